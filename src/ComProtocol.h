@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include "config.h"
 #if defined(_WIN32)
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -331,6 +332,23 @@ struct ConfigCmd
 
     char* save;//日志要保存的文件名(-f)，没有该选项则输出到屏幕
 
+    uint32_t  threads;           // 线程池EventLoop数量(-j)，tcp服务端把新连接分散到线程池，默认0不启用
+    bool      least_loaded;      // 线程池选择负载最小的poller(--balance least)，默认轮询(--balance rr)
+    bool      io_uring;          // EventLoop使用io_uring代替epoll(--io-uring)，内核不支持时回退到epoll
+    uint32_t  busy_poll;         // EventLoop空闲时忙轮询的时长(--busy-poll)，微秒，默认0不启用
+    bool      sock_busy_poll;    // socket同时设置SO_BUSY_POLL(--sock-busy-poll)，时长同busy_poll
+    uint32_t  read_budget;       // socket每次可读事件最多读取次数(--read-budget)，0为读尽为止
+    uint64_t  read_budget_bytes; // socket每次可读事件最多读取字节数(--read-budget)，0为不限
+    uint32_t  batch;             // udp压测每次sendmmsg发送的包数(--batch)，默认1逐包sendto
+    uint32_t  recv_batch;        // udp和raw socket每次recvmmsg接收的包数(--recv-batch)，1为逐包recvfrom
+    uint32_t  gso;               // udp压测每次GSO发送的包数(--gso)，默认0不使用
+    bool      gro;               // udp压测服务端开启UDP GRO接收合并包(--gro)
+    bool      zerocopy;          // tcp压测和文件发送使用MSG_ZEROCOPY零拷贝发送(--zerocopy)
+    bool      send_list;         // 压测客户端使用Socket发送队列，由poller线程批量发送(--send-list)
+    bool      steer_cpu;         // udp服务端分片(-j)时按接收cpu选择分片(--steer-cpu)，默认按对端地址哈希
+    bool      timestamp;         // 压测socket开启SO_TIMESTAMPING，总结中输出收发各阶段耗时(--timestamp)
+    bool      single_socket;     // udp服务端所有对端共用监听socket收发，不为每个对端创建connect的socket(--single-socket)
+
     ConfigCmd()
     {
         role = ' ';
@@ -350,6 +368,22 @@ struct ConfigCmd
         dst = nullptr;
         interfaceC = nullptr;
         memset(dstmac,0,6);
+        threads = 0;
+        least_loaded = false;
+        io_uring = false;
+        busy_poll = 0;
+        sock_busy_poll = false;
+        read_budget = SOCK_READ_BUDGET_DEFAULT;
+        read_budget_bytes = 0;
+        batch = 1;
+        recv_batch = SOCK_RECV_BATCH_DEFAULT;
+        gso = 0;
+        gro = false;
+        zerocopy = false;
+        send_list = false;
+        steer_cpu = false;
+        timestamp = false;
+        single_socket = false;
     }
 };
 
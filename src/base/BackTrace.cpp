@@ -153,7 +153,7 @@ void chw_assert()
             printf("#%d %p %d %s\n", i, frame, parsed, fmt);
         }
 
-        free(symbols);
+        ::free(symbols);
 #endif
 
     // assert(0);// 会触发SIGABRT(6)信号，导致循环调用
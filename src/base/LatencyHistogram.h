@@ -0,0 +1,136 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __LATENCY_HISTOGRAM_H
+#define __LATENCY_HISTOGRAM_H
+
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+namespace chw {
+
+/**
+ * 延时分布统计，按2的幂分桶，第i个桶记录[2^(i-1), 2^i)微秒的样本数。
+ * 计数只增不减，只允许一个线程记录，snapshot可在其他线程调用，区间统计由调用者对两次快照求差。
+ */
+class LatencyHistogram {
+public:
+    static const int kBuckets = 32;
+
+    struct Snapshot {
+        uint64_t buckets[kBuckets] = {0};
+
+        uint64_t count() const {
+            uint64_t ret = 0;
+            for (int i = 0; i < kBuckets; ++i) {
+                ret += buckets[i];
+            }
+            return ret;
+        }
+
+        /**
+         * @brief 获取分位数，返回所在桶的上限
+         *
+         * @param ratio [in]分位，0~1
+         * @return uint64_t 延时上限，微秒
+         */
+        uint64_t percentile(double ratio) const {
+            uint64_t total = count();
+            if (total == 0) {
+                return 0;
+            }
+            uint64_t target = (uint64_t)(total * ratio);
+            if (target >= total) {
+                target = total - 1;
+            }
+            uint64_t sum = 0;
+            for (int i = 0; i < kBuckets; ++i) {
+                sum += buckets[i];
+                if (sum > target) {
+                    return bucketLimit(i);
+                }
+            }
+            return bucketLimit(kBuckets - 1);
+        }
+
+        /**
+         * @brief 最大值所在桶的上限，微秒
+         */
+        uint64_t max() const {
+            for (int i = kBuckets - 1; i >= 0; --i) {
+                if (buckets[i]) {
+                    return bucketLimit(i);
+                }
+            }
+            return 0;
+        }
+
+        Snapshot operator-(const Snapshot &other) const {
+            Snapshot ret;
+            for (int i = 0; i < kBuckets; ++i) {
+                ret.buckets[i] = buckets[i] - other.buckets[i];
+            }
+            return ret;
+        }
+
+        Snapshot &operator+=(const Snapshot &other) {
+            for (int i = 0; i < kBuckets; ++i) {
+                buckets[i] += other.buckets[i];
+            }
+            return *this;
+        }
+
+        /**
+         * @brief 格式化为"p50/p99/max"，单位微秒，没有样本时返回"-"
+         */
+        std::string toString() const {
+            if (count() == 0) {
+                return "-";
+            }
+            return std::to_string(percentile(0.5)) + "/" + std::to_string(percentile(0.99)) + "/" + std::to_string(max()) + "us";
+        }
+    };
+
+    LatencyHistogram() {
+        for (int i = 0; i < kBuckets; ++i) {
+            _buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 记录一个样本，只允许一个线程调用
+     *
+     * @param us [in]延时，微秒
+     */
+    void record(uint64_t us) {
+        int i = us ? 64 - __builtin_clzll(us) : 0;
+        if (i >= kBuckets) {
+            i = kBuckets - 1;
+        }
+        _buckets[i].store(_buckets[i].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 获取累计计数快照（可在任意线程执行）
+     */
+    Snapshot snapshot() const {
+        Snapshot ret;
+        for (int i = 0; i < kBuckets; ++i) {
+            ret.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+        }
+        return ret;
+    }
+
+private:
+    static uint64_t bucketLimit(int i) {
+        return i ? (1ULL << i) : 0;
+    }
+
+private:
+    std::atomic<uint64_t> _buckets[kBuckets];
+};
+
+} //namespace chw
+
+#endif //__LATENCY_HISTOGRAM_H
@@ -656,7 +656,7 @@ void LoggerWrapper::printLogV(Logger &logger, int level, const char *file, const
 #ifdef ASAN_USE_DELETE
         delete [] str; // 开启asan后，用free会卡死
 #else
-        free(str);
+        ::free(str);// vasprintf用libc malloc分配，不能用chw::free
 #endif
     }
 }
@@ -9,15 +9,22 @@
 #include <assert.h>
 #include <sys/types.h>
 #include "util.h"
+#include "MemoryPool.h"
 
 #ifndef _MEMORY_PROTECT_
 #define _MEMORY_PROTECT_ 0
 #endif //_MEMORY_PROTECT_
 
+// _RAM_NEW_/_RAM_DEL_使用MemoryPool，为0时直接使用new/delete
+#ifndef _MEMORY_POOL_
+#define _MEMORY_POOL_ 1
+#endif //_MEMORY_POOL_
+
 #define MAX_ALLOC_MEMORY (500*1024*1024)
 
 #define _RAM_NEW_(len) chw::malloc(len)
 #define _RAM_DEL_(ptr) chw::free(ptr)
+#define _RAM_FIT_(len) chw::fit_size(len)
 #define _RAM_SET_(pDst,uDstLen,SetValue,uSetLen) chw::s_memset(pDst,uDstLen,SetValue,uSetLen)
 #define _RAM_ZERQ_(pDst,uDstLen,uSetPos) chw::s_memzero(pDst,uDstLen,uSetPos)
 #define _RAM_CPY_(pDst,uDstLen,pSrc,uCpyLen) chw::s_memcpy(pDst,uDstLen,pSrc,uCpyLen)
@@ -38,7 +45,11 @@ static inline void *malloc(size_t size)
 #endif
     void *buf = NULL;
     try {
+#if _MEMORY_POOL_
+        buf = MemoryPool::Alloc(size);
+#else
         buf = ::new char[size];
+#endif //_MEMORY_POOL_
     } catch (...) {
         throw std::bad_alloc();
     }
@@ -52,7 +63,25 @@ static inline void *malloc(size_t size)
  */
 static inline void free(void *buf)
 {
+#if _MEMORY_POOL_
+    MemoryPool::Free(buf);
+#else
     delete[] (char*)buf;
+#endif //_MEMORY_POOL_
+}
+
+/**
+ * @brief 申请size字节时实际可用的大小，使用内存池时向上取整到所在分级
+ * @param size 申请大小
+ * @return 可用大小
+ */
+static inline size_t fit_size(size_t size)
+{
+#if _MEMORY_POOL_
+    return MemoryPool::FitSize(size);
+#else
+    return size;
+#endif //_MEMORY_POOL_
 }
 
 /**
@@ -0,0 +1,350 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#include "MemoryPool.h"
+#include "Logger.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+
+namespace chw {
+
+// 分级大小从2^kMinShift到2^kMaxShift
+static const uint32_t kMinShift = 6;
+static const uint32_t kMaxShift = 20;
+static const uint32_t kClasses = kMaxShift - kMinShift + 1;
+// 超过最大分级直接向系统申请
+static const uint32_t kLargeClass = kClasses;
+
+// 每个线程每级最多缓存的字节数和块数，至少缓存kMinCached块
+static const size_t kThreadCacheBytes = 4 << 20;
+static const uint32_t kMaxCached = 256;
+static const uint32_t kMinCached = 4;
+// 全局空闲链表每级最多缓存的字节数，超过时释放给系统
+static const size_t kCentralBytes = 64 << 20;
+
+static const uint32_t kMagic = 0x4d504f4c;
+
+// 块头，位于返回给用户的内存之前，16字节保证用户内存按16字节对齐
+struct BlockHdr {
+    uint32_t cls;
+    uint32_t magic;
+    uint64_t size;// 块大小，不含块头
+};
+
+// 空闲块复用块头位置保存链表指针
+struct FreeNode {
+    FreeNode *next;
+};
+
+static_assert(sizeof(BlockHdr) == 16, "BlockHdr must be 16 bytes");
+
+static inline uint32_t classOf(size_t size) {
+    if (size <= ((size_t)1 << kMinShift)) {
+        return 0;
+    }
+    if (size > ((size_t)1 << kMaxShift)) {
+        return kLargeClass;
+    }
+    return 64 - __builtin_clzll(size - 1) - kMinShift;
+}
+
+static inline size_t classSize(uint32_t cls) {
+    return (size_t)1 << (cls + kMinShift);
+}
+
+static inline uint32_t cacheLimit(uint32_t cls) {
+    size_t n = kThreadCacheBytes / classSize(cls);
+    if (n > kMaxCached) {
+        return kMaxCached;
+    }
+    return n < kMinCached ? kMinCached : (uint32_t)n;
+}
+
+// 线程缓存已析构时的计数，只有线程退出阶段使用；used/peak按分级大小统计
+static std::atomic<uint64_t> s_alloc{0};
+static std::atomic<uint64_t> s_hit{0};
+static std::atomic<int64_t> s_used{0};
+// GetStat时采样的峰值
+static std::atomic<uint64_t> s_peak{0};
+
+// 只有一个线程修改的计数，不需要原子加，其他线程可以读取
+template<typename T>
+static inline void addLocal(std::atomic<T> &counter, T n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+// 全局空闲链表，每级一把锁
+struct CentralList {
+    std::mutex mtx;
+    FreeNode *head = nullptr;
+    uint32_t count = 0;
+};
+
+// 进程退出时其他静态对象析构仍可能释放内存，全局空闲链表不析构
+static CentralList *central() {
+    static CentralList *s_central = new CentralList[kClasses];
+    return s_central;
+}
+
+static void releaseToSystem(FreeNode *node) {
+    ::delete[] (char *)node;
+}
+
+struct ThreadCache;
+
+// 所有线程缓存，GetStat时汇总各线程的计数
+struct CacheRegistry {
+    std::mutex mtx;
+    std::vector<ThreadCache *> caches;
+    // 已退出线程的计数
+    uint64_t alloc = 0;
+    uint64_t hit = 0;
+    int64_t used = 0;
+};
+
+static CacheRegistry *registry() {
+    static CacheRegistry *s_registry = new CacheRegistry;
+    return s_registry;
+}
+
+/**
+ * 线程缓存，线程退出时归还到全局空闲链表
+ * 计数也按线程保存，申请和释放不竞争全局原子变量
+ */
+struct ThreadCache {
+    FreeNode *head[kClasses] = {nullptr};
+    uint32_t count[kClasses] = {0};
+    std::atomic<uint64_t> alloc{0};
+    std::atomic<uint64_t> hit{0};
+    std::atomic<int64_t> used{0};// 在其他线程申请的内存在本线程释放时可能为负
+
+    ThreadCache();
+    ~ThreadCache();
+
+    // 从全局空闲链表批量取一半上限的块
+    void fetch(uint32_t cls) {
+        auto &list = central()[cls];
+        uint32_t want = cacheLimit(cls) / 2;
+        std::lock_guard<std::mutex> lck(list.mtx);
+        while (list.head && count[cls] < want) {
+            FreeNode *node = list.head;
+            list.head = node->next;
+            --list.count;
+            node->next = head[cls];
+            head[cls] = node;
+            ++count[cls];
+        }
+    }
+
+    // 归还n块到全局空闲链表，超过全局上限的释放给系统
+    void release(uint32_t cls, uint32_t n) {
+        auto &list = central()[cls];
+        uint32_t max = kCentralBytes / classSize(cls);
+        FreeNode *drop = nullptr;
+        {
+            std::lock_guard<std::mutex> lck(list.mtx);
+            while (head[cls] && n--) {
+                FreeNode *node = head[cls];
+                head[cls] = node->next;
+                --count[cls];
+                if (list.count < max) {
+                    node->next = list.head;
+                    list.head = node;
+                    ++list.count;
+                } else {
+                    node->next = drop;
+                    drop = node;
+                }
+            }
+        }
+        while (drop) {
+            FreeNode *node = drop;
+            drop = node->next;
+            releaseToSystem(node);
+        }
+    }
+};
+
+// 线程缓存析构后本线程的释放直接归还全局空闲链表
+static thread_local bool t_cache_alive = false;
+static thread_local ThreadCache t_cache;
+
+ThreadCache::ThreadCache() {
+    auto reg = registry();
+    std::lock_guard<std::mutex> lck(reg->mtx);
+    reg->caches.emplace_back(this);
+}
+
+ThreadCache::~ThreadCache() {
+    t_cache_alive = false;
+    for (uint32_t cls = 0; cls < kClasses; ++cls) {
+        release(cls, count[cls]);
+    }
+
+    auto reg = registry();
+    std::lock_guard<std::mutex> lck(reg->mtx);
+    reg->alloc += alloc.load(std::memory_order_relaxed);
+    reg->hit += hit.load(std::memory_order_relaxed);
+    reg->used += used.load(std::memory_order_relaxed);
+    reg->caches.erase(std::find(reg->caches.begin(), reg->caches.end(), this));
+}
+
+static inline ThreadCache *threadCache() {
+    if (!t_cache_alive) {
+        // 首次使用时构造，线程退出析构后不再使用
+        static thread_local bool t_cache_inited = false;
+        if (t_cache_inited) {
+            return nullptr;
+        }
+        t_cache_inited = true;
+        t_cache_alive = true;
+    }
+    return &t_cache;
+}
+
+void *MemoryPool::Alloc(size_t size) {
+    uint32_t cls = classOf(size);
+    size_t block = cls == kLargeClass ? size : classSize(cls);
+
+    ThreadCache *cache = threadCache();
+    FreeNode *node = nullptr;
+    if (cls != kLargeClass) {
+        if (cache) {
+            if (!cache->head[cls]) {
+                cache->fetch(cls);
+            }
+            node = cache->head[cls];
+            if (node) {
+                cache->head[cls] = node->next;
+                --cache->count[cls];
+            }
+        } else {
+            auto &list = central()[cls];
+            std::lock_guard<std::mutex> lck(list.mtx);
+            node = list.head;
+            if (node) {
+                list.head = node->next;
+                --list.count;
+            }
+        }
+    }
+
+    uint64_t hit = node ? 1 : 0;
+    if (!node) {
+        // 向系统申请，失败时抛出std::bad_alloc
+        node = (FreeNode *)::new char[sizeof(BlockHdr) + block];
+    }
+
+    if (cache) {
+        addLocal<uint64_t>(cache->alloc, 1);
+        addLocal<uint64_t>(cache->hit, hit);
+        addLocal<int64_t>(cache->used, block);
+    } else {
+        s_alloc.fetch_add(1, std::memory_order_relaxed);
+        s_hit.fetch_add(hit, std::memory_order_relaxed);
+        s_used.fetch_add(block, std::memory_order_relaxed);
+    }
+
+    BlockHdr *hdr = (BlockHdr *)node;
+    hdr->cls = cls;
+    hdr->magic = kMagic;
+    hdr->size = block;
+    return hdr + 1;
+}
+
+void MemoryPool::Free(void *ptr) {
+    if (ptr == nullptr) {
+        return;
+    }
+    BlockHdr *hdr = (BlockHdr *)ptr - 1;
+    if (hdr->magic != kMagic) {
+        // 不是本内存池申请的内存，或重复释放，不再归还
+        ErrorL << "MemoryPool free invalid pointer:" << ptr;
+        return;
+    }
+    hdr->magic = 0;
+    uint32_t cls = hdr->cls;
+
+    ThreadCache *cache = threadCache();
+    if (cache) {
+        addLocal<int64_t>(cache->used, -(int64_t)hdr->size);
+    } else {
+        s_used.fetch_sub(hdr->size, std::memory_order_relaxed);
+    }
+
+    FreeNode *node = (FreeNode *)hdr;
+    if (cls == kLargeClass) {
+        releaseToSystem(node);
+        return;
+    }
+
+    if (!cache) {
+        auto &list = central()[cls];
+        std::lock_guard<std::mutex> lck(list.mtx);
+        node->next = list.head;
+        list.head = node;
+        ++list.count;
+        return;
+    }
+
+    node->next = cache->head[cls];
+    cache->head[cls] = node;
+    if (++cache->count[cls] > cacheLimit(cls)) {
+        // 缓存满了，归还一半，避免在阈值附近反复归还和获取
+        cache->release(cls, cache->count[cls] / 2);
+    }
+}
+
+size_t MemoryPool::FitSize(size_t size) {
+    uint32_t cls = classOf(size);
+    return cls == kLargeClass ? size : classSize(cls);
+}
+
+MemoryPool::Stat MemoryPool::GetStat() {
+    Stat stat;
+    stat.alloc = s_alloc.load(std::memory_order_relaxed);
+    stat.hit = s_hit.load(std::memory_order_relaxed);
+    int64_t used = s_used.load(std::memory_order_relaxed);
+    {
+        // 汇总各线程的计数，读取时其他线程可能正在修改，结果是近似值
+        auto reg = registry();
+        std::lock_guard<std::mutex> lck(reg->mtx);
+        stat.alloc += reg->alloc;
+        stat.hit += reg->hit;
+        used += reg->used;
+        for (auto cache : reg->caches) {
+            stat.alloc += cache->alloc.load(std::memory_order_relaxed);
+            stat.hit += cache->hit.load(std::memory_order_relaxed);
+            used += cache->used.load(std::memory_order_relaxed);
+        }
+    }
+    stat.used = used > 0 ? used : 0;
+
+    // 峰值在每次统计时采样，两次统计之间的短暂峰值可能漏掉
+    uint64_t peak = s_peak.load(std::memory_order_relaxed);
+    while (stat.used > peak && !s_peak.compare_exchange_weak(peak, stat.used, std::memory_order_relaxed)) {
+    }
+    stat.peak = std::max(peak, stat.used);
+    for (uint32_t cls = 0; cls < kClasses; ++cls) {
+        auto &list = central()[cls];
+        std::lock_guard<std::mutex> lck(list.mtx);
+        stat.cached += (uint64_t)list.count * classSize(cls);
+    }
+    return stat;
+}
+
+std::string MemoryPool::Stat::toString() const {
+    std::ostringstream oss;
+    oss << "hit:" << std::setprecision(2) << std::fixed << (alloc ? (double)hit * 100 / alloc : 100.0) << "%"
+        << ",malloc:" << alloc - hit
+        << ",used:" << (double)used / (1 << 20) << "MB"
+        << ",peak:" << (double)peak / (1 << 20) << "MB";
+    return oss.str();
+}
+
+} //namespace chw
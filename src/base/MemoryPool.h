@@ -0,0 +1,65 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __MEMORY_POOL_H
+#define __MEMORY_POOL_H
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace chw {
+
+/**
+ * 按大小分级的内存池，_RAM_NEW_/_RAM_DEL_的底层实现。
+ * 申请大小向上取整到2的幂(64B~1MB)，每个线程缓存各级空闲块，缓存满时批量归还到全局空闲链表，
+ * 缓存空时先从全局空闲链表批量取，都没有才向系统申请；超过1MB的直接向系统申请。
+ * 稳定运行时收发路径的申请释放都在线程缓存中完成，不调用系统分配。
+ */
+class MemoryPool {
+public:
+    struct Stat {
+        uint64_t alloc = 0;     // 申请次数
+        uint64_t hit = 0;       // 从池中取得的次数
+        uint64_t used = 0;      // 当前已申请未释放的字节数(按分级大小)
+        uint64_t peak = 0;      // used的峰值，每次GetStat时采样，是近似值
+        uint64_t cached = 0;    // 全局空闲链表中缓存的字节数，不含线程缓存
+
+        /**
+         * @brief 格式化为"hit:99.99%,used:1.00MB,peak:2.00MB"
+         */
+        std::string toString() const;
+    };
+
+    /**
+     * @brief 申请内存
+     *
+     * @param size [in]大小
+     * @return void* 内存，失败抛出std::bad_alloc
+     */
+    static void *Alloc(size_t size);
+
+    /**
+     * @brief 释放Alloc申请的内存，可以在任意线程释放
+     *
+     * @param ptr [in]内存，nullptr时不处理
+     */
+    static void Free(void *ptr);
+
+    /**
+     * @brief 申请size字节时实际可用的大小，即所在分级的大小
+     *
+     * @param size [in]大小
+     * @return size_t 可用大小
+     */
+    static size_t FitSize(size_t size);
+
+    /**
+     * @brief 获取统计计数（任意线程执行）
+     */
+    static Stat GetStat();
+};
+
+} //namespace chw
+
+#endif //__MEMORY_POOL_H
@@ -14,6 +14,7 @@
 */
 
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
 
 namespace chw {
@@ -62,6 +63,33 @@ public:
 #endif
     }
 
+    /**
+     * @brief 等待信号，最多等待ms毫秒
+     *
+     * @param ms [in]超时时间，毫秒
+     * @return bool 收到信号返回true，超时返回false
+     */
+    bool waitFor(uint32_t ms) {
+#if defined(HAVE_SEM)
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += ms / 1000;
+        ts.tv_nsec += (ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ++ts.tv_sec;
+            ts.tv_nsec -= 1000000000L;
+        }
+        return sem_timedwait(&_sem, &ts) == 0;
+#else
+        std::unique_lock<std::recursive_mutex> lock(_mutex);
+        if (!_condition.wait_for(lock, std::chrono::milliseconds(ms), [this]() { return _count > 0; })) {
+            return false;
+        }
+        --_count;
+        return true;
+#endif
+    }
+
 private:
 #if defined(HAVE_SEM)
     sem_t _sem;
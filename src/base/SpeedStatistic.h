@@ -4,6 +4,7 @@
 #ifndef __SPEED_STATISTIC_H
 #define __SPEED_STATISTIC_H
 
+#include <atomic>
 #include "TimeTicker.h"
 
 namespace chw {
@@ -14,10 +15,10 @@ public:
     ~BytesSpeed() = default;
 
     /**
-     * 添加统计字节
+     * 添加统计字节，只允许一个线程累加，getSpeed可在其他线程调用
      */
     BytesSpeed &operator+=(uint64_t bytes) {
-        _bytes += bytes;
+        _bytes.store(_bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
 #if 0//chw:只在需要时计算速率
         if (_bytes > 1024 * 1024) {
             //数据大于1MB就计算一次网速
@@ -46,16 +47,17 @@ private:
         if (elapsed == 0) {
             return _speed;
         }
-        _speed = ((_bytes - _bytes_last) * 1000 / elapsed);
+        uint64_t bytes = _bytes.load(std::memory_order_relaxed);
+        _speed = ((bytes - _bytes_last) * 1000 / elapsed);
         _ticker.resetTime();
         // _bytes = 0;
-        _bytes_last = _bytes;
+        _bytes_last = bytes;
         return _speed;
     }
 
 private:
     uint64_t _speed = 0;
-    uint64_t _bytes = 0;
+    std::atomic<uint64_t> _bytes{0};
     uint64_t _bytes_last = 0;// 上一次统计的字节数
     Ticker _ticker;
 };
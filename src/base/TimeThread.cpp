@@ -4,6 +4,7 @@
 #include "TimeThread.h"
 #include <atomic>
 #include <thread>
+#include <chrono>
 #include "Logger.h"
 #include "onceToken.h"
 #include "local_time.h"
@@ -107,4 +108,18 @@ uint64_t getCurrentMicrosecond(bool system_time) {
     return s_currentMicrosecond.load(memory_order_acquire);
 }
 
+uint64_t getMonotonicMicrosecond() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t getMonotonicNanosecond() {
+#if !defined(_WIN32)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
 }//namespace chw
\ No newline at end of file
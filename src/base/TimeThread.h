@@ -28,6 +28,16 @@ uint64_t getCurrentMillisecond(bool system_time = false);
  */
 uint64_t getCurrentMicrosecond(bool system_time = false);
 
+/**
+ * 获取单调时钟的微秒数，直接读取时钟，精度高于getCurrentMicrosecond，用于短时间间隔统计
+ */
+uint64_t getMonotonicMicrosecond();
+
+/**
+ * 获取单调时钟的纳秒数，linux下与CLOCK_MONOTONIC的timerfd使用同一时钟
+ */
+uint64_t getMonotonicNanosecond();
+
 
 }//namespace chw
 
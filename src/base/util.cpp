@@ -72,14 +72,14 @@ namespace chw {
             return -1;
         }
         size_t size = (size_t)len + 1;
-        char* str = (char*)malloc(size);
+        char* str = (char*)::malloc(size);
         if (!str) {
             return -1;
         }
         // _vsprintf_s is the "secure" version of vsprintf
         int r = vsprintf_s(str, len + 1, fmt, ap);
         if (r == -1) {
-            free(str);
+            ::free(str);
             return -1;
         }
         *strp = str;
@@ -819,7 +819,7 @@ std::string demangle(const char *mangled) {
 #ifdef ASAN_USE_DELETE
         delete [] demangled; // 开启asan后，用free会卡死
 #else
-        free(demangled);
+        ::free(demangled);// __cxa_demangle用libc malloc分配，不能用chw::free
 #endif
     } else {
         out.append(mangled);
@@ -10,6 +10,7 @@
 
 #include <stdlib.h>// for exit
 #include <stdio.h>// for printf
+#include <string.h>// for strcmp
 
 #include "GlobalValue.h"
 #include "Logger.h"
@@ -21,6 +22,28 @@ namespace chw {
 #define MIN_INTERVAL 0.1
 #define MAX_INTERVAL 60.0
 
+#define MAX_THREADS 256
+#define MAX_BUSY_POLL 1000000
+#define MAX_BATCH 1024// sendmmsg/recvmmsg一次最多收发UIO_MAXIOV个包
+
+// 只有长选项的参数标识，从256开始避开单字符选项
+enum {
+    OPT_BALANCE = 256,
+    OPT_IO_URING,
+    OPT_BUSY_POLL,
+    OPT_SOCK_BUSY_POLL,
+    OPT_READ_BUDGET,
+    OPT_BATCH,
+    OPT_RECV_BATCH,
+    OPT_GSO,
+    OPT_GRO,
+    OPT_ZEROCOPY,
+    OPT_SEND_LIST,
+    OPT_STEER_CPU,
+    OPT_TIMESTAMP,
+    OPT_SINGLE_SOCKET,
+};
+
 const double KILO_UNIT = 1024.0;
 const double MEGA_UNIT = 1024.0 * 1024.0;
 const double GIGA_UNIT = 1024.0 * 1024.0 * 1024.0;
@@ -107,12 +130,28 @@ uint32_t CmdLineParse::parse_arguments(int argc, char **argv)
         {"interface", required_argument, NULL, 'I'},
         {"dstmac", required_argument, NULL, 'M'},
 
+        {"threads", required_argument, NULL, 'j'},
+        {"balance", required_argument, NULL, OPT_BALANCE},
+        {"io-uring", no_argument, NULL, OPT_IO_URING},
+        {"busy-poll", required_argument, NULL, OPT_BUSY_POLL},
+        {"sock-busy-poll", no_argument, NULL, OPT_SOCK_BUSY_POLL},
+        {"read-budget", required_argument, NULL, OPT_READ_BUDGET},
+        {"batch", required_argument, NULL, OPT_BATCH},
+        {"recv-batch", required_argument, NULL, OPT_RECV_BATCH},
+        {"gso", required_argument, NULL, OPT_GSO},
+        {"gro", no_argument, NULL, OPT_GRO},
+        {"zerocopy", no_argument, NULL, OPT_ZEROCOPY},
+        {"send-list", no_argument, NULL, OPT_SEND_LIST},
+        {"steer-cpu", no_argument, NULL, OPT_STEER_CPU},
+        {"timestamp", no_argument, NULL, OPT_TIMESTAMP},
+        {"single-socket", no_argument, NULL, OPT_SINGLE_SOCKET},
+
         {NULL, 0, NULL, 0}
     };
     int flag;
     int portno;
    
-    while ((flag = getopt_long(argc, argv, "hvsu46p:c:t:i:B:l:b:f:S:D:PFn:rI:M:", longopts, NULL)) != -1) {
+    while ((flag = getopt_long(argc, argv, "hvsu46p:c:t:i:B:l:b:f:S:D:PFn:rI:M:j:", longopts, NULL)) != -1) {
         switch (flag) {
             case 'h':
 				help();
@@ -222,6 +261,89 @@ uint32_t CmdLineParse::parse_arguments(int argc, char **argv)
                     return chw::fail;
                 }
                 break;
+
+            case 'j':
+                if (atoi(optarg) < 0 || atoi(optarg) > MAX_THREADS) {
+                    printf("Invalid threads number:%s (max = %d)\n",optarg,MAX_THREADS);
+                    return chw::fail;
+                }
+                gConfigCmd.threads = atoi(optarg);
+                break;
+            case OPT_BALANCE:
+                if (strcmp(optarg, "rr") == 0) {
+                    gConfigCmd.least_loaded = false;
+                } else if (strcmp(optarg, "least") == 0) {
+                    gConfigCmd.least_loaded = true;
+                } else {
+                    printf("Invalid balance:%s, must be rr or least\n",optarg);
+                    return chw::fail;
+                }
+                break;
+            case OPT_IO_URING:
+                gConfigCmd.io_uring = true;
+                break;
+            case OPT_BUSY_POLL:
+                if (atoi(optarg) < 0 || atoi(optarg) > MAX_BUSY_POLL) {
+                    printf("Invalid busy poll time:%s (max = %d us)\n",optarg,MAX_BUSY_POLL);
+                    return chw::fail;
+                }
+                gConfigCmd.busy_poll = atoi(optarg);
+                break;
+            case OPT_SOCK_BUSY_POLL:
+                gConfigCmd.sock_busy_poll = true;
+                break;
+            case OPT_READ_BUDGET:
+            {
+                // 格式: 次数[,字节数]
+                int count = 0;
+                long long bytes = 0;
+                if (sscanf(optarg, "%d,%lld", &count, &bytes) < 1 || count < 0 || bytes < 0) {
+                    printf("Invalid read budget:%s, must be <count>[,<bytes>]\n",optarg);
+                    return chw::fail;
+                }
+                gConfigCmd.read_budget = count;
+                gConfigCmd.read_budget_bytes = bytes;
+                break;
+            }
+            case OPT_BATCH:
+                if (atoi(optarg) < 1 || atoi(optarg) > MAX_BATCH) {
+                    printf("Invalid batch:%s (1 ~ %d)\n",optarg,MAX_BATCH);
+                    return chw::fail;
+                }
+                gConfigCmd.batch = atoi(optarg);
+                break;
+            case OPT_RECV_BATCH:
+                if (atoi(optarg) < 1 || atoi(optarg) > MAX_BATCH) {
+                    printf("Invalid recv batch:%s (1 ~ %d)\n",optarg,MAX_BATCH);
+                    return chw::fail;
+                }
+                gConfigCmd.recv_batch = atoi(optarg);
+                break;
+            case OPT_GSO:
+                if (atoi(optarg) < 0 || atoi(optarg) > UDP_GSO_MAX_SEGMENTS) {
+                    printf("Invalid gso:%s (0 ~ %d)\n",optarg,UDP_GSO_MAX_SEGMENTS);
+                    return chw::fail;
+                }
+                gConfigCmd.gso = atoi(optarg);
+                break;
+            case OPT_GRO:
+                gConfigCmd.gro = true;
+                break;
+            case OPT_ZEROCOPY:
+                gConfigCmd.zerocopy = true;
+                break;
+            case OPT_SEND_LIST:
+                gConfigCmd.send_list = true;
+                break;
+            case OPT_STEER_CPU:
+                gConfigCmd.steer_cpu = true;
+                break;
+            case OPT_TIMESTAMP:
+                gConfigCmd.timestamp = true;
+                break;
+            case OPT_SINGLE_SOCKET:
+                gConfigCmd.single_socket = true;
+                break;
                 
             default:
 				printf("Incorrect parameter option, --help for help.\n");
@@ -278,9 +400,20 @@ void CmdLineParse::help()
             "  -P, --Perf                Performance test mode\n"
             "  -F, --File                File transmission mode\n"
             "  -B, --bind      <host>    bind to a specific interface\n"
+            "  -j, --threads   #         number of cpu-pinned event loops, server sessions spread across them\n"
+            "  --balance       <rr|least> how to pick a loop for a new session, round-robin(default) or least-loaded\n"
+            "  --io-uring                use io_uring instead of epoll for event loops, fallback to epoll if unsupported\n"
+            "  --busy-poll     #         event loops spin for # microseconds before sleeping, trade cpu for latency\n"
+            "  --sock-busy-poll          set SO_BUSY_POLL on sockets, spin time from --busy-poll(default 50us)\n"
+            "  --read-budget   <n>[,b]   max reads(default 64) and bytes per socket wakeup before yielding to other fds, 0 = drain\n"
+            "  --recv-batch    #         udp/raw sockets receive up to # packets per recvmmsg call(default 16), 1 = recvfrom\n"
+            "  --timestamp               -P model, SO_TIMESTAMPING on sockets, summary splits rx/tx time into stack, wire and app\n"
 
             "Server specific:\n"
             "  -s, --server              run in server mode\n"
+            "  --gro                     -P -u model, receive coalesced packets with UDP_GRO, counted per packet\n"
+            "  --steer-cpu               -u model with -j, pick the loop's socket by receiving cpu instead of peer address hash\n"
+            "  --single-socket           -u model, demux all peers on the listening socket instead of one connected socket per peer\n"
             
             "Client specific:\n"
             "  -c, --client    <host>    run in client mode, connecting to <host>\n"
@@ -290,6 +423,10 @@ void CmdLineParse::help()
             "  -S, --src                 --File(-F) model,Source file path, include file name\n"
             "  -D, --dst                 --File(-F) model,Purpose file save path,exclusive file name\n"
             "  -n, --number              client bind port\n"
+            "  --batch         #         -P -u model, send # packets per sendmmsg call(default 1, plain sendto)\n"
+            "  --gso           #         -P -u model, send # equal-size packets per UDP_SEGMENT call, fallback to --batch path if unsupported\n"
+            "  --zerocopy                -P or -F tcp model, send with MSG_ZEROCOPY, buffers reused after kernel completion\n"
+            "  --send-list               -P model, queue packets and flush them from the event loop with sendmsg(tcp)/sendmmsg(udp)\n"
 
             "raw socket:\n"
             "  -r, --raw                 run raw socket, only for -T and -P mode\n"
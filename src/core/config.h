@@ -63,4 +63,39 @@
 // 文件传输时每包大小
 #define FILE_SEND_MTU   1460
 
+// 未指定--busy-poll时socket的SO_BUSY_POLL时长，单位微秒
+#define SOCK_BUSY_POLL_DEFAULT 50
+
+// socket每次可读事件最多读取的次数，读满后让出轮询线程，剩余数据排队到下一轮读取，0为读尽为止
+#define SOCK_READ_BUDGET_DEFAULT 64
+
+// udp和raw socket每次recvmmsg最多接收的包数，1为逐包recvfrom
+#define SOCK_RECV_BATCH_DEFAULT 16
+
+// 开启SO_TIMESTAMPING时保存发送时间戳的槽数，按OPT_ID序号取模，关联同一次发送的SCHED和SND时间戳
+#define SOCK_TX_STAMP_SLOTS 1024
+
+// tcp私有读缓存的初始大小，读满时翻倍直到TCP_BUFFER_SIZE
+#define SOCK_RECV_BUF_MIN   4 * 1024
+
+// tcp私有读缓存连续多少次读取量不足1/4时缩小一半
+#define SOCK_RECV_SHRINK_TIMES  64
+
+// 零拷贝发送和发送队列使用的发送缓存环总大小，Buffer在发送完成前不能复用，需要大于socket发送缓存
+#define SEND_RING_BYTES (16<<20)
+
+// 发送缓存环的Buffer个数上下限
+#define SEND_RING_MIN   4
+#define SEND_RING_MAX   1024
+
+// Socket发送队列(send_l)允许积压的最大字节数，超过时入队失败
+#define SEND_LIST_MAX_BYTES (64<<20)
+
+// Socket发送队列攒够多少个消息立即发送，不足时延时发送的毫秒数
+#define SEND_LIST_BATCH     256
+#define SEND_LIST_DELAY_MS  1
+
+// 发送线程等待socket可写时，每次等待的最长毫秒数，超时后重新检查连接状态
+#define WAIT_WRITABLE_SLICE_MS  100
+
 #endif//__CONFIG_H
\ No newline at end of file
@@ -44,7 +44,7 @@ void FileRecv::SetSndData(std::function<uint32_t(char* buf, uint32_t )> cb)
  */
 void FileRecv::onRecv(const Buffer::Ptr &buf)
 {
-    if(StickyPacket(buf,STD_BIND_2(FileRecv::DispatchMsg,this)) == chw::fail)
+    if(StickyPacket(buf,_chain,std::bind(&FileRecv::DispatchView,this,std::placeholders::_1)) == chw::fail)
     {
         sleep_exit(100 * 1000);
     }
@@ -67,15 +67,37 @@ void FileRecv::DispatchMsg(char* buf, uint32_t len)
         case FILE_TRAN_END:
             procTranEnd(buf);
             break;
-        case FILE_TRAN_DATA:
-            procFileData(buf,len);
-            break;
 
         default:
             break;
     }
 }
 
+/**
+ * @brief 分发粘包处理后的消息，文件数据不拷贝直接写入，跨分段的信令消息拷贝成连续内存
+ * 
+ * @param view [in]消息
+ */
+void FileRecv::DispatchView(const BufferView &view)
+{
+    MsgHdr hdr = {};
+    view.Copy(0,&hdr,sizeof(MsgHdr));
+    if(hdr.uMsgType == FILE_TRAN_DATA)
+    {
+        procFileData(view);
+        return;
+    }
+
+    char* buf = view.Contiguous();
+    if(buf == nullptr)
+    {
+        _sig_buf.resize(view.Size());
+        view.Copy(0,_sig_buf.data(),view.Size());
+        buf = _sig_buf.data();
+    }
+    DispatchMsg(buf,view.Size());
+}
+
 /**
  * @brief 发送信令消息给对端
  * 
@@ -213,12 +235,11 @@ void FileRecv::procTranEnd(char* buf)
 }
 
 /**
- * @brief 接收文件传输数据
+ * @brief 接收文件传输数据，消息可能跨多个分段，逐段写入文件
  * 
- * @param buf [in]数据
- * @param len [in]长度
+ * @param view [in]消息
  */
-void FileRecv::procFileData(char* buf, uint32_t len)
+void FileRecv::procFileData(const BufferView &view)
 {
     static bool firstdata = false;
     if(firstdata == false)
@@ -233,19 +254,38 @@ void FileRecv::procFileData(char* buf, uint32_t len)
         sleep_exit(100 * 1000);
     }
 
-    if(len <= sizeof(MsgHdr))
+    if(view.Size() <= sizeof(MsgHdr))
     {
         return;
     }
 
-    uint32_t write_len = fwrite(buf + sizeof(MsgHdr), 1, len - sizeof(MsgHdr), _write_file);
-    if(write_len != len - sizeof(MsgHdr))
+    // 跳过消息头，逐段写入
+    uint32_t write_len = 0;
+    size_t skip = sizeof(MsgHdr);
+    for(size_t i = 0; i < view.Count(); i++)
+    {
+        const BufferSlice &slice = view[i];
+        if(skip >= slice.len)
+        {
+            skip -= slice.len;
+            continue;
+        }
+        size_t seg_len = slice.len - skip;
+        size_t n = fwrite(slice.data() + skip, 1, seg_len, _write_file);
+        write_len += n;
+        skip = 0;
+        if(n != seg_len)
+        {
+            break;
+        }
+    }
+    if(write_len != view.Size() - sizeof(MsgHdr))
     {
         fclose(_write_file);
 
         SendSignalMsg(FILE_TRAN_END,ERROR_FILE_PEER_UNKNOWN);
         ErrorL << "file write failed, error=" << errno << "(" << strerror(errno) << ")"
-               << ",write_len=" << write_len << ",len=" << len - sizeof(MsgHdr);
+               << ",write_len=" << write_len << ",len=" << view.Size() - sizeof(MsgHdr);
         sleep_exit(100 * 1000);
     }
     
@@ -7,6 +7,7 @@
 #include <memory>
 #include "Session.h"
 #include "FileTransfer.h"
+#include "BufferChain.h"
 
 namespace chw {
 
@@ -54,12 +55,11 @@ private:
     void procTranReq(char* buf);
 
     /**
-     * @brief 接收文件传输数据
+     * @brief 接收文件传输数据，消息可能跨多个分段，逐段写入文件
      * 
-     * @param buf [in]数据
-     * @param len [in]长度
+     * @param view [in]消息
      */
-    void procFileData(char* buf, uint32_t len);
+    void procFileData(const BufferView &view);
 
     /**
      * @brief 发送信令消息给对端
@@ -76,6 +76,13 @@ private:
      * @param len [in]长度
      */
     void DispatchMsg(char* buf, uint32_t len);
+
+    /**
+     * @brief 分发粘包处理后的消息，文件数据不拷贝直接写入，跨分段的信令消息拷贝成连续内存
+     * 
+     * @param view [in]消息
+     */
+    void DispatchView(const BufferView &view);
 private:
     // std::string _cls;// 类名
     // uint32_t _status;//FileTranStatus
@@ -87,6 +94,8 @@ private:
     FILE* _write_file;// 写文件句柄
     uint32_t _write_size;// 已写入的大小
     Ticker _ticker;// 统计耗时
+    BufferChain _chain;// 粘包处理的半包缓存链
+    std::vector<char> _sig_buf;// 跨分段的信令消息拷贝到这里
 
     // /**
     //  * @brief 发送数据
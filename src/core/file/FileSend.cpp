@@ -157,7 +157,8 @@ void FileSend::procTranRsp(char* buf)
     // 创建独立线程发送文件数据，避免阻塞信令
     if(_send_poller == nullptr)
     {
-        _send_poller = std::make_shared<EventLoop>("send poller");
+        // 零拷贝完成通知在socket的poller线程读取，发送不能占用该线程
+        _send_poller = EventLoop::addPoller("send poller");
     }
     
     auto poller = _poller;
@@ -209,13 +210,48 @@ void FileSend::procTranRsp(char* buf)
         static Ticker ticker_ctl;// 控速用的计时器
         ticker_ctl.resetTime();
 
+        // 零拷贝发送时轮流读入发送缓存环，Buffer在内核发送完成后才会被复用
+        BufferRing ring;
+        bool zerocopy = false;
+        if(strong_self->_send_data_z)
+        {
+            uint32_t count = std::min<uint32_t>(SEND_RING_MAX, std::max<uint32_t>(SEND_RING_MIN, SEND_RING_BYTES / strong_self->_snd_buf_mtu));
+            zerocopy = ring.Init(count, strong_self->_snd_buf_mtu) == chw::success;
+        }
+
         Ticker tker;// 统计耗时
         uint32_t uReadSize = 0;
         uint32_t allSendLen = 0;
-        while ((uReadSize = fread(buf + sizeof(MsgHdr), 1, strong_self->_snd_buf_mtu - sizeof(MsgHdr), fp)) > 0)
+        while (true)
         {
-            pMsgHdr->uTotalLen = uReadSize + sizeof(MsgHdr);
-            uint32_t len = strong_self->_send_data((char*)buf,uReadSize + sizeof(MsgHdr));
+            Buffer::Ptr zbuf = zerocopy ? ring.Next(strong_self->_send_stop) : nullptr;
+            if(zerocopy && !zbuf)
+            {
+                // 连接已断开，buf不会再有完成通知，放弃等待
+                PrintE("connection lost while waiting for zerocopy buffer.");
+                break;
+            }
+            char* rdbuf = zbuf ? (char*)zbuf->data() : buf;
+            uReadSize = fread(rdbuf + sizeof(MsgHdr), 1, strong_self->_snd_buf_mtu - sizeof(MsgHdr), fp);
+            if(uReadSize == 0)
+            {
+                break;
+            }
+
+            uint32_t len = 0;
+            if(zbuf)
+            {
+                MsgHdr* pZcHdr = (MsgHdr*)rdbuf;
+                pZcHdr->uMsgType = FILE_TRAN_DATA;
+                pZcHdr->uTotalLen = uReadSize + sizeof(MsgHdr);
+                zbuf->SetSize(uReadSize + sizeof(MsgHdr));
+                len = strong_self->_send_data_z(zbuf);
+            }
+            else
+            {
+                pMsgHdr->uTotalLen = uReadSize + sizeof(MsgHdr);
+                len = strong_self->_send_data((char*)buf,uReadSize + sizeof(MsgHdr));
+            }
             if(len == 0)
             {
                 break;
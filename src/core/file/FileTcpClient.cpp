@@ -14,8 +14,16 @@ namespace chw {
 
 FileTcpClient::FileTcpClient(const EventLoop::Ptr &poller) : TcpClient(poller)
 {
-    _FileTransfer = std::make_shared<chw::FileSend>(poller);
-    _FileTransfer->SetSndData(STD_BIND_2(FileTcpClient::SendDataToSer,this));
+    auto sender = std::make_shared<chw::FileSend>(poller);
+    sender->SetSndData(STD_BIND_2(FileTcpClient::SendDataToSer,this));
+    if(gConfigCmd.zerocopy)
+    {
+        // 零拷贝只对大块发送有收益，文件数据改为按tcp缓存大小分块
+        sender->SetSndBufMtu(TCP_BUFFER_SIZE);
+        sender->SetSndDataZ(STD_BIND_1(FileTcpClient::SendDataToSerZ,this));
+        sender->SetSndStop([this]() { return !alive(); });
+    }
+    _FileTransfer = sender;
 }
 
 /**
@@ -45,7 +53,20 @@ void FileTcpClient::onError(const SockException &ex)
 
 int FileTcpClient::SendDataToSer(const char *buffer, int len)
 {
+    // socket发送缓存满时等待可写事件，不在发送线程中重试
+    if (!waitWritable()) {
+        return 0;
+    }
     return senddata_i((char*)buffer,len);
 }
 
+uint32_t FileTcpClient::SendDataToSerZ(const Buffer::Ptr &buf)
+{
+    // 同 SendDataToSer，发送缓存满时剩余数据由Socket排队，等待排队数据发完再继续
+    if (!waitWritable()) {
+        return 0;
+    }
+    return senddata_z(buf);
+}
+
 }//namespace chw
\ No newline at end of file
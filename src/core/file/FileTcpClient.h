@@ -30,6 +30,9 @@ public:
 
     int SendDataToSer(const char *buffer, int len);
 
+    // 零拷贝发送文件数据(--zerocopy)
+    uint32_t SendDataToSerZ(const Buffer::Ptr &buf);
+
     /**
      * @brief 开始文件传输
      * 
@@ -26,6 +26,16 @@ public:
     // 设置发送回调
     virtual void SetSndData(std::function<uint32_t(char* buf, uint32_t )> cb) = 0;
 
+    // 设置零拷贝发送回调，设置后文件数据通过它发送
+    virtual void SetSndDataZ(std::function<uint32_t(const Buffer::Ptr &buf)> cb) {
+        _send_data_z = cb;
+    }
+
+    // 设置发送中止判断，返回true时发送线程不再等待零拷贝buf，例如连接已断开
+    virtual void SetSndStop(std::function<bool()> cb) {
+        _send_stop = cb;
+    }
+
     // 开始文件传输
     virtual void StartTransf() = 0;
 private:
@@ -42,6 +52,17 @@ protected:
      * @return uint32_t 发送成功的数据长度
      */
     std::function<uint32_t(char*, uint32_t )> _send_data;
+
+    /**
+     * @brief 零拷贝发送数据，内核发送完成前buf被Socket持有，不能修改
+     * 
+     * @param buf [in]数据
+     * @return uint32_t 发送成功的数据长度
+     */
+    std::function<uint32_t(const Buffer::Ptr &)> _send_data_z;
+
+    // 发送中止判断，零拷贝等待buf时检查
+    std::function<bool()> _send_stop;
 };
 
 }//namespace chw
@@ -147,6 +147,7 @@ int32_t NpcapSocket::SendToAdapter(char* buf, uint32_t len)
     {
         PrintE("adapter send failed,iRet:%d,err:%s",iRet,pcap_geterr(_handle));
     }
+    _RAM_DEL_(snd_buf);
 
     return iRet;
 }
@@ -8,10 +8,28 @@
 #include "PressSession.h"
 #include "PressClient.h"
 #include "MsgInterface.h"
+#include "EventLoopPool.h"
+#include "config.h"
 #include <iomanip>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
 
 namespace chw {
 
+// 本进程所有线程累计占用的cpu时间(用户态+内核态)，单位秒
+static double processCpuTime()
+{
+#if !defined(_WIN32)
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) == 0)
+    {
+        return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+    }
+#endif
+    return 0;
+}
+
 PressModel::PressModel(const chw::EventLoop::Ptr& poller) : workmodel(poller)
 {
     if(_poller == nullptr)
@@ -24,6 +42,8 @@ PressModel::PressModel(const chw::EventLoop::Ptr& poller) : workmodel(poller)
     _client_snd_num = 0;
     _client_snd_seq = 0;
     _client_snd_len = 0;
+    _gso = 0;
+    _cpu_start = 0;
 
     _server_rcv_num = 0;
     _server_rcv_seq = 0;
@@ -35,6 +55,11 @@ PressModel::PressModel(const chw::EventLoop::Ptr& poller) : workmodel(poller)
 
     _last_lost = 0;
     _last_seq = 0;
+    _last_snd_num = 0;
+
+    _tcp_conns = 0;
+    _tcp_sample_ms = 0;
+    _tcp_interval_ms = 0;
 }
 
 PressModel::~PressModel()
@@ -45,6 +70,7 @@ PressModel::~PressModel()
 void PressModel::startmodel()
 {
     _ticker_dur.resetTime();
+    _cpu_start = processCpuTime();
     
     if(chw::gConfigCmd.role == 's')
     {
@@ -52,7 +78,10 @@ void PressModel::startmodel()
         if(chw::gConfigCmd.protol == SockNum::Sock_TCP) {
             _pServer = std::make_shared<chw::TcpServer>(_poller);
         } else {
-            _pServer = std::make_shared<chw::UdpServer>(_poller);
+            auto server = std::make_shared<chw::UdpServer>(_poller);
+            server->setSteerCpu(chw::gConfigCmd.steer_cpu);
+            server->setSingleSocket(chw::gConfigCmd.single_socket);
+            _pServer = server;
         }
         
         try {
@@ -170,8 +199,10 @@ void PressModel::prepare_exit()
     PrintD("- - - - - - - - - - - - - - - - average- - - - - - - - - -- - - - - - - - -");
     if(chw::gConfigCmd.protol == SockNum::Sock_TCP)
     {
+        sampleTcpInfo();
         // PrintD("%-16.0f%-8.2f(%s)",uDurTimeS,speed,unit.c_str());
-        InfoL << std::left << std::setw(16) << std::setprecision(0) << std::fixed << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")";
+        InfoL << std::left << std::setw(16) << std::setprecision(0) << std::fixed << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")"
+            << tcpInfoStat(false) << (chw::gConfigCmd.role == 'c' ? cpuStat() : "") << loopStat(false) << memStat() << stampStat();
     }
     else
     {
@@ -186,14 +217,16 @@ void PressModel::prepare_exit()
 
             InfoL << std::left << std::setw(16) << std::setprecision(0) << std::fixed << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")"
                 << "  all " << _rs << " pkt:" << _server_rcv_num << ",bytes:" << _server_rcv_len
-                << ",seq:" << _server_rcv_seq << ",lost:" << lost_num << "(" << std::setprecision(2) << std::fixed << lost_ratio << "%)";
+                << ",seq:" << _server_rcv_seq << ",lost:" << lost_num << "(" << std::setprecision(2) << std::fixed << lost_ratio << "%)"
+                << loopStat(false) << memStat() << stampStat();
         }
         else
         {
             // PrintD("%-16.0f%-8.2f(%s)  all %s pkt:%lu,bytes:%lu"
             //     ,uDurTimeS,speed,unit.c_str(),_rs.c_str(),_client_snd_num,_client_snd_len);
             InfoL << std::left << std::setw(16) << std::setprecision(0) << std::fixed << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")"
-                << "  all " << _rs << " pkt:" << _client_snd_num << ",bytes:" << _client_snd_len;
+                << "  all " << _rs << " pkt:" << _client_snd_num << ",bytes:" << _client_snd_len
+                << ",pps:" << (uint64_t)(_client_snd_num / uDurTimeS) << "(" << sendMode() << ")" << loopStat(false) << memStat() << stampStat();
         }
         
     }
@@ -225,12 +258,19 @@ void PressModel::onManagerModel()
 
     speed_human(BytesPs,speed,unit);
 
+    if(chw::gConfigCmd.protol == SockNum::Sock_TCP)
+    {
+        sampleTcpInfo();
+    }
+    // 内存池峰值在汇总计数时采样，每秒采样一次
+    MemoryPool::GetStat();
+
     if(chw::gConfigCmd.role == 's' && speed > 0)
     {
         if(chw::gConfigCmd.protol == SockNum::Sock_TCP)
         {
             // PrintD("%-16u%-8.2f(%s)",uDurTimeS,speed,unit.c_str());
-            InfoL << std::left << std::setw(16) << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")";
+            InfoL << std::left << std::setw(16) << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")" << tcpInfoStat(true) << loopStat(true);
         }
         else
         {
@@ -246,7 +286,8 @@ void PressModel::onManagerModel()
             << "(" << unit << ")"
             << "    "
             << cur_lost_num << "/" << cur_rcv_seq
-            << "(" << std::setprecision(2) << std::fixed << cur_lost_ratio << "%)";
+            << "(" << std::setprecision(2) << std::fixed << cur_lost_ratio << "%)"
+            << loopStat(true);
 
             _last_lost = lost_num;
             _last_seq  = _server_rcv_seq;
@@ -255,7 +296,19 @@ void PressModel::onManagerModel()
     if(chw::gConfigCmd.role == 'c')
     {
         //PrintD("%-16u%-8.2f(%s)",uDurTimeS,speed,unit.c_str());
-        InfoL << std::left << std::setw(16) << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")";
+        if(chw::gConfigCmd.protol == SockNum::Sock_UDP)
+        {
+            // udp客户端输出本周期发包速率，用于对比sendto和sendmmsg
+            uint64_t snd_num = _client_snd_num;
+            uint64_t pps = (snd_num - _last_snd_num) / (chw::gConfigCmd.reporter_interval < 1 ? 1 : chw::gConfigCmd.reporter_interval);
+            _last_snd_num = snd_num;
+            InfoL << std::left << std::setw(16) << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")"
+                << "    " << pps << "pps" << loopStat(true);
+        }
+        else
+        {
+            InfoL << std::left << std::setw(16) << uDurTimeS << std::setw(8) << std::setprecision(2) << std::fixed << speed << "(" << unit << ")" << tcpInfoStat(true) << loopStat(true);
+        }
     }
 
     if(gConfigCmd.duration > 0 && uDurTimeS >= gConfigCmd.duration)
@@ -265,13 +318,302 @@ void PressModel::onManagerModel()
     }
 }
 
+std::string PressModel::sendMode()
+{
+    if(_gso > 1)
+    {
+        if(_pClient->getSock()->gsoEnabled())
+        {
+            return "gso x" + std::to_string(_gso);
+        }
+        // 内核或网卡不支持，已退回逐包发送
+#if defined(HAS_SENDMMSG)
+        return "sendmmsg x" + std::to_string(_gso) + ",gso unsupported";
+#else
+        return "sendto,gso unsupported";
+#endif //HAS_SENDMMSG
+    }
+    if(chw::gConfigCmd.send_list)
+    {
+#if defined(HAS_SENDMMSG)
+        return "send list,sendmmsg";
+#else
+        return "send list,sendto";
+#endif //HAS_SENDMMSG
+    }
+    if(chw::gConfigCmd.protol == SockNum::Sock_UDP && chw::gConfigCmd.batch > 1)
+    {
+#if defined(HAS_SENDMMSG)
+        return "sendmmsg x" + std::to_string(chw::gConfigCmd.batch);
+#else
+        return "sendto x" + std::to_string(chw::gConfigCmd.batch);
+#endif //HAS_SENDMMSG
+    }
+
+    return "sendto";
+}
+
+std::string PressModel::cpuStat()
+{
+    double cpu = processCpuTime() - _cpu_start;
+    if(_client_snd_len == 0 || cpu <= 0)
+    {
+        return "";
+    }
+
+    std::ostringstream oss;
+    oss << "  cpu:" << std::setprecision(3) << std::fixed << cpu / ((double)_client_snd_len / (1 << 30)) << "s/GB";
+    if(!chw::gConfigCmd.zerocopy)
+    {
+        oss << "(copy)";
+        return oss.str();
+    }
+
+    uint64_t sends = 0, copied = 0;
+    auto sock = _pClient->getSock();
+    if(!sock || !sock->zerocopyEnabled())
+    {
+        oss << "(copy,zerocopy unsupported)";
+        return oss.str();
+    }
+    sock->getZeroCopyStat(sends, copied);
+    // 回环网卡上内核总是退回拷贝发送，对比需要在物理网卡上测试
+    oss << "(zerocopy,kernel copied:" << (sends ? copied * 100 / sends : 0) << "%)";
+    return oss.str();
+}
+
+std::string PressModel::memStat()
+{
+    return "  mem:" + MemoryPool::GetStat().toString();
+}
+
+void PressModel::sampleTcpInfo()
+{
+    SockUtil::TcpInfo info, interval;
+    uint32_t conns = 0;
+    if(chw::gConfigCmd.role == 's')
+    {
+        _pServer->GetTcpInfo(info, interval, conns);
+    }
+    else if(auto sock = _pClient->getSock())
+    {
+        if(sock->getTcpInfo(info) == 0)
+        {
+            interval = info - _tcp_info;
+            conns = 1;
+        }
+    }
+
+    uint64_t now_ms = _ticker_dur.elapsedTime();
+    _tcp_interval_ms = now_ms - _tcp_sample_ms;
+    _tcp_sample_ms = now_ms;
+    if(conns == 0)
+    {
+        // 连接都已断开，总结中使用最后一次采样
+        _tcp_interval = SockUtil::TcpInfo();
+        return;
+    }
+    _tcp_info = info;
+    _tcp_interval = interval;
+    _tcp_conns = conns;
+}
+
+std::string PressModel::tcpInfoStat(bool interval)
+{
+    if(_tcp_conns == 0)
+    {
+        return "";
+    }
+
+    const SockUtil::TcpInfo &info = interval ? _tcp_interval : _tcp_info;
+    // 多个连接时rtt和拥塞窗口取平均，其他累加
+    uint32_t conns = _tcp_conns;
+    uint64_t wall_us = (interval ? _tcp_interval_ms : _ticker_dur.elapsedTime()) * 1000 * conns;
+    double busy = wall_us ? (double)info.busy_time * 100 / wall_us : 0;
+    double rwnd = info.busy_time ? (double)info.rwnd_limited * 100 / info.busy_time : 0;
+    double sndbuf = info.busy_time ? (double)info.sndbuf_limited * 100 / info.busy_time : 0;
+
+    // 发送时间大部分受对端接收窗口限制为接收方瓶颈，受本端发送缓存限制或应用写得不够快为发送方瓶颈，否则受拥塞窗口(网络)限制
+    const char *limit = "-";
+    if(info.busy_time > 0)
+    {
+        if(rwnd >= 50)
+        {
+            limit = "rwnd";
+        }
+        else if(sndbuf >= 50)
+        {
+            limit = "sndbuf";
+        }
+        else if(busy < 50)
+        {
+            limit = "app";
+        }
+        else
+        {
+            limit = "cwnd";
+        }
+    }
+
+    double pacing = 0, delivery = 0;
+    std::string pacing_unit, delivery_unit;
+    speed_human(info.pacing_rate, pacing, pacing_unit);
+    speed_human(info.delivery_rate, delivery, delivery_unit);
+
+    std::ostringstream oss;
+    oss << "  rtt:" << info.rtt / conns << "/" << info.rttvar / conns << "us"
+        << " cwnd:" << info.snd_cwnd / conns
+        << " retrans:" << info.total_retrans
+        << std::setprecision(2) << std::fixed
+        << " pacing:" << pacing << pacing_unit
+        << " delivery:" << delivery << delivery_unit
+        << std::setprecision(0)
+        << " busy:" << busy << "%"
+        << " rwnd:" << rwnd << "%"
+        << " sndbuf:" << sndbuf << "%"
+        << " limit:" << limit;
+    if(conns > 1)
+    {
+        oss << " conns:" << conns;
+    }
+    return oss.str();
+}
+
+std::string PressModel::stampStat()
+{
+    if(!chw::gConfigCmd.timestamp)
+    {
+        return "";
+    }
+
+    Socket::StampStat stat;
+    if(chw::gConfigCmd.role == 's')
+    {
+        _pServer->GetStampStat(stat);
+    }
+    else if(auto sock = _pClient->getSock())
+    {
+        stat = sock->getStampStat();
+    }
+    // 硬件时间戳需要网卡已开启(如hwstamp_ctl)，没有时wire为"-"
+    return "  stamp " + stat.toString();
+}
+
+std::string PressModel::loopStat(bool interval)
+{
+    std::vector<EventLoop::Ptr> pollers{_poller};
+    EventLoopPool::Instance().for_each([&](const EventLoop::Ptr &poller) {
+        pollers.emplace_back(poller);
+    });
+
+    uint32_t load = 0;
+    LatencyHistogram::Snapshot task_delay;
+    LatencyHistogram::Snapshot timer_late;
+    for(auto &poller : pollers)
+    {
+        auto stat = poller->getLoadStat();
+        if(interval)
+        {
+            auto &last = _last_load[poller.get()];
+            auto cur = stat;
+            stat = stat - last;
+            last = cur;
+        }
+        // 负载取最忙的poller，延时分布合并统计
+        load = std::max(load, stat.load());
+        task_delay += stat.task_delay;
+        timer_late += stat.timer_late;
+    }
+
+    return "  load:" + std::to_string(load) + "% task:" + task_delay.toString() + " timer:" + timer_late.toString();
+}
+
 // tcp当连接成功后再开始发送数据
 void PressModel::start_client_press()
 {
-    char* buf = (char*)_RAM_NEW_(gConfigCmd.blksize);
+    // udp指定--gso时，一次发送_gso个首尾相连的等长包，总长度不能超过udp最大长度
+    if(gConfigCmd.protol == SockNum::Sock_UDP && gConfigCmd.gso > 1 && gConfigCmd.blksize > 0)
+    {
+        _gso = std::min<uint32_t>(gConfigCmd.gso, UDP_GSO_MAX_SIZE / gConfigCmd.blksize);
+        if(_gso < gConfigCmd.gso)
+        {
+            WarnL << "gso limited to " << _gso << " packets by max udp size " << UDP_GSO_MAX_SIZE;
+        }
+    }
+
+    uint32_t segs = _gso > 1 ? _gso : 1;
+    char* buf = (char*)_RAM_NEW_(gConfigCmd.blksize * segs);
     MsgHdr* pMsgHdr = (MsgHdr*)buf;
-    pMsgHdr->uMsgIndex = 0;
-    pMsgHdr->uTotalLen = gConfigCmd.blksize;
+    for(uint32_t i = 0; i < segs; i++)
+    {
+        MsgHdr* pSegHdr = (MsgHdr*)(buf + i * gConfigCmd.blksize);
+        pSegHdr->uMsgIndex = 0;
+        pSegHdr->uTotalLen = gConfigCmd.blksize;
+    }
+
+    // tcp指定--zerocopy时轮流使用发送缓存环，内核发送完成前Buffer被Socket持有
+    bool zerocopy = gConfigCmd.protol == SockNum::Sock_TCP && gConfigCmd.zerocopy && gConfigCmd.blksize > 0;
+    // 指定--send-list时每个包放入Socket发送队列，由poller线程批量发送，发送完成前Buffer被Socket持有
+    bool sendlist = gConfigCmd.send_list && !zerocopy && segs == 1 && gConfigCmd.blksize > 0;
+    BufferRing ring;
+    if(zerocopy || sendlist)
+    {
+        uint32_t count = std::min<uint32_t>(SEND_RING_MAX, std::max<uint32_t>(SEND_RING_MIN, SEND_RING_BYTES / gConfigCmd.blksize));
+        if(ring.Init(count, gConfigCmd.blksize) == chw::fail)
+        {
+            ErrorL << "alloc send buffers failed, count=" << count << ",size=" << gConfigCmd.blksize;
+            sleep_exit(100 * 1000);
+        }
+    }
+
+    // udp指定--batch时攒够一批再sendmmsg，每个包在拷贝进批量缓存前已写好序列号
+    bool batch = gConfigCmd.protol == SockNum::Sock_UDP && gConfigCmd.batch > 1 && segs == 1 && !sendlist;
+    if(batch)
+    {
+        _pClient->getSock()->SetBatchM(gConfigCmd.batch);
+    }
+
+    // 只有本线程发送数据，send_i不再加锁
+    _pClient->getSock()->setSendOwner(std::this_thread::get_id());
+
+    // 发送一次，pkts返回本次发送的包数
+    uint32_t index = 0;
+    auto senddata = [&](uint32_t &pkts) -> uint32_t {
+        pkts = segs;
+        // 发送缓存满时Socket把剩余数据排队，等待排队数据发完再继续；--send-list由发送队列长度控制
+        if(!sendlist && !_pClient->waitWritable())
+        {
+            // 连接断开或等待可写超时
+            pkts = 0;
+            return 0;
+        }
+        if(zerocopy || sendlist)
+        {
+            auto rbuf = ring.Next([this]() { return !_bsending; });
+            if(!rbuf)
+            {
+                // 测试结束，放弃等待
+                pkts = 0;
+                return 0;
+            }
+            MsgHdr* pRingHdr = (MsgHdr*)rbuf->data();
+            pRingHdr->uMsgIndex = ++index;
+            pRingHdr->uTotalLen = gConfigCmd.blksize;
+            rbuf->SetSize(gConfigCmd.blksize);
+            return zerocopy ? _pClient->senddata_z(rbuf) : _pClient->senddata_l(rbuf);
+        }
+        if(segs > 1)
+        {
+            // GSO超级缓冲区中每个包带各自递增的序列号
+            for(uint32_t i = 0; i < segs; i++)
+            {
+                ((MsgHdr*)(buf + i * gConfigCmd.blksize))->uMsgIndex = ++index;
+            }
+            return _pClient->senddata_g(buf,gConfigCmd.blksize * segs,gConfigCmd.blksize);
+        }
+        pMsgHdr->uMsgIndex = ++index;
+        return batch ? _pClient->senddata_m(buf,gConfigCmd.blksize) : _pClient->senddata_i(buf,gConfigCmd.blksize);
+    };
     
     // 不控速
     if(gConfigCmd.bandwidth == 0)
@@ -284,19 +626,19 @@ void PressModel::start_client_press()
                 continue;
             }
 
-            pMsgHdr->uMsgIndex ++;
-            uint32_t sndlen = _pClient->senddata_i(buf,gConfigCmd.blksize);
-            if(sndlen == gConfigCmd.blksize)
+            uint32_t pkts = 1;
+            uint32_t sndlen = senddata(pkts);
+            if(sndlen == gConfigCmd.blksize * pkts)
             {
-                _client_snd_num ++;
-                _client_snd_seq ++;
+                _client_snd_num += pkts;
+                _client_snd_seq += pkts;
                 _client_snd_len += sndlen;
             }
             else
             {
                 // 出现错误，退出测试
                 auto err = get_uv_error(true);
-                ErrorL << "send return=" << sndlen << ",all len=" << gConfigCmd.blksize << ",err=" << uv_strerror(err);
+                ErrorL << "send return=" << sndlen << ",all len=" << gConfigCmd.blksize * pkts << ",err=" << uv_strerror(err);
                 prepare_exit();
                 sleep_exit(100 * 1000);
             }
@@ -321,19 +663,19 @@ void PressModel::start_client_press()
         uint32_t curr_all_sndlen = 0;
         while(1)
         {
-            pMsgHdr->uMsgIndex ++;
-            uint32_t sndlen = _pClient->senddata_i(buf,gConfigCmd.blksize);
-            if(sndlen == gConfigCmd.blksize)
+            uint32_t pkts = 1;
+            uint32_t sndlen = senddata(pkts);
+            if(sndlen == gConfigCmd.blksize * pkts)
             {
-                _client_snd_num ++;
-                _client_snd_seq ++;
+                _client_snd_num += pkts;
+                _client_snd_seq += pkts;
                 _client_snd_len += sndlen;
             }
             else
             {
                 // 出现错误，退出测试
                 auto err = get_uv_error(true);
-                ErrorL << "send return=" << sndlen << ",all len=" << gConfigCmd.blksize << ",err=" << uv_strerror(err);
+                ErrorL << "send return=" << sndlen << ",all len=" << gConfigCmd.blksize * pkts << ",err=" << uv_strerror(err);
                 prepare_exit();
                 sleep_exit(100 * 1000);
             }
@@ -347,11 +689,33 @@ void PressModel::start_client_press()
 
             if(curr_all_sndlen >= uBytep100ms)
             {
+                if(batch)
+                {
+                    // 休眠前发出不足一批的包，未发出的包留在批量缓存，下次继续发送
+                    _pClient->flushdata_m();
+                }
                 usleep((100 - use_ms - 1) * 1000);
                 break;
             }
         }
     }
+
+    if(batch)
+    {
+        // 发出批量缓存中剩余的包，发送队列满时等待可写后重试
+        uint32_t retry = 0;
+        while(_pClient->flushdata_m() == chw::fail)
+        {
+            if(++retry > 100 || !_pClient->waitWritable())
+            {
+                WarnL << "flush batch failed, some packets counted as sent were dropped";
+                break;
+            }
+        }
+    }
+
+    // 结束发送，其他线程转发过来还没执行的发送改为加锁发送
+    _pClient->getSock()->setSendOwner();
 }
 
 }//namespace chw 
\ No newline at end of file
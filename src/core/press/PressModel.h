@@ -5,6 +5,7 @@
 #define __PRESS_MODEL_H
 
 #include <memory>
+#include <unordered_map>
 #include "ComProtocol.h"
 #include "EventLoop.h"
 #include "Server.h"
@@ -47,6 +48,50 @@ private:
      */
     void start_client_press();
 
+    /**
+     * @brief 汇总EventLoop负载统计，负载取最忙的poller，async任务延时和定时器延时输出p50/p99/max
+     * 
+     * @param interval [in]true统计本周期，false统计从启动到现在
+     * @return std::string 追加到速率后面的统计信息
+     */
+    std::string loopStat(bool interval);
+
+    /**
+     * @brief 内存池统计，命中率、系统分配次数、在用和峰值内存，输出在总结中
+     * 
+     * @return std::string 统计信息
+     */
+    std::string memStat();
+
+    /**
+     * @brief udp客户端的发送方式，sendto或sendmmsg及批量大小，输出在总结中便于对比pps
+     */
+    std::string sendMode();
+
+    /**
+     * @brief 客户端从启动到现在每发送1GB数据占用的cpu时间，用于对比拷贝发送和零拷贝发送
+     */
+    std::string cpuStat();
+
+    /**
+     * @brief 收发时间戳统计(--timestamp)，内核协议栈、网卡和应用各阶段耗时，输出在总结中
+     */
+    std::string stampStat();
+
+    /**
+     * @brief 采样tcp连接状态(TCP_INFO)，服务端合并所有会话，每个统计周期和总结前调用
+     */
+    void sampleTcpInfo();
+
+    /**
+     * @brief tcp连接状态统计，rtt、拥塞窗口、重传、发送节奏和交付速率，以及发送时间中受接收窗口、发送缓存限制的比例，
+     * 用于判断瓶颈在网络(cwnd)、接收方(rwnd)还是发送方(sndbuf/app)
+     * 
+     * @param interval [in]true为本周期，false为从开始到现在
+     * @return std::string 追加到速率后面的统计信息
+     */
+    std::string tcpInfoStat(bool interval);
+
 private:
     chw::Server::Ptr _pServer;
     chw::Client::Ptr _pClient;
@@ -61,16 +106,29 @@ private:
     uint64_t _client_snd_num;// 发送包的数量
     uint64_t _client_snd_seq;// 发送包的最大序列号
     uint64_t _client_snd_len;// 发送的字节总大小
+    uint32_t _gso;// udp GSO每次发送的包数，0不使用
+    double _cpu_start;// 启动时进程占用的cpu时间，单位秒
 
     // udp客户端丢包
     uint32_t _last_lost;// 上次统计时的丢包数量
     uint32_t _last_seq; // 上次统计时的最大序列号
+    uint64_t _last_snd_num;// 上次统计时发送包的数量
 
     // 做为服务端
     uint64_t _server_rcv_num;// 接收包的数量
     uint64_t _server_rcv_seq;// 接收包的最大序列号
     uint64_t _server_rcv_len;// 接收的字节总大小
     uint64_t _server_rcv_spd;// 接收速率,单位byte
+
+    // tcp连接状态(TCP_INFO)，多个会话时为合并值
+    SockUtil::TcpInfo _tcp_info;// 最近一次采样的当前值
+    SockUtil::TcpInfo _tcp_interval;// 最近一次采样与上次采样的差值
+    uint32_t _tcp_conns;// 最近一次采样成功的连接数量
+    uint64_t _tcp_sample_ms;// 最近一次采样的测试时长ms
+    uint64_t _tcp_interval_ms;// 最近一次采样与上次采样的间隔ms
+
+    // 各poller上次统计时的负载
+    std::unordered_map<EventLoop*, EventLoop::LoadStat> _last_load;
 public:
     bool _bStart;
 };
@@ -10,6 +10,8 @@ namespace chw {
 PressSession::PressSession(const Socket::Ptr &sock) : Session(sock)
 {
     _cls = chw::demangle(typeid(PressSession).name());
+    // 接收数据在回调中统计完即丢弃，使用poller线程共享的读缓存
+    sock->setSharedRecvBuffer(true);
 
     _server_rcv_num = 0;
     _server_rcv_seq = 0;
@@ -23,17 +25,35 @@ PressSession::PressSession(const Socket::Ptr &sock) : Session(sock)
  */
 void PressSession::onRecv(const Buffer::Ptr &pBuf)
 {
+    uint64_t num = 1;
     if(getSock()->sockType() == SockNum::Sock_UDP)
     {
-        MsgHdr* pMsgHdr = (MsgHdr*)pBuf->data();
-        if(_server_rcv_seq < pMsgHdr->uMsgIndex)
+        // UDP GRO合并包按每个udp包拆开统计，包数量和最大序列号与逐包接收一致
+        size_t size = pBuf->Size();
+        size_t seg_size = pBuf->SegSize();
+        if(seg_size == 0 || seg_size > size)
         {
-            _server_rcv_seq = pMsgHdr->uMsgIndex;
+            seg_size = size;
         }
+
+        uint64_t max_seq = _server_rcv_seq.load(std::memory_order_relaxed);
+        size_t offset = 0;
+        num = 0;
+        do
+        {
+            num ++;
+            MsgHdr* pMsgHdr = (MsgHdr*)((char*)pBuf->data() + offset);
+            if(max_seq < pMsgHdr->uMsgIndex)
+            {
+                max_seq = pMsgHdr->uMsgIndex;
+            }
+            offset += seg_size;
+        } while(seg_size > 0 && offset < size);
+        _server_rcv_seq.store(max_seq, std::memory_order_relaxed);
     }
 
-    _server_rcv_num ++;
-    _server_rcv_len += pBuf->Size();
+    _server_rcv_num.fetch_add(num, std::memory_order_relaxed);
+    _server_rcv_len.fetch_add(pBuf->Size(), std::memory_order_relaxed);
 
     pBuf->Reset();
 }
@@ -91,9 +111,7 @@ uint32_t PressSession::senddata(char* buff, uint32_t len)
  */
 uint64_t PressSession::GetPktNum()
 {
-    uint64_t tmp = _server_rcv_num;
-    _server_rcv_num = 0;
-    return tmp;
+    return _server_rcv_num.exchange(0, std::memory_order_relaxed);
 }
 
 /**
@@ -103,7 +121,7 @@ uint64_t PressSession::GetPktNum()
  */
 uint64_t PressSession::GetSeq()
 {
-    return _server_rcv_seq;
+    return _server_rcv_seq.load(std::memory_order_relaxed);
 }
 
 /**
@@ -113,9 +131,25 @@ uint64_t PressSession::GetSeq()
  */
 uint64_t PressSession::GetRcvLen()
 {
-    uint64_t tmp = _server_rcv_len;
-    _server_rcv_len = 0;
-    return tmp;
+    return _server_rcv_len.exchange(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 采样tcp连接状态(TCP_INFO)，由服务端poller线程周期调用
+ * 
+ * @param info     [out]当前值
+ * @param interval [out]与上次采样的差值
+ * @return bool tcp会话返回true
+ */
+bool PressSession::SampleTcpInfo(SockUtil::TcpInfo &info, SockUtil::TcpInfo &interval)
+{
+    if(getSock()->getTcpInfo(info) != 0)
+    {
+        return false;
+    }
+    interval = info - _last_tcp_info;
+    _last_tcp_info = info;
+    return true;
 }
 
 }//namespace chw
\ No newline at end of file
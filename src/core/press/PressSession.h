@@ -5,6 +5,7 @@
 #define __PRESS_SESSION_H
 
 #include <memory>
+#include <atomic>
 #include "Session.h"
 
 namespace chw {
@@ -75,10 +76,21 @@ public:
      */
     virtual uint64_t GetRcvLen()override;
 
+    /**
+     * @brief 采样tcp连接状态(TCP_INFO)，由服务端poller线程周期调用
+     * 
+     * @param info     [out]当前值
+     * @param interval [out]与上次采样的差值
+     * @return bool tcp会话返回true
+     */
+    virtual bool SampleTcpInfo(SockUtil::TcpInfo &info, SockUtil::TcpInfo &interval) override;
+
 private:
-    uint64_t _server_rcv_num;// 接收包的数量
-    uint64_t _server_rcv_seq;// 接收包的最大序列号,注意udp可能乱序
-    uint64_t _server_rcv_len;// 接收的字节总大小
+    // 会话可能运行在线程池的poller线程，统计计数由服务端poller线程读取，使用原子变量
+    std::atomic<uint64_t> _server_rcv_num;// 接收包的数量
+    std::atomic<uint64_t> _server_rcv_seq;// 接收包的最大序列号,注意udp可能乱序
+    std::atomic<uint64_t> _server_rcv_len;// 接收的字节总大小
+    SockUtil::TcpInfo _last_tcp_info;// 上次采样的tcp连接状态，只在服务端poller线程访问
 
     std::string _cls;
 };
@@ -53,7 +53,7 @@ void KcpClient::CreateKcp(uint32_t conv, KcpSendCb cb, void *user)
         _kcp->fastresend = 1;
     }
 
-    ///4.创建定时器周期处理ikcp_update
+    ///4.创建定时器周期处理ikcp_update，1ms周期使用高精度定时器
     std::weak_ptr<KcpClient> weak_self = std::static_pointer_cast<KcpClient>(shared_from_this());
     _timer = std::make_shared<Timer>(0.001, [weak_self]() -> bool {
         auto strong_self = weak_self.lock();
@@ -64,7 +64,7 @@ void KcpClient::CreateKcp(uint32_t conv, KcpSendCb cb, void *user)
         ///5.处理kcp发送和重发
         strong_self->onKcpUpdate();
         return true;
-    }, _poller);
+    }, _poller, true);
 }
 
 /**
@@ -84,6 +84,10 @@ void KcpClient::RcvDataToKcp(const char* buf, long len)
 
     ///7.kcp将接收到的kcp数据包还原成用户数据
     while (1) {
+        if (_rcv_buf->Capacity() == 0 && _rcv_buf->SetCapacity(TCP_BUFFER_SIZE) == chw::fail) {
+            // 上层通过Buffer::Detach取走了接收缓存，重新分配
+            break;
+        }
         int nrecv = ikcp_recv(_kcp, (char*)_rcv_buf->data() + _rcv_buf->Size(), _rcv_buf->Idle());
         // printf("ikcp_recv nrecv=%d\n", nrecv);
         if (nrecv < 0) break;
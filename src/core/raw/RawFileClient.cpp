@@ -99,7 +99,9 @@ int RawSendDataCb(const char *buf, int len, ikcpcb *kcp, void *user)
     memcpy(peth->h_source,pClient->_local_mac,IFHWADDRLEN);
     peth->h_proto = htons(ETH_RAW_FILE);
     
-    return pClient->send_addr(snd_buf,sizeof(ethhdr) + len,(struct sockaddr*)&pClient->_local_addr,sizeof(struct sockaddr_ll));
+    int ret = pClient->send_addr(snd_buf,sizeof(ethhdr) + len,(struct sockaddr*)&pClient->_local_addr,sizeof(struct sockaddr_ll));
+    _RAM_DEL_(snd_buf);
+    return ret;
 }
 
 
@@ -289,7 +289,8 @@ void RawPressModel::start_client_press()
         while(_bsending)
         {
             pMsgHdr->uMsgIndex ++;
-            uint32_t sndlen = _pClient->send_addr(buf,buflen,(struct sockaddr*)&_pClient->_local_addr,sizeof(struct sockaddr_ll));
+            // socket发送缓存满时send_addr把数据排队，等待排队数据发完再继续，避免队列溢出
+            uint32_t sndlen = _pClient->waitWritable() ? _pClient->send_addr(buf,buflen,(struct sockaddr*)&_pClient->_local_addr,sizeof(struct sockaddr_ll)) : 0;
             if(sndlen == buflen)
             {
                 _client_snd_num ++;
@@ -318,7 +319,7 @@ void RawPressModel::start_client_press()
         while(1)
         {
             pMsgHdr->uMsgIndex ++;
-            uint32_t sndlen = _pClient->send_addr(buf,buflen,(struct sockaddr*)&_pClient->_local_addr,sizeof(struct sockaddr_ll));
+            uint32_t sndlen = _pClient->waitWritable() ? _pClient->send_addr(buf,buflen,(struct sockaddr*)&_pClient->_local_addr,sizeof(struct sockaddr_ll)) : 0;
             if(sndlen == buflen)
             {
                 _client_snd_num ++;
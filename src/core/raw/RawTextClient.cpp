@@ -64,7 +64,9 @@ uint32_t RawTextClient::send_text(char* buf, uint32_t len)
     memcpy(peth->h_source,_local_mac,IFHWADDRLEN);
     peth->h_proto = htons(ETH_RAW_TEXT);
 
-    return send_addr(snd_buf,sizeof(ethhdr) + len,(struct sockaddr*)&_local_addr,sizeof(struct sockaddr_ll));
+    uint32_t ret = send_addr(snd_buf,sizeof(ethhdr) + len,(struct sockaddr*)&_local_addr,sizeof(struct sockaddr_ll));
+    _RAM_DEL_(snd_buf);
+    return ret;
 }
 
 }//namespace chw
\ No newline at end of file
@@ -37,16 +37,47 @@
 #define create_event() epoll_create(EPOLL_SIZE)
 #endif //HAS_EPOLL
 
+#if defined(HAS_TIMERFD)
+#include <sys/timerfd.h>
+#endif //HAS_TIMERFD
+
 #if defined(HAS_KQUEUE)
 #include <sys/event.h>
 #define KEVENT_SIZE 1024
 #define create_event() kqueue()
 #endif // HAS_KQUEUE
 
+#if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
+//事件数据，低32位为fd，高32位为事件代数
+#define toEventData(fd, gen) (((uint64_t)(gen) << 32) | (uint32_t)(fd))
+#endif
+
 using namespace std;
 
 namespace chw {
 
+static bool s_use_uring = false;
+
+void EventLoop::setUseUring(bool enable) {
+    s_use_uring = enable;
+}
+
+static uint32_t s_busy_poll_us = 0;
+
+void EventLoop::setBusyPoll(uint32_t us) {
+    s_busy_poll_us = us;
+}
+
+uint32_t EventLoop::getBusyPoll() {
+    return s_busy_poll_us;
+}
+
+void EventLoop::getBusyPollStat(uint64_t &spin_us, uint64_t &work_us, uint64_t &sleep_us) const {
+    spin_us = _spin_us.load(std::memory_order_relaxed);
+    work_us = _work_us.load(std::memory_order_relaxed);
+    sleep_us = _sleep_us.load(std::memory_order_relaxed);
+}
+
 void EventLoop::addEventPipe() {
     SockUtil::setNoBlocked(_pipe.readFD());
     SockUtil::setNoBlocked(_pipe.writeFD());
@@ -58,7 +89,7 @@ void EventLoop::addEventPipe() {
     }
 }
 
-EventLoop::EventLoop(std::string name) {
+EventLoop::EventLoop(std::string name) : _timing_wheel(getCurrentMillisecond()) {
 #if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
     _event_fd = create_event();
     if (_event_fd == -1) {
@@ -67,8 +98,19 @@ EventLoop::EventLoop(std::string name) {
     SockUtil::setCloExec(_event_fd);
 #endif //HAS_EPOLL
 
+#if defined(HAS_IO_URING)
+    if (s_use_uring) {
+        _uring.reset(new UringWrap);
+        if (!_uring->init(EPOLL_SIZE)) {
+            WarnL << "io_uring is unavailable, fallback to epoll";
+            _uring.reset();
+        }
+    }
+#endif //HAS_IO_URING
+
     _name = std::move(name);
     _logger = Logger::Instance().shared_from_this();
+    _busy_poll_us = s_busy_poll_us;
     addEventPipe();
 }
 
@@ -95,8 +137,24 @@ EventLoop::~EventLoop() {
     }
 #endif
 
+#if defined(HAS_TIMERFD)
+    if (_timer_fd != -1) {
+        close(_timer_fd);
+        _timer_fd = -1;
+    }
+#endif //HAS_TIMERFD
+
     //退出前清理管道中的数据
     onPipeEvent(true);
+    if (_busy_poll_us) {
+        uint64_t spin_us, work_us, sleep_us;
+        getBusyPollStat(spin_us, work_us, sleep_us);
+        uint64_t total = spin_us + work_us + sleep_us;
+        InfoL << getThreadName() << " busy poll " << _busy_poll_us << "us, spin:" << spin_us / 1000 << "ms"
+              << " work:" << work_us / 1000 << "ms sleep:" << sleep_us / 1000 << "ms"
+              << ", spin/work:" << (work_us ? (double)spin_us / work_us : 0.0)
+              << ", cpu:" << (total ? (spin_us + work_us) * 100 / total : 0) << "%";
+    }
     InfoL << getThreadName();
 }
 
@@ -108,27 +166,47 @@ int EventLoop::addEvent(int fd, int event, PollEventCB cb) {
     }
 
     if (isCurrentThread()) {
+#if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
+        if (findEventRecord(fd)) {
+            //与epoll_ctl(EPOLL_CTL_ADD)行为保持一致
+            return -1;
+        }
+        EventRecord *record = getEventRecord(fd);
+        if (!record) {
+            return -1;
+        }
+        uint32_t gen = nextEventGen();
 #if defined(HAS_EPOLL)
+#if defined(HAS_IO_URING)
+        if (_uring) {
+            uringPollAdd(fd, event, gen);
+            record->cb.reset(new PollEventCB(std::move(cb)));
+            record->gen = gen;
+            record->event = event;
+            ++_fd_count;
+            return 0;
+        }
+#endif //HAS_IO_URING
         struct epoll_event ev = {0};
         ev.events = toEpoll(event) ;
-        ev.data.fd = fd;
+        ev.data.u64 = toEventData(fd, gen);
         int ret = epoll_ctl(_event_fd, EPOLL_CTL_ADD, fd, &ev);
-        if (ret != -1) {
-            _event_map.emplace(fd, std::make_shared<PollEventCB>(std::move(cb)));
-        }
-        return ret;
-#elif defined(HAS_KQUEUE)
+#else
         struct kevent kev[2];
         int index = 0;
         if (event & Event_Read) {
-            EV_SET(&kev[index++], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+            EV_SET(&kev[index++], fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, (void *)(uintptr_t)gen);
         }
         if (event & Event_Write) {
-            EV_SET(&kev[index++], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+            EV_SET(&kev[index++], fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, (void *)(uintptr_t)gen);
         }
         int ret = kevent(_event_fd, kev, index, nullptr, 0, nullptr);
+#endif //HAS_EPOLL
         if (ret != -1) {
-            _event_map.emplace(fd, std::make_shared<PollEventCB>(std::move(cb)));
+            record->cb.reset(new PollEventCB(std::move(cb)));
+            record->gen = gen;
+            record->event = event;
+            ++_fd_count;
         }
         return ret;
 #else
@@ -145,6 +223,7 @@ int EventLoop::addEvent(int fd, int event, PollEventCB cb) {
         record->event = event;
         record->call_back = std::move(cb);
         _event_map.emplace(fd, record);
+        ++_fd_count;
         return 0;
 #endif
     }
@@ -162,23 +241,29 @@ int EventLoop::delEvent(int fd, PollCompleteCB cb) {
     }
 
     if (isCurrentThread()) {
-#if defined(HAS_EPOLL)
+#if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
         int ret = -1;
-        if (_event_map.erase(fd)) {
-            _event_cache_expired.emplace(fd);
+        EventRecord *record = findEventRecord(fd);
+        if (record) {
+            uint32_t gen = record->gen;
+            removeEventRecord(record);
+            --_fd_count;
+#if defined(HAS_IO_URING)
+            if (_uring) {
+                uringPollRemove(fd, gen);
+                cb(true);
+                return 0;
+            }
+#endif //HAS_IO_URING
+#if defined(HAS_EPOLL)
             ret = epoll_ctl(_event_fd, EPOLL_CTL_DEL, fd, nullptr);
-        }
-        cb(ret != -1);
-        return ret;
-#elif defined(HAS_KQUEUE)
-        int ret = -1;
-        if (_event_map.erase(fd)) {
-            _event_cache_expired.emplace(fd);
+#else
             struct kevent kev[2];
             int index = 0;
-            EV_SET(&kev[index++], fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
-            EV_SET(&kev[index++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+            EV_SET(&kev[index++], fd, EVFILT_READ, EV_DELETE, 0, 0, (void *)(uintptr_t)gen);
+            EV_SET(&kev[index++], fd, EVFILT_WRITE, EV_DELETE, 0, 0, (void *)(uintptr_t)gen);
             ret = kevent(_event_fd, kev, index, nullptr, 0, nullptr);
+#endif //HAS_EPOLL
         }
         cb(ret != -1);
         return ret;
@@ -186,6 +271,7 @@ int EventLoop::delEvent(int fd, PollCompleteCB cb) {
         int ret = -1;
         if (_event_map.erase(fd)) {
             _event_cache_expired.emplace(fd);
+            --_fd_count;
             ret = 0;
         }
         cb(ret != -1);
@@ -207,19 +293,38 @@ int EventLoop::modifyEvent(int fd, int event, PollCompleteCB cb) {
         cb = [](bool success) {};
     }
     if (isCurrentThread()) {
+#if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
+        EventRecord *record = findEventRecord(fd);
+        if (!record) {
+            cb(false);
+            return -1;
+        }
+#if defined(HAS_IO_URING)
+        if (_uring) {
+            //先取消旧的poll请求，再用新代数提交，旧请求遗留的完成项会被过滤
+            uringPollRemove(fd, record->gen);
+            record->gen = nextEventGen();
+            record->event = event;
+            uringPollAdd(fd, event, record->gen);
+            cb(true);
+            return 0;
+        }
+#endif //HAS_IO_URING
 #if defined(HAS_EPOLL)
         struct epoll_event ev = { 0 };
         ev.events = toEpoll(event);
-        ev.data.fd = fd;
+        ev.data.u64 = toEventData(fd, record->gen);
         auto ret = epoll_ctl(_event_fd, EPOLL_CTL_MOD, fd, &ev);
-        cb(ret != -1);
-        return ret;
-#elif defined(HAS_KQUEUE)
+#else
         struct kevent kev[2];
         int index = 0;
-        EV_SET(&kev[index++], fd, EVFILT_READ, event & Event_Read ? EV_ADD | EV_CLEAR : EV_DELETE, 0, 0, nullptr);
-        EV_SET(&kev[index++], fd, EVFILT_WRITE, event & Event_Write ? EV_ADD | EV_CLEAR : EV_DELETE, 0, 0, nullptr);
+        EV_SET(&kev[index++], fd, EVFILT_READ, event & Event_Read ? EV_ADD | EV_CLEAR : EV_DELETE, 0, 0, (void *)(uintptr_t)record->gen);
+        EV_SET(&kev[index++], fd, EVFILT_WRITE, event & Event_Write ? EV_ADD | EV_CLEAR : EV_DELETE, 0, 0, (void *)(uintptr_t)record->gen);
         int ret = kevent(_event_fd, kev, index, nullptr, 0, nullptr);
+#endif //HAS_EPOLL
+        if (ret != -1) {
+            record->event = event;
+        }
         cb(ret != -1);
         return ret;
 #else
@@ -237,32 +342,166 @@ int EventLoop::modifyEvent(int fd, int event, PollCompleteCB cb) {
     return 0;
 }
 
-Task::Ptr EventLoop::async(TaskIn task, bool may_sync) {
-    return async_l(std::move(task), may_sync, false);
+#if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
+EventLoop::EventRecord *EventLoop::getEventRecord(int fd) {
+    if (fd < 0) {
+        return nullptr;
+    }
+    size_t chunk = (size_t)fd >> EVENT_CHUNK_SHIFT;
+    if (chunk >= _event_table.size()) {
+        _event_table.resize(chunk + 1);
+    }
+    if (!_event_table[chunk]) {
+        _event_table[chunk].reset(new EventRecord[EVENT_CHUNK_MASK + 1]);
+    }
+    return &_event_table[chunk][fd & EVENT_CHUNK_MASK];
+}
+
+void EventLoop::removeEventRecord(EventRecord *record) {
+    //先清空记录再释放回调，回调析构时可能重入add/delEvent
+    std::unique_ptr<PollEventCB> cb = std::move(record->cb);
+    record->event = 0;
+    if (_event_dispatching) {
+        //回调可能正在执行，本轮事件分发结束后释放
+        _event_expired.emplace_back(std::move(cb));
+    }
+}
+#endif //defined(HAS_EPOLL) || defined(HAS_KQUEUE)
+
+void EventLoop::async(TaskIn task, bool may_sync) {
+    async_l(std::move(task), may_sync, false);
 }
 
-Task::Ptr EventLoop::async_first(TaskIn task, bool may_sync) {
-    return async_l(std::move(task), may_sync, true);
+void EventLoop::async_first(TaskIn task, bool may_sync) {
+    async_l(std::move(task), may_sync, true);
 }
 
-Task::Ptr EventLoop::async_l(TaskIn task, bool may_sync, bool first) {
+void EventLoop::async_l(TaskIn task, bool may_sync, bool first) {
     // TimeTicker();
     if (may_sync && isCurrentThread()) {
         task();
-        return nullptr;
+        return;
+    }
+
+    _task_count.fetch_add(1);
+    if (first) {
+        _queue_task_first.push(QueueTask{std::move(task), getMonotonicMicrosecond()});
+    } else {
+        _queue_task.push(QueueTask{std::move(task), getMonotonicMicrosecond()});
     }
+    //只有轮询线程休眠时才写eventfd唤醒，连续投递的任务只唤醒一次
+    if (_sleeping.exchange(false)) {
+        _pipe.write("", 1);
+    }
+}
+
+bool EventLoop::prepareSleep() {
+    //先标记休眠再检查任务数量，与async_l中先加任务数量再检查休眠标记配合，保证不会漏掉唤醒
+    _sleeping.store(true);
+    if (_task_count.load() <= 0) {
+        return true;
+    }
+    _sleeping.store(false);
+    flushTask();
+    return false;
+}
+
+int64_t EventLoop::flushTask() {
+    int64_t count = _task_count.load();
+    if (count <= 0) {
+        return 0;
+    }
+    int64_t done = 0;
+    QueueTask task;
+    while (done < count && (_queue_task_first.pop(task) || _queue_task.pop(task))) {
+        ++done;
+        uint64_t now = getMonotonicMicrosecond();
+        _task_delay.record(now > task.time ? now - task.time : 0);
+        try {
+            task.task();
+        } catch (ExitException &) {
+            _exit_flag = true;
+        } catch (std::exception &ex) {
+            ErrorL << "Exception occurred when do async task: " << ex.what();
+        }
+        task.task = nullptr;
+    }
+    _task_count.fetch_sub(done);
+    return done;
+}
+
+int EventLoop::pollTimeout(uint64_t min_delay) {
+    if (_busy_poll_us) {
+        uint64_t now = getMonotonicMicrosecond();
+        if (!_spin_begin) {
+            _spin_begin = now;
+        }
+        if (now - _spin_begin < _busy_poll_us) {
+            //忙轮询期间不休眠，也就不需要eventfd唤醒，直接执行已入队的任务
+            if (flushTask()) {
+                _spin_begin = 0;
+                _last_spin = false;
+            }
+            return 0;
+        }
+    }
+    if (!prepareSleep()) {
+        return 0;
+    }
+    return min_delay ? (int)min_delay : -1;
+}
 
-    auto ret = std::make_shared<Task>(std::move(task));
-    {
-        lock_guard<mutex> lck(_mtx_task);
-        if (first) {
-            _list_task.emplace_front(ret);
+void EventLoop::startSleep() {
+    uint64_t now = getMonotonicMicrosecond();
+    if (_wake_time) {
+        //空转轮询之间的间隔也算作空闲
+        uint64_t elapsed = now - _wake_time;
+        auto &total = _last_spin ? _idle_us : _busy_us;
+        total.store(total.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+        if (_busy_poll_us) {
+            (_last_spin ? _spin_us : _work_us).fetch_add(elapsed, std::memory_order_relaxed);
+        }
+    }
+    _sleep_begin.store(now, std::memory_order_relaxed);
+}
+
+void EventLoop::sleepWakeUp(int timeout, bool has_event) {
+    uint64_t now = getMonotonicMicrosecond();
+    uint64_t elapsed = now - _sleep_begin.load(std::memory_order_relaxed);
+    _sleep_begin.store(0, std::memory_order_relaxed);
+    _idle_us.store(_idle_us.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+    if (_busy_poll_us) {
+        if (timeout == 0 && _spin_begin) {
+            _spin_us.fetch_add(elapsed, std::memory_order_relaxed);
+        } else if (timeout == 0) {
+            _work_us.fetch_add(elapsed, std::memory_order_relaxed);
         } else {
-            _list_task.emplace_back(ret);
+            _sleep_us.fetch_add(elapsed, std::memory_order_relaxed);
+        }
+        if (has_event) {
+            //有事件要处理，下次空闲时重新开始忙轮询
+            _spin_begin = 0;
         }
+        _last_spin = !has_event && timeout == 0 && _spin_begin;
+    }
+    _wake_time = now;
+}
+
+EventLoop::LoadStat EventLoop::getLoadStat() const {
+    LoadStat ret;
+    ret.busy_us = _busy_us.load(std::memory_order_relaxed);
+    ret.idle_us = _idle_us.load(std::memory_order_relaxed);
+    uint64_t sleep_begin = _sleep_begin.load(std::memory_order_relaxed);
+    if (sleep_begin) {
+        //长时间没有事件的poller一直处于休眠中，计入当前这次休眠
+        uint64_t now = getMonotonicMicrosecond();
+        ret.idle_us += now > sleep_begin ? now - sleep_begin : 0;
     }
-    //写数据到管道,唤醒主线程
-    _pipe.write("", 1);
+    ret.task_delay = _task_delay.snapshot();
+    ret.timer_late = _timing_wheel.lateness().snapshot();
+#if defined(HAS_TIMERFD)
+    ret.timer_late += _precise_late.snapshot();
+#endif //HAS_TIMERFD
     return ret;
 }
 
@@ -290,37 +529,21 @@ inline void EventLoop::onPipeEvent(bool flush) {
       }
     }
 
-    decltype(_list_task) _list_swap;
-    {
-        lock_guard<mutex> lck(_mtx_task);
-        _list_swap.swap(_list_task);
-    }
+    flushTask();
+}
 
-    _list_swap.for_each([&](const Task::Ptr &task) {
-        try {
-            (*task)();
-        } catch (ExitException &) {
-            _exit_flag = true;
-        } catch (std::exception &ex) {
-            ErrorL << "Exception occurred when do async task: " << ex.what();
+Buffer::Ptr EventLoop::getSharedBuffer(bool is_udp) {
+    auto ret = _shared_buffer[is_udp].lock();
+    if (!ret) {
+        ret = std::make_shared<Buffer>();
+        if (ret->SetCapacity(is_udp ? RAW_BUFFER_SIZE : TCP_BUFFER_SIZE) == chw::fail) {
+            return nullptr;
         }
-    });
+        _shared_buffer[is_udp] = ret;
+    }
+    return ret;
 }
 
-// SocketRecvBuffer::Ptr EventLoop::getSharedBuffer(bool is_udp) {
-// #if !defined(__linux) && !defined(__linux__)
-//     // 非Linux平台下，tcp和udp共享recvfrom方案，使用同一个buffer  [AUTO-TRANSLATED:2d2ee7bf]
-//     //On non-Linux platforms, tcp and udp share the recvfrom scheme, using the same buffer
-//     is_udp = 0;
-// #endif
-//     auto ret = _shared_buffer[is_udp].lock();
-//     if (!ret) {
-//         ret = SocketRecvBuffer::create(is_udp);
-//         _shared_buffer[is_udp] = ret;
-//     }
-//     return ret;
-// }
-
 thread::id EventLoop::getThreadId() const {
     return _loop_thread ? _loop_thread->get_id() : thread::id();
 }
@@ -329,6 +552,10 @@ const std::string& EventLoop::getThreadName() const {
     return _name;
 }
 
+size_t EventLoop::getFdCount() const {
+    return _fd_count;
+}
+
 static thread_local std::weak_ptr<EventLoop> s_current_poller;
 
 // static
@@ -345,70 +572,76 @@ void EventLoop::runLoop(bool blocked, bool ref_self) {
         _exit_flag = false;
         uint64_t minDelay;
 #if defined(HAS_EPOLL)
+#if defined(HAS_IO_URING)
+        if (_uring) {
+            runUringLoop();
+            return;
+        }
+#endif //HAS_IO_URING
         struct epoll_event events[EPOLL_SIZE];
         while (!_exit_flag) {
             minDelay = getMinDelay();
-            //startSleep();//用于统计当前线程负载情况
-            int ret = epoll_wait(_event_fd, events, EPOLL_SIZE, minDelay ? minDelay : -1);
-            //sleepWakeUp();//用于统计当前线程负载情况
+            int timeout = pollTimeout(minDelay);
+            startSleep();//用于统计当前线程负载情况
+            int ret = epoll_wait(_event_fd, events, EPOLL_SIZE, timeout);
+            _sleeping.store(false, std::memory_order_relaxed);
+            sleepWakeUp(timeout, ret > 0);//用于统计当前线程负载情况
             if (ret <= 0) {
                 //超时或被打断
                 continue;
             }
 
-            _event_cache_expired.clear();
-
+            _event_dispatching = true;
             for (int i = 0; i < ret; ++i) {
                 struct epoll_event &ev = events[i];
-                int fd = ev.data.fd;
-                if (_event_cache_expired.count(fd)) {
-                    //event cache refresh
+                int fd = (int)(uint32_t)ev.data.u64;
+                EventRecord *record = findEventRecord(fd);
+                if (!record) {
+                    epoll_ctl(_event_fd, EPOLL_CTL_DEL, fd, nullptr);
                     continue;
                 }
-
-                auto it = _event_map.find(fd);
-                if (it == _event_map.end()) {
-                    epoll_ctl(_event_fd, EPOLL_CTL_DEL, fd, nullptr);
+                if (record->gen != (uint32_t)(ev.data.u64 >> 32)) {
+                    //fd在本轮已删除并重新添加，忽略旧的事件
                     continue;
                 }
-                auto cb = it->second;
                 try {
-                    (*cb)(toPoller(ev.events));
+                    (*record->cb)(toPoller(ev.events));
                 } catch (std::exception &ex) {
                     ErrorL << "Exception occurred when do event task: " << ex.what();
                 }
             }
+            _event_dispatching = false;
+            _event_expired.clear();
         }
 #elif defined(HAS_KQUEUE)
         struct kevent kevents[KEVENT_SIZE];
         while (!_exit_flag) {
             minDelay = getMinDelay();
-            struct timespec timeout = { (long)minDelay / 1000, (long)minDelay % 1000 * 1000000 };
+            int timeout = pollTimeout(minDelay);
+            struct timespec ts = { (long)timeout / 1000, (long)timeout % 1000 * 1000000 };
 
             startSleep();
-            int ret = kevent(_event_fd, nullptr, 0, kevents, KEVENT_SIZE, minDelay ? &timeout : nullptr);
-            sleepWakeUp();
+            int ret = kevent(_event_fd, nullptr, 0, kevents, KEVENT_SIZE, timeout >= 0 ? &ts : nullptr);
+            _sleeping.store(false, std::memory_order_relaxed);
+            sleepWakeUp(timeout, ret > 0);
             if (ret <= 0) {
                 continue;
             }
 
-            _event_cache_expired.clear();
-
+            _event_dispatching = true;
             for (int i = 0; i < ret; ++i) {
                 auto &kev = kevents[i];
-                auto fd = kev.ident;
-                if (_event_cache_expired.count(fd)) {
-                    // event cache refresh
-                    continue;
-                }
-
-                auto it = _event_map.find(fd);
-                if (it == _event_map.end()) {
+                int fd = (int)kev.ident;
+                EventRecord *record = findEventRecord(fd);
+                if (!record) {
                     EV_SET(&kev, fd, kev.filter, EV_DELETE, 0, 0, nullptr);
                     kevent(_event_fd, &kev, 1, nullptr, 0, nullptr);
                     continue;
                 }
-                auto cb = it->second;
+                if (record->gen != (uint32_t)(uintptr_t)kev.udata) {
+                    //fd在本轮已删除并重新添加，忽略旧的事件
+                    continue;
+                }
                 int event = 0;
                 switch (kev.filter) {
                     case EVFILT_READ: event = Event_Read; break;
@@ -417,11 +650,13 @@ void EventLoop::runLoop(bool blocked, bool ref_self) {
                 }
 
                 try {
-                    (*cb)(event);
+                    (*record->cb)(event);
                 } catch (std::exception &ex) {
                     ErrorL << "Exception occurred when do event task: " << ex.what();
                 }
             }
+            _event_dispatching = false;
+            _event_expired.clear();
         }
 #else
         int ret, max_fd;
@@ -454,9 +689,15 @@ void EventLoop::runLoop(bool blocked, bool ref_self) {
                 }
             }
 
-            //startSleep();//用于统计当前线程负载情况
-            ret = zl_select(max_fd + 1, &set_read, &set_write, &set_err, minDelay ? &tv : nullptr);
-            //sleepWakeUp();//用于统计当前线程负载情况
+            int timeout = pollTimeout(minDelay);
+            if (timeout == 0) {
+                tv.tv_sec = 0;
+                tv.tv_usec = 0;
+            }
+            startSleep();//用于统计当前线程负载情况
+            ret = zl_select(max_fd + 1, &set_read, &set_write, &set_err, timeout >= 0 ? &tv : nullptr);
+            _sleeping.store(false, std::memory_order_relaxed);
+            sleepWakeUp(timeout, ret > 0);//用于统计当前线程负载情况
 
             if (ret <= 0) {
                 //超时或被打断  [AUTO-TRANSLATED:7005fded]
@@ -506,67 +747,250 @@ void EventLoop::runLoop(bool blocked, bool ref_self) {
     }
 }
 
-uint64_t EventLoop::flushDelayTask(uint64_t now_time) {
-    decltype(_delay_task_map) task_copy;
-    task_copy.swap(_delay_task_map);
+#if defined(HAS_IO_URING)
+//取消poll请求的user_data，完成项直接忽略，事件代数从1开始不会与其冲突
+#define URING_IGNORE_DATA 0
 
-    for (auto it = task_copy.begin(); it != task_copy.end() && it->first <= now_time; it = task_copy.erase(it)) {
-        //已到期的任务  [AUTO-TRANSLATED:849cdc29]
-        //Expired tasks
-        try {
-            auto next_delay = (*(it->second))();
-            if (next_delay) {
-                //可重复任务,更新时间截止线  [AUTO-TRANSLATED:c7746a21]
-                //Repeatable tasks, update deadline
-                _delay_task_map.emplace(next_delay + now_time, std::move(it->second));
-            }
-        } catch (std::exception &ex) {
-            ErrorL << "Exception occurred when do delay task: " << ex.what();
+void EventLoop::uringPollAdd(int fd, int event, uint32_t gen) {
+    struct io_uring_sqe *sqe = _uring->getSqe();
+    if (!sqe) {
+        ErrorL << "io_uring submission queue is full, fd:" << fd;
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = toEpoll(event);
+    if (!(event & Event_LT) && _uring->multishotPoll()) {
+        //边沿触发，一次提交持续产生完成项；内核不支持multishot时按oneshot提交，完成后重新提交
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = toEventData(fd, gen);
+}
+
+void EventLoop::uringPollRemove(int fd, uint32_t gen) {
+    struct io_uring_sqe *sqe = _uring->getSqe();
+    if (!sqe) {
+        ErrorL << "io_uring submission queue is full, fd:" << fd;
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = toEventData(fd, gen);
+    sqe->user_data = URING_IGNORE_DATA;
+}
+
+void EventLoop::runUringLoop() {
+    struct io_uring_cqe cqes[EPOLL_SIZE];
+    uint64_t minDelay;
+    while (!_exit_flag) {
+        minDelay = getMinDelay();
+        //poll请求和取消请求在休眠前批量提交，完成项批量收割，每轮只需一次系统调用
+        int timeout = pollTimeout(minDelay);
+        startSleep();
+        int ret = timeout ? _uring->submitAndWait(minDelay) : _uring->submit();
+        _sleeping.store(false, std::memory_order_relaxed);
+        sleepWakeUp(timeout, _uring->hasCqe());
+        if (ret == -1) {
+            ErrorL << "io_uring_enter failed: " << get_uv_errmsg();
+            continue;
         }
+
+        uint32_t count = 0;
+        _event_dispatching = true;
+        do {
+            count = _uring->peekCqes(cqes, EPOLL_SIZE);
+            for (uint32_t i = 0; i < count; ++i) {
+                struct io_uring_cqe &cqe = cqes[i];
+                if (cqe.user_data == URING_IGNORE_DATA) {
+                    continue;
+                }
+
+                int fd = (int)(uint32_t)cqe.user_data;
+                uint32_t gen = (uint32_t)(cqe.user_data >> 32);
+                EventRecord *record = findEventRecord(fd);
+                if (!record || record->gen != gen) {
+                    //fd已删除或已修改监听事件
+                    continue;
+                }
+
+                //内核资源不足时multishot请求可能被终止，不算fd错误
+                bool interrupted = cqe.res == -ECANCELED || cqe.res == -ENOMEM;
+                if (!interrupted) {
+                    try {
+                        (*record->cb)(cqe.res < 0 ? (int)Event_Error : toPoller(cqe.res));
+                    } catch (std::exception &ex) {
+                        ErrorL << "Exception occurred when do event task: " << ex.what();
+                    }
+                }
+
+                if (!(cqe.flags & IORING_CQE_F_MORE) && (cqe.res >= 0 || interrupted)) {
+                    //oneshot请求或multishot请求被内核终止，仍在监听时重新提交
+                    record = findEventRecord(fd);
+                    if (record && record->gen == gen) {
+                        uringPollAdd(fd, record->event, gen);
+                    }
+                }
+            }
+        } while (count == EPOLL_SIZE);
+        _event_dispatching = false;
+        _event_expired.clear();
     }
+}
+#endif //HAS_IO_URING
 
-    task_copy.insert(_delay_task_map.begin(), _delay_task_map.end());
-    task_copy.swap(_delay_task_map);
+uint64_t EventLoop::flushDelayTask(uint64_t now_time) {
+    //执行已到期的任务，可重复任务在时间轮内重新加入
+    _timing_wheel.advance(now_time);
 
-    auto it = _delay_task_map.begin();
-    if (it == _delay_task_map.end()) {
-        //没有剩余的定时器了  [AUTO-TRANSLATED:23b1119e]
-        //No remaining timers
+    if (_timing_wheel.empty()) {
+        //没有剩余的定时器了
         return 0;
     }
-    //最近一个定时器的执行延时  [AUTO-TRANSLATED:2535621b]
-    //Delay in execution of the last timer
-    return it->first - now_time;
+    //最近一个定时器的执行延时
+    auto next = _timing_wheel.nextExpire();
+    return next > now_time ? next - now_time : 1;
 }
 
 uint64_t EventLoop::getMinDelay() {
-    auto it = _delay_task_map.begin();
-    if (it == _delay_task_map.end()) {
-        //没有剩余的定时器了  [AUTO-TRANSLATED:23b1119e]
-        //No remaining timers
+    if (_timing_wheel.empty()) {
+        //没有剩余的定时器了
         return 0;
     }
     auto now = getCurrentMillisecond();
-    if (it->first > now) {
-        //所有任务尚未到期  [AUTO-TRANSLATED:8d80eabf]
-        //All tasks have not expired
-        return it->first - now;
+    auto next = _timing_wheel.nextExpire();
+    if (next > now) {
+        //所有任务尚未到期
+        return next - now;
     }
-    //执行已到期的任务并刷新休眠延时  [AUTO-TRANSLATED:cd6348b7]
-    //Execute expired tasks and refresh sleep delay
+    //执行已到期的任务并刷新休眠延时
     return flushDelayTask(now);
 }
 
-EventLoop::DelayTask::Ptr EventLoop::doDelayTask(uint64_t delay_ms, function<uint64_t()> task) {
+void onTaskCanceled(const std::weak_ptr<EventLoop> &weak_poller, const std::shared_ptr<TaskCancelable> &task) {
+    auto poller = weak_poller.lock();
+    if (!poller) {
+        return;
+    }
+    //任务可能在自己的回调中被取消，总是异步释放，不在回调执行中销毁回调
+    std::weak_ptr<TaskCancelable> weak_task = task;
+    EventLoop *loop = poller.get();
+    poller->async([loop, weak_task]() {
+        //已经到期出队的任务此时已经析构
+        if (auto strong_task = weak_task.lock()) {
+            strong_task->release();
+            loop->_timing_wheel.onCancel();
+        }
+    }, false);
+}
+
+EventLoop::DelayTask::Ptr EventLoop::doDelayTask(uint64_t delay_ms, DelayTask::func_type task) {
     DelayTask::Ptr ret = std::make_shared<DelayTask>(std::move(task));
+    ret->bindPoller(shared_from_this());
     auto time_line = getCurrentMillisecond() + delay_ms;
     async_first([time_line, ret, this]() {
         //异步执行的目的是刷新select或epoll的休眠时间  [AUTO-TRANSLATED:a6b5c8d7]
         //The purpose of asynchronous execution is to refresh the sleep time of select or epoll
-        _delay_task_map.emplace(time_line, ret);
+        _timing_wheel.add(time_line, ret);
     });
     return ret;
 }
 
-}  // namespace chw
+EventLoop::DelayTask::Ptr EventLoop::doDelayTaskPrecise(uint64_t delay_ns, DelayTask::func_type task) {
+#if defined(HAS_TIMERFD)
+    DelayTask::Ptr ret = std::make_shared<DelayTask>(std::move(task));
+    ret->bindPoller(shared_from_this());
+    auto deadline = getMonotonicNanosecond() + delay_ns;
+    async_first([deadline, ret, this]() {
+        addPreciseTimer(deadline, ret);
+    });
+    return ret;
+#else
+    //没有timerfd时向上取整到毫秒
+    auto inner = std::make_shared<DelayTask>(std::move(task));
+    return doDelayTask((delay_ns + 999999) / 1000000, [inner]() -> uint64_t {
+        uint64_t next_ns = (*inner)();
+        return next_ns ? (next_ns + 999999) / 1000000 : 0;
+    });
+#endif //HAS_TIMERFD
+}
 
+#if defined(HAS_TIMERFD)
+void EventLoop::addPreciseTimer(uint64_t deadline, DelayTask::Ptr task) {
+    if (_timer_fd == -1) {
+        _timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (_timer_fd == -1) {
+            ErrorL << "Create timerfd failed: " << get_uv_errmsg() << ", fallback to millisecond timer";
+            addMillisecondTimer(deadline, task);
+            return;
+        }
+        if (addEvent(_timer_fd, Event_Read, [this](int event) { onTimerFdEvent(); }) == -1) {
+            ErrorL << "Add timerfd to poller failed, fallback to millisecond timer";
+            close(_timer_fd);
+            _timer_fd = -1;
+            addMillisecondTimer(deadline, task);
+            return;
+        }
+    }
+    _precise_timer.push(PreciseTimer{deadline, _precise_seq++, std::move(task)});
+    armTimerFd();
+}
+
+void EventLoop::addMillisecondTimer(uint64_t deadline, const DelayTask::Ptr &task) {
+    //timerfd不可用时交给时间轮，精度降为毫秒，任务不丢失
+    uint64_t now = getMonotonicNanosecond();
+    uint64_t delay_ms = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+    //与没有timerfd时一样，下次延时向上取整到毫秒，task取消后包装任务返回0不再执行
+    auto wrap = std::make_shared<DelayTask>([task]() -> uint64_t {
+        uint64_t next_ns = (*task)();
+        return next_ns ? (next_ns + 999999) / 1000000 : 0;
+    });
+    _timing_wheel.add(getCurrentMillisecond() + delay_ms, wrap);
+}
+
+void EventLoop::onTimerFdEvent() {
+    uint64_t expirations;
+    while (::read(_timer_fd, &expirations, sizeof(expirations)) == -1 && errno == EINTR) {
+    }
+    //timerfd已触发，需要重新设置
+    _timer_fd_deadline = 0;
+
+    uint64_t now = getMonotonicNanosecond();
+    while (!_precise_timer.empty() && _precise_timer.top().deadline <= now) {
+        PreciseTimer timer = _precise_timer.top();
+        _precise_timer.pop();
+        _precise_late.record((now - timer.deadline) / 1000);
+        try {
+            auto next_delay = (*timer.task)();
+            if (next_delay) {
+                //按上次到期时间累加避免周期漂移，已落后时从当前时间开始
+                uint64_t deadline = timer.deadline + next_delay;
+                if (deadline <= now) {
+                    deadline = now + next_delay;
+                }
+                _precise_timer.push(PreciseTimer{deadline, _precise_seq++, std::move(timer.task)});
+            }
+        } catch (std::exception &ex) {
+            ErrorL << "Exception occurred when do precise delay task: " << ex.what();
+        }
+    }
+    armTimerFd();
+}
+
+void EventLoop::armTimerFd() {
+    uint64_t deadline = _precise_timer.empty() ? 0 : _precise_timer.top().deadline;
+    if (deadline == _timer_fd_deadline) {
+        return;
+    }
+    //到期时间为0表示停止timerfd
+    struct itimerspec spec = {};
+    spec.it_value.tv_sec = deadline / 1000000000ULL;
+    spec.it_value.tv_nsec = deadline % 1000000000ULL;
+    if (timerfd_settime(_timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        ErrorL << "timerfd_settime failed: " << get_uv_errmsg();
+        return;
+    }
+    _timer_fd_deadline = deadline;
+}
+#endif //HAS_TIMERFD
+
+}  // namespace chw
@@ -5,15 +5,23 @@
 #define __EVENT_LOOP_H
 
 #include <mutex>
+#include <atomic>
 #include <thread>
 #include <string>
 #include <functional>
 #include <memory>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include <queue>
 #include "PipeWrap.h"
+#include "UringWrap.h"
+#include "TimingWheel.h"
+#include "MpscQueue.h"
 #include "Logger.h"
+#include "LatencyHistogram.h"
 #include "Semaphore.h"
+#include "Buffer.h"
 //#include "Util/List.h"
 //#include "Thread/TaskExecutor.h"
 //#include "Thread/ThreadPool.h"
@@ -22,17 +30,24 @@
 
 #if defined(__linux__) || defined(__linux)
 #define HAS_EPOLL
+//高精度定时器使用timerfd
+#define HAS_TIMERFD
 #endif //__linux__
 
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
 #define HAS_KQUEUE
 #endif // __APPLE__
 
+//事件表每块包含的fd数量
+#define EVENT_CHUNK_SHIFT 10
+#define EVENT_CHUNK_MASK ((1 << EVENT_CHUNK_SHIFT) - 1)
+
 namespace chw {
 
 class EventLoop : public std::enable_shared_from_this<EventLoop> {
 public:
     friend class TaskExecutorGetterImp;
+    friend void onTaskCanceled(const std::weak_ptr<EventLoop> &poller, const std::shared_ptr<TaskCancelable> &task);
 
     using Ptr = std::shared_ptr<EventLoop>;
     using PollEventCB = std::function<void(int event)>;
@@ -75,21 +90,18 @@ public:
     int modifyEvent(int fd, int event, PollCompleteCB cb = nullptr);
 
     /**
-     * 异步执行任务
+     * 异步执行任务，捕获数据较小时投递任务不分配堆内存
      * @param task 任务
      * @param may_sync 如果调用该函数的线程就是本对象的轮询线程，那么may_sync为true时就是同步执行任务
-     * @return 是否成功，一定会返回true
-
      */
-    Task::Ptr async(TaskIn task, bool may_sync = true);
+    void async(TaskIn task, bool may_sync = true);
 
     /**
      * 同async方法，不过是把任务打入任务列队头，这样任务优先级最高
      * @param task 任务
      * @param may_sync 如果调用该函数的线程就是本对象的轮询线程，那么may_sync为true时就是同步执行任务
-     * @return 是否成功，一定会返回true
      */
-    Task::Ptr async_first(TaskIn task, bool may_sync = true);
+    void async_first(TaskIn task, bool may_sync = true);
 
     /**
      * 判断执行该接口的线程是否为本对象的轮询线程
@@ -103,20 +115,28 @@ public:
      * @param task 任务，返回值为0时代表不再重复任务，否则为下次执行延时，如果任务中抛异常，那么默认不重复任务
      * @return 可取消的任务标签
      */
-    DelayTask::Ptr doDelayTask(uint64_t delay_ms, std::function<uint64_t()> task);
+    DelayTask::Ptr doDelayTask(uint64_t delay_ms, DelayTask::func_type task);
+
+    /**
+     * 高精度延时执行某个任务，linux下使用CLOCK_MONOTONIC的timerfd，其他平台退化为毫秒精度
+     * 比doDelayTask开销大，只用于需要亚毫秒精度的场景
+     * @param delay_ns 延时纳秒数
+     * @param task 任务，返回值为0时代表不再重复任务，否则为下次执行延时(纳秒)，如果任务中抛异常，那么默认不重复任务
+     * @return 可取消的任务标签
+     */
+    DelayTask::Ptr doDelayTaskPrecise(uint64_t delay_ns, DelayTask::func_type task);
 
     /**
      * 获取当前线程关联的Poller实例
      */
     static EventLoop::Ptr getCurrentPoller();
 
-    // /**
-    //  * 获取当前线程下所有socket共享的读缓存
-    //  * Gets the shared read buffer for all sockets in the current thread
-     
-    //  * [AUTO-TRANSLATED:2796f458]
-    //  */
-    // SocketRecvBuffer::Ptr getSharedBuffer(bool is_udp);
+    /**
+     * 获取当前线程下所有socket共享的读缓存，只能在poller线程调用
+     * 没有socket引用时自动释放，下次获取时重新分配
+     * @param is_udp [in]udp缓存大小为RAW_BUFFER_SIZE，tcp为TCP_BUFFER_SIZE
+     */
+    Buffer::Ptr getSharedBuffer(bool is_udp);
 
     /**
      * 获取poller线程id
@@ -128,6 +148,65 @@ public:
      */
     const std::string& getThreadName() const;
 
+    /**
+     * 设置之后创建的EventLoop是否使用io_uring代替epoll(--io-uring)，内核不支持时自动回退到epoll
+     */
+    static void setUseUring(bool enable);
+
+    /**
+     * 设置之后创建的EventLoop的忙轮询时长(--busy-poll)，单位微秒，0表示关闭。
+     * 开启后空闲时先以0超时轮询该时长再阻塞休眠，用cpu换取更低的唤醒延时
+     */
+    static void setBusyPoll(uint32_t us);
+
+    /**
+     * 获取忙轮询时长，单位微秒
+     */
+    static uint32_t getBusyPoll();
+
+    /**
+     * @brief 获取忙轮询统计，只有开启忙轮询时才统计（可在任意线程执行）
+     *
+     * @param spin_us   [out]空转轮询耗时，微秒
+     * @param work_us   [out]处理事件和任务耗时，微秒
+     * @param sleep_us  [out]阻塞休眠耗时，微秒
+     */
+    void getBusyPollStat(uint64_t &spin_us, uint64_t &work_us, uint64_t &sleep_us) const;
+
+    //负载统计，都是累计值，区间统计由调用者对两次结果求差
+    struct LoadStat {
+        uint64_t busy_us = 0;//处理事件、任务、定时器的耗时，微秒
+        uint64_t idle_us = 0;//休眠和空转轮询的耗时，微秒
+        LatencyHistogram::Snapshot task_delay;//async投递到执行的延时
+        LatencyHistogram::Snapshot timer_late;//定时器到期到执行的延时
+
+        /**
+         * @brief 忙碌时间占比，百分比
+         */
+        uint32_t load() const {
+            return busy_us + idle_us ? (uint32_t)(busy_us * 100 / (busy_us + idle_us)) : 0;
+        }
+
+        LoadStat operator-(const LoadStat &other) const {
+            LoadStat ret;
+            ret.busy_us = busy_us - other.busy_us;
+            ret.idle_us = idle_us - other.idle_us;
+            ret.task_delay = task_delay - other.task_delay;
+            ret.timer_late = timer_late - other.timer_late;
+            return ret;
+        }
+    };
+
+    /**
+     * @brief 获取负载统计（可在任意线程执行）
+     */
+    LoadStat getLoadStat() const;
+
+    /**
+     * 获取当前监听的fd数量，用于线程池选择负载最小的poller（可在任意线程执行）
+     */
+    size_t getFdCount() const;
+
     /**
      * @brief 创建一个EventLoop
      * 
@@ -170,14 +249,44 @@ public:
      */
     void onPipeEvent(bool flush = false);
 
+    /**
+     * 休眠前调用，有待执行的任务时先执行任务并返回false，此时轮询不应阻塞
+     * @return 是否可以阻塞休眠
+     */
+    bool prepareSleep();
+
+    /**
+     * 执行从其他线程切换过来的任务，最多执行调用时已入队的任务数量，防止任务中再次投递任务导致饿死
+     * @return 执行的任务数量
+     */
+    int64_t flushTask();
+
+    /**
+     * 计算本轮轮询的超时时间，忙轮询时长内返回0
+     * @param min_delay 最近一个定时器的延时，0表示没有定时器
+     * @return 超时时间，毫秒，-1表示一直等待
+     */
+    int pollTimeout(uint64_t min_delay);
+
+    /**
+     * 轮询前调用，统计上一轮处理耗时，用于统计当前线程负载情况
+     */
+    void startSleep();
+
+    /**
+     * 轮询后调用，统计轮询耗时
+     * @param timeout    本轮轮询的超时时间
+     * @param has_event  是否收到事件
+     */
+    void sleepWakeUp(int timeout, bool has_event);
+
     /**
      * 切换线程并执行任务
      * @param task
      * @param may_sync
      * @param first
-     * @return 可取消的任务本体，如果已经同步执行，则返回nullptr
      */
-    Task::Ptr async_l(TaskIn task, bool may_sync = true, bool first = false);
+    void async_l(TaskIn task, bool may_sync = true, bool first = false);
 
     /**
      * 结束事件轮询
@@ -200,9 +309,88 @@ public:
      */
     void addEventPipe();
 
+#if defined(HAS_TIMERFD)
+    /**
+     * 添加高精度定时器，首次使用时创建timerfd
+     */
+    void addPreciseTimer(uint64_t deadline, DelayTask::Ptr task);
+
+    /**
+     * timerfd不可用时，把高精度定时器按毫秒精度加入时间轮
+     */
+    void addMillisecondTimer(uint64_t deadline, const DelayTask::Ptr &task);
+
+    /**
+     * timerfd可读，执行到期的高精度定时器
+     */
+    void onTimerFdEvent();
+
+    /**
+     * 按最近的到期时间设置timerfd
+     */
+    void armTimerFd();
+#endif //HAS_TIMERFD
+
 private:
     class ExitException : public std::exception {};
 
+#if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
+    struct EventRecord {
+        std::unique_ptr<PollEventCB> cb;//为空表示未监听
+        uint32_t gen = 0;//每次添加或修改时更新，和fd一起组成事件数据，用于过滤已删除fd的遗留事件
+        int event = 0;
+    };
+
+    /**
+     * 查找fd对应的事件记录，fd未监听时返回nullptr
+     */
+    EventRecord *findEventRecord(int fd) {
+        size_t chunk = (size_t)fd >> EVENT_CHUNK_SHIFT;
+        if (fd < 0 || chunk >= _event_table.size() || !_event_table[chunk]) {
+            return nullptr;
+        }
+        EventRecord *record = &_event_table[chunk][fd & EVENT_CHUNK_MASK];
+        return record->cb ? record : nullptr;
+    }
+
+    /**
+     * 获取fd对应的事件记录，不存在时分配
+     */
+    EventRecord *getEventRecord(int fd);
+
+    /**
+     * 删除fd对应的事件记录，回调延后到本轮事件分发结束后释放
+     */
+    void removeEventRecord(EventRecord *record);
+
+    /**
+     * 生成新的事件代数，跳过0
+     */
+    uint32_t nextEventGen() {
+        if (++_event_gen == 0) {
+            ++_event_gen;
+        }
+        return _event_gen;
+    }
+#endif //defined(HAS_EPOLL) || defined(HAS_KQUEUE)
+
+#if defined(HAS_IO_URING)
+    /**
+     * io_uring事件轮询
+     */
+    void runUringLoop();
+
+    /**
+     * 提交poll请求，边沿触发使用multishot，水平触发使用oneshot并在完成后重新提交
+     */
+    void uringPollAdd(int fd, int event, uint32_t gen);
+
+    /**
+     * 提交取消poll请求
+     */
+    void uringPollRemove(int fd, uint32_t gen);
+#endif //HAS_IO_URING
+
 private:
     //标记loop线程是否退出
     bool _exit_flag;
@@ -211,28 +399,67 @@ private:
     //当前线程下，所有socket共享的读缓存  [AUTO-TRANSLATED:6ce70017]
     //当前线程下，所有socket共享的读缓存
 // Shared read buffer for all sockets under the current thread
-    // std::weak_ptr<SocketRecvBuffer> _shared_buffer[2];
+    std::weak_ptr<Buffer> _shared_buffer[2];
 
     //执行事件循环的线程
     std::thread *_loop_thread = nullptr;
     //通知事件循环的线程已启动
     Semaphore _sem_run_started;
 
-    //内部事件管道
+    //内部事件管道，linux下为eventfd
     PipeWrap _pipe;
-    //从其他线程切换过来的任务
-    std::mutex _mtx_task;
-    List<Task::Ptr> _list_task;
+    //从其他线程切换过来的任务，async_first的任务优先执行
+    struct QueueTask {
+        TaskIn task;
+        uint64_t time;//入队时间，微秒
+    };
+    MpscQueue<QueueTask> _queue_task;
+    MpscQueue<QueueTask> _queue_task_first;
+    //待执行的任务数量，入队前加1
+    std::atomic<int64_t> _task_count{0};
+    //轮询线程是否准备休眠，只有休眠时才写_pipe唤醒
+    std::atomic<bool> _sleeping{false};
 
     //保持日志可用
     Logger::Ptr _logger;
+    //当前监听的fd数量
+    std::atomic<size_t> _fd_count{0};
+
+    //忙轮询时长，微秒，0表示关闭
+    uint32_t _busy_poll_us = 0;
+    //本次空闲开始忙轮询的时间，0表示未开始
+    uint64_t _spin_begin = 0;
+    //上一轮轮询开始和结束的时间
+    std::atomic<uint64_t> _sleep_begin{0};//正在休眠时非0，统计负载时计入当前这次休眠
+    uint64_t _wake_time = 0;
+    //上一轮是否为空转轮询
+    bool _last_spin = false;
+    //负载统计，微秒
+    std::atomic<uint64_t> _busy_us{0};
+    std::atomic<uint64_t> _idle_us{0};
+    //async投递到执行的延时
+    LatencyHistogram _task_delay;
+    //忙轮询统计，微秒
+    std::atomic<uint64_t> _spin_us{0};
+    std::atomic<uint64_t> _work_us{0};
+    std::atomic<uint64_t> _sleep_us{0};
 
 #if defined(HAS_EPOLL) || defined(HAS_KQUEUE)
     // epoll和kqueue相关  [AUTO-TRANSLATED:84d2785e]
     //epoll和kqueue相关
 // epoll and kqueue related
     int _event_fd = -1;
-    std::unordered_map<int, std::shared_ptr<PollEventCB> > _event_map;
+    //按fd索引的事件表，分块分配，扩容时已有记录的地址不变
+    std::vector<std::unique_ptr<EventRecord[]> > _event_table;
+    //本轮循环中删除的回调，回调可能正在执行，本轮事件分发结束后再释放
+    std::vector<std::unique_ptr<PollEventCB> > _event_expired;
+    uint32_t _event_gen = 0;
+    //是否正在分发事件
+    bool _event_dispatching = false;
+#if defined(HAS_IO_URING)
+    //io_uring相关，为空时使用epoll
+    std::unique_ptr<UringWrap> _uring;
+#endif //HAS_IO_URING
 #else
     //select相关
     struct Poll_Record {
@@ -243,11 +470,30 @@ private:
         PollEventCB call_back;
     };
     std::unordered_map<int, Poll_Record::Ptr> _event_map;
-#endif //HAS_EPOLL
     std::unordered_set<int> _event_cache_expired;
+#endif //HAS_EPOLL
 
     //定时器
-    std::multimap<uint64_t, DelayTask::Ptr> _delay_task_map;
+    TimingWheel _timing_wheel;
+
+#if defined(HAS_TIMERFD)
+    //高精度定时器，按到期时间排序，到期时间相同时按添加顺序执行
+    struct PreciseTimer {
+        uint64_t deadline;//到期时间，纳秒
+        uint64_t seq;
+        DelayTask::Ptr task;
+        bool operator>(const PreciseTimer &other) const {
+            return deadline != other.deadline ? deadline > other.deadline : seq > other.seq;
+        }
+    };
+    std::priority_queue<PreciseTimer, std::vector<PreciseTimer>, std::greater<PreciseTimer> > _precise_timer;
+    uint64_t _precise_seq = 0;
+    int _timer_fd = -1;
+    //timerfd当前设置的到期时间，纳秒
+    uint64_t _timer_fd_deadline = 0;
+    //高精度定时器到期到执行的延时
+    LatencyHistogram _precise_late;
+#endif //HAS_TIMERFD
 };
 
 }  // namespace chw
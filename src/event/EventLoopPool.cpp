@@ -0,0 +1,99 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#include "EventLoopPool.h"
+#include "util.h"
+
+namespace chw {
+
+static size_t s_pool_size = 0;
+static EventLoopPool::Balance s_balance = EventLoopPool::BALANCE_ROUND_ROBIN;
+
+INSTANCE_IMP(EventLoopPool)
+
+/**
+ * @brief 设置线程池大小，需要在第一次调用Instance()之前设置
+ *
+ * @param size [in]线程数量，0表示不启用线程池
+ */
+void EventLoopPool::setPoolSize(size_t size)
+{
+    s_pool_size = size;
+}
+
+/**
+ * @brief 设置负载均衡策略，需要在第一次调用Instance()之前设置
+ *
+ * @param balance [in]负载均衡策略
+ */
+void EventLoopPool::setBalance(Balance balance)
+{
+    s_balance = balance;
+}
+
+EventLoopPool::EventLoopPool() : _index(0), _balance(s_balance)
+{
+    // 线程数超过cpu核数时，按核数取模绑定
+    auto cpus = std::thread::hardware_concurrency();
+    for (size_t i = 0; i < s_pool_size; ++i) {
+        auto name = "loop pool " + std::to_string(i);
+        _pollers.emplace_back(EventLoop::addPoller(name, PRIORITY_HIGHEST, true, cpus ? i % cpus : 0));
+    }
+    if (s_pool_size > 0) {
+        InfoL << "EventLoop pool size:" << s_pool_size << ", balance:" << (_balance == BALANCE_ROUND_ROBIN ? "round-robin" : "least-loaded");
+    }
+}
+
+/**
+ * @brief 按负载均衡策略获取一个poller（可在任意线程执行）
+ *
+ * @return EventLoop::Ptr 线程池为空时返回nullptr
+ */
+EventLoop::Ptr EventLoopPool::getPoller()
+{
+    if (_pollers.empty()) {
+        return nullptr;
+    }
+
+    if (_balance == BALANCE_ROUND_ROBIN) {
+        return _pollers[_index++ % _pollers.size()];
+    }
+
+    // 监听fd数量相同时从上次位置往后选，避免总是选中第一个
+    size_t start = _index++;
+    EventLoop::Ptr ret;
+    size_t min_load = SIZE_MAX;
+    for (size_t i = 0; i < _pollers.size(); ++i) {
+        auto &poller = _pollers[(start + i) % _pollers.size()];
+        auto load = poller->getFdCount();
+        if (load < min_load) {
+            min_load = load;
+            ret = poller;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief 获取线程池大小
+ *
+ * @return size_t 线程数量
+ */
+size_t EventLoopPool::getPollerSize() const
+{
+    return _pollers.size();
+}
+
+/**
+ * @brief 遍历所有poller
+ *
+ * @param cb [in]回调
+ */
+void EventLoopPool::for_each(const std::function<void(const EventLoop::Ptr &)> &cb)
+{
+    for (auto &poller : _pollers) {
+        cb(poller);
+    }
+}
+
+}//namespace chw
@@ -0,0 +1,74 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __EVENT_LOOP_POOL_H
+#define __EVENT_LOOP_POOL_H
+
+#include <atomic>
+#include <vector>
+#include <functional>
+#include "EventLoop.h"
+
+namespace chw {
+
+/**
+ * EventLoop线程池，启动N个绑定cpu的EventLoop线程(-j N)，
+ * 用于把tcp服务端新接入的连接分散到多个线程，避免单核瓶颈。
+ */
+class EventLoopPool {
+public:
+    // 选择poller的负载均衡策略
+    enum Balance {
+        BALANCE_ROUND_ROBIN,    // 轮询
+        BALANCE_LEAST_LOADED    // 选择监听fd最少的poller
+    };
+
+    static EventLoopPool &Instance();
+
+    /**
+     * @brief 设置线程池大小，需要在第一次调用Instance()之前设置
+     *
+     * @param size [in]线程数量，0表示不启用线程池
+     */
+    static void setPoolSize(size_t size);
+
+    /**
+     * @brief 设置负载均衡策略，需要在第一次调用Instance()之前设置
+     *
+     * @param balance [in]负载均衡策略
+     */
+    static void setBalance(Balance balance);
+
+    /**
+     * @brief 按负载均衡策略获取一个poller（可在任意线程执行）
+     *
+     * @return EventLoop::Ptr 线程池为空时返回nullptr
+     */
+    EventLoop::Ptr getPoller();
+
+    /**
+     * @brief 获取线程池大小
+     *
+     * @return size_t 线程数量
+     */
+    size_t getPollerSize() const;
+
+    /**
+     * @brief 遍历所有poller
+     *
+     * @param cb [in]回调
+     */
+    void for_each(const std::function<void(const EventLoop::Ptr &)> &cb);
+
+private:
+    EventLoopPool();
+
+private:
+    std::vector<EventLoop::Ptr> _pollers;
+    std::atomic<size_t> _index;
+    Balance _balance;
+};
+
+}//namespace chw
+
+#endif//__EVENT_LOOP_POOL_H
@@ -0,0 +1,165 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __MPSC_QUEUE_H
+#define __MPSC_QUEUE_H
+
+#include <atomic>
+#include <mutex>
+#include "util.h"
+
+namespace chw {
+
+/**
+ * 无锁多生产者单消费者队列(Vyukov)，push可在任意线程执行，pop只能在一个线程执行。
+ * 生产者正在入队时，消费者可能暂时取不到该元素，稍后重试即可。
+ * 节点从队列自带的节点池分配，出队后归还，稳定运行时入队不分配堆内存；
+ * 节点池按块扩容，空闲链表头部带版本号防止ABA，池满时才单独分配节点。
+ */
+template <typename T>
+class MpscQueue : public noncopyable {
+public:
+    MpscQueue() {
+        for (uint32_t i = 0; i < kMaxChunks; ++i) {
+            _chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+        _tail = allocNode();
+        _tail->next.store(nullptr, std::memory_order_relaxed);
+        _head.store(_tail, std::memory_order_relaxed);
+    }
+
+    ~MpscQueue() {
+        T value;
+        while (pop(value)) {
+        }
+        if (!_tail->index) {
+            delete _tail;
+        }
+        for (uint32_t i = 0; i < kMaxChunks; ++i) {
+            delete[] _chunks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief 入队（可在任意线程执行）
+     *
+     * @param value [in]元素
+     */
+    void push(T value) {
+        Node *node = allocNode();
+        node->value = std::move(value);
+        node->next.store(nullptr, std::memory_order_relaxed);
+        Node *prev = _head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @brief 出队（只能在消费者线程执行）
+     *
+     * @param value [out]元素
+     * @return bool 队列为空返回false
+     */
+    bool pop(T &value) {
+        Node *tail = _tail;
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        _tail = next;
+        freeNode(tail);
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node *> next{nullptr};
+        std::atomic<uint32_t> free_next{0};// 空闲链表中下一个节点的编号
+        uint32_t index = 0;// 节点编号，从1开始，0表示池外单独分配的节点
+        T value;
+    };
+
+    // 每块节点数量和最大块数，池内最多kMaxChunks * kChunkSize个节点
+    static const uint32_t kChunkShift = 8;
+    static const uint32_t kChunkSize = 1 << kChunkShift;
+    static const uint32_t kMaxChunks = 1024;
+
+    Node *nodeAt(uint32_t index) {
+        --index;
+        return &_chunks[index >> kChunkShift].load(std::memory_order_acquire)[index & (kChunkSize - 1)];
+    }
+
+    Node *allocNode() {
+        for (;;) {
+            uint64_t head = _free_head.load(std::memory_order_acquire);
+            uint32_t index = (uint32_t)head;
+            if (!index) {
+                if (!grow()) {
+                    return new Node;
+                }
+                continue;
+            }
+            // 节点可能已被其他生产者取走，此时读到的free_next无效，但版本号已变化，CAS会失败
+            Node *node = nodeAt(index);
+            uint64_t next = ((head >> 32) + 1) << 32 | node->free_next.load(std::memory_order_relaxed);
+            if (_free_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                return node;
+            }
+        }
+    }
+
+    void freeNode(Node *node) {
+        if (!node->index) {
+            delete node;
+            return;
+        }
+        pushFree(node, node);
+    }
+
+    // 把first到last的链表(已通过free_next链接)放回空闲链表
+    void pushFree(Node *first, Node *last) {
+        uint64_t head = _free_head.load(std::memory_order_relaxed);
+        uint64_t next;
+        do {
+            last->free_next.store((uint32_t)head, std::memory_order_relaxed);
+            next = ((head >> 32) + 1) << 32 | first->index;
+        } while (!_free_head.compare_exchange_weak(head, next, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool grow() {
+        std::lock_guard<std::mutex> lck(_mtx_grow);
+        if ((uint32_t)_free_head.load(std::memory_order_acquire)) {
+            // 其他线程已经扩容
+            return true;
+        }
+        uint32_t count = _chunk_count.load(std::memory_order_relaxed);
+        if (count == kMaxChunks) {
+            return false;
+        }
+        Node *chunk = new Node[kChunkSize];
+        for (uint32_t i = 0; i < kChunkSize; ++i) {
+            chunk[i].index = (count << kChunkShift) + i + 1;
+            chunk[i].free_next.store(i + 1 < kChunkSize ? chunk[i].index + 1 : 0, std::memory_order_relaxed);
+        }
+        _chunks[count].store(chunk, std::memory_order_release);
+        _chunk_count.store(count + 1, std::memory_order_relaxed);
+        pushFree(&chunk[0], &chunk[kChunkSize - 1]);
+        return true;
+    }
+
+private:
+    // 生产者入队位置
+    std::atomic<Node *> _head;
+    // 消费者出队位置，指向已出队的哨兵节点
+    Node *_tail;
+
+    // 节点池，空闲链表头部低32位为节点编号，高32位为版本号
+    std::atomic<uint64_t> _free_head{0};
+    std::atomic<Node *> _chunks[kMaxChunks];
+    std::atomic<uint32_t> _chunk_count{0};
+    std::mutex _mtx_grow;
+};
+
+} //namespace chw
+
+#endif //__MPSC_QUEUE_H
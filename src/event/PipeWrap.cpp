@@ -12,6 +12,10 @@
 #pragma comment(lib, "ws2_32.lib")
 #endif
 
+#if defined(HAS_EVENTFD)
+#include <sys/eventfd.h>
+#endif
+
 using namespace std;
 
 #define checkFD(fd) \
@@ -50,6 +54,14 @@ void PipeWrap::reOpen() {
     SockUtil::setNoDelay(_pipe_fd[0]);
     SockUtil::setNoDelay(_pipe_fd[1]);
     close(listener_fd);
+#elif defined(HAS_EVENTFD)
+    //读写使用同一个eventfd
+    _pipe_fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_pipe_fd[0] == -1) {
+        throw runtime_error(StrPrinter << "Create eventfd failed: " << get_uv_errmsg());
+    }
+    _pipe_fd[1] = _pipe_fd[0];
+    return;
 #else
     if (pipe(_pipe_fd) == -1) {
         throw runtime_error(StrPrinter << "Create posix pipe failed: " << get_uv_errmsg());
@@ -62,6 +74,10 @@ void PipeWrap::reOpen() {
 }
 
 void PipeWrap::clearFD() {
+    if (_pipe_fd[1] == _pipe_fd[0]) {
+        //eventfd读写是同一个fd
+        _pipe_fd[1] = -1;
+    }
     closeFD(_pipe_fd[0]);
     closeFD(_pipe_fd[1]);
 }
@@ -72,6 +88,14 @@ PipeWrap::~PipeWrap() {
 
 int PipeWrap::write(const void *buf, int n) {
     int ret;
+#if defined(HAS_EVENTFD)
+    //eventfd只累加计数，忽略写入的内容
+    uint64_t count = 1;
+    do {
+        ret = ::write(_pipe_fd[1], &count, sizeof(count));
+    } while (-1 == ret && UV_EINTR == get_uv_error(true));
+    return ret == -1 ? ret : n;
+#else
     do {
 #if defined(_WIN32)
         ret = send(_pipe_fd[1], (char *)buf, n, 0);
@@ -80,10 +104,18 @@ int PipeWrap::write(const void *buf, int n) {
 #endif // defined(_WIN32)
     } while (-1 == ret && UV_EINTR == get_uv_error(true));
     return ret;
+#endif // defined(HAS_EVENTFD)
 }
 
 int PipeWrap::read(void *buf, int n) {
     int ret;
+#if defined(HAS_EVENTFD)
+    //eventfd一次读取并清零计数，buf至少8字节
+    if (n < (int)sizeof(uint64_t)) {
+        return -1;
+    }
+    n = sizeof(uint64_t);
+#endif // defined(HAS_EVENTFD)
     do {
 #if defined(_WIN32)
         ret = recv(_pipe_fd[0], (char *)buf, n, 0);
@@ -4,51 +4,80 @@
 #ifndef __PIPE_WRAP_H
 #define __PIPE_WRAP_H
 
+#include <atomic>
+#include <memory>
 #include "util.h"
+#include "TaskFunc.h"
 
 namespace chw {
 
+class EventLoop;
 
-class TaskCancelable : public noncopyable {
+class TaskCancelable : public noncopyable, public std::enable_shared_from_this<TaskCancelable> {
 public:
     TaskCancelable() = default;
     virtual ~TaskCancelable() = default;
     virtual void cancel() = 0;
+    //释放回调持有的资源，只能在执行任务的线程调用
+    virtual void release() = 0;
 };
 
+/**
+ * @brief 任务被取消后，投递到执行任务的poller线程释放回调，poller已销毁时不处理；定义在EventLoop.cpp
+ * 
+ * @param poller [in]执行任务的poller
+ * @param task   [in]被取消的任务
+ */
+void onTaskCanceled(const std::weak_ptr<EventLoop> &poller, const std::shared_ptr<TaskCancelable> &task);
+
 template<class R, class... ArgTypes>
 class TaskCancelableImp;
 
+/**
+ * 可取消的任务，回调内联保存在对象内，make_shared只需一次内存分配
+ * 绑定了poller的任务取消后在poller线程释放回调，未绑定的在任务对象析构时释放
+ */
 template<class R, class... ArgTypes>
 class TaskCancelableImp<R(ArgTypes...)> : public TaskCancelable {
 public:
     using Ptr = std::shared_ptr<TaskCancelableImp>;
-    using func_type = std::function<R(ArgTypes...)>;
+    using func_type = TaskFunc<R(ArgTypes...)>;
 
     ~TaskCancelableImp() = default;
 
     template<typename FUNC>
-    TaskCancelableImp(FUNC &&task) {
-        _strongTask = std::make_shared<func_type>(std::forward<FUNC>(task));
-        _weakTask = _strongTask;
+    TaskCancelableImp(FUNC &&task) : _task(std::forward<FUNC>(task)) {}
+
+    //绑定执行任务的poller，需要由shared_ptr持有
+    void bindPoller(const std::shared_ptr<EventLoop> &poller) {
+        _poller = poller;
     }
 
+    //可在任意线程取消，回调持有的资源在poller线程释放，不用等到任务到期
     void cancel() override {
-        _strongTask = nullptr;
+        if (_canceled.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        if (!_poller.expired()) {
+            onTaskCanceled(_poller, shared_from_this());
+        }
+    }
+
+    void release() override {
+        _task = nullptr;
     }
 
     operator bool() {
-        return _strongTask && *_strongTask;
+        return !_canceled.load(std::memory_order_acquire) && _task;
     }
 
     void operator=(std::nullptr_t) {
-        _strongTask = nullptr;
+        cancel();
     }
 
     R operator()(ArgTypes ...args) const {
-        auto strongTask = _weakTask.lock();
-        if (strongTask && *strongTask) {
-            return (*strongTask)(std::forward<ArgTypes>(args)...);
+        if (!_canceled.load(std::memory_order_acquire) && _task) {
+            return _task(std::forward<ArgTypes>(args)...);
         }
         return defaultValue<R>();
     }
@@ -70,13 +99,19 @@ public:
     }
 
 protected:
-    std::weak_ptr<func_type> _weakTask;
-    std::shared_ptr<func_type> _strongTask;
+    func_type _task;
+    std::atomic<bool> _canceled{false};
+    std::weak_ptr<EventLoop> _poller;// 执行任务的poller，未绑定时为空
 };
 
-using TaskIn = std::function<void()>;
+using TaskIn = TaskFunc<void()>;
 using Task = TaskCancelableImp<void()>;
 
+#if defined(__linux__) || defined(__linux)
+//linux下使用eventfd代替管道，多次写入合并为一次读取
+#define HAS_EVENTFD
+#endif //__linux__
+
 class PipeWrap {
 public:
     PipeWrap();
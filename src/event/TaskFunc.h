@@ -0,0 +1,164 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __TASK_FUNC_H
+#define __TASK_FUNC_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace chw {
+
+template<typename Sig>
+class TaskFunc;
+
+/**
+ * 只能移动的可调用对象，用于代替std::function保存EventLoop的任务。
+ * 捕获的数据不超过kInlineSize字节时直接保存在对象内部，不分配堆内存，超过时才在堆上分配。
+ */
+template<typename R, typename... ArgTypes>
+class TaskFunc<R(ArgTypes...)> {
+public:
+    static const size_t kInlineSize = 64;
+
+    TaskFunc() = default;
+    TaskFunc(std::nullptr_t) {}
+
+    template<typename FUNC, typename = typename std::enable_if<!std::is_same<typename std::decay<FUNC>::type, TaskFunc>::value>::type>
+    TaskFunc(FUNC &&func) {
+        using F = typename std::decay<FUNC>::type;
+        if (isEmpty(func)) {
+            return;
+        }
+        init<F>(std::forward<FUNC>(func), std::integral_constant<bool, sizeof(F) <= kInlineSize
+            && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<F>::value>());
+    }
+
+    TaskFunc(TaskFunc &&other) noexcept {
+        moveFrom(other);
+    }
+
+    TaskFunc &operator=(TaskFunc &&other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    TaskFunc &operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    TaskFunc(const TaskFunc &) = delete;
+    TaskFunc &operator=(const TaskFunc &) = delete;
+
+    ~TaskFunc() {
+        reset();
+    }
+
+    explicit operator bool() const {
+        return _ops != nullptr;
+    }
+
+    R operator()(ArgTypes ...args) const {
+        return _ops->invoke(_storage, std::forward<ArgTypes>(args)...);
+    }
+
+private:
+    struct Ops {
+        R (*invoke)(void *storage, ArgTypes &&...args);
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *storage);
+    };
+
+    template<typename F>
+    struct InlineOps {
+        static R invoke(void *storage, ArgTypes &&...args) {
+            return (*reinterpret_cast<F *>(storage))(std::forward<ArgTypes>(args)...);
+        }
+        static void move(void *dst, void *src) {
+            new (dst) F(std::move(*reinterpret_cast<F *>(src)));
+            reinterpret_cast<F *>(src)->~F();
+        }
+        static void destroy(void *storage) {
+            reinterpret_cast<F *>(storage)->~F();
+        }
+        static const Ops ops;
+    };
+
+    template<typename F>
+    struct HeapOps {
+        static R invoke(void *storage, ArgTypes &&...args) {
+            return (**reinterpret_cast<F **>(storage))(std::forward<ArgTypes>(args)...);
+        }
+        static void move(void *dst, void *src) {
+            *reinterpret_cast<F **>(dst) = *reinterpret_cast<F **>(src);
+        }
+        static void destroy(void *storage) {
+            delete *reinterpret_cast<F **>(storage);
+        }
+        static const Ops ops;
+    };
+
+    //空的函数指针或std::function不保存，保证operator bool与原对象一致
+    template<typename F>
+    static bool isEmpty(const F &func, typename std::enable_if<std::is_constructible<bool, const F &>::value>::type * = nullptr) {
+        return !static_cast<bool>(func);
+    }
+
+    template<typename F>
+    static bool isEmpty(const F &, typename std::enable_if<!std::is_constructible<bool, const F &>::value>::type * = nullptr) {
+        return false;
+    }
+
+    template<typename F, typename FUNC>
+    void init(FUNC &&func, std::true_type) {
+        new (_storage) F(std::forward<FUNC>(func));
+        _ops = &InlineOps<F>::ops;
+    }
+
+    template<typename F, typename FUNC>
+    void init(FUNC &&func, std::false_type) {
+        *reinterpret_cast<F **>(_storage) = new F(std::forward<FUNC>(func));
+        _ops = &HeapOps<F>::ops;
+    }
+
+    void moveFrom(TaskFunc &other) {
+        if (other._ops) {
+            other._ops->move(_storage, other._storage);
+            _ops = other._ops;
+            other._ops = nullptr;
+        }
+    }
+
+    void reset() {
+        if (_ops) {
+            _ops->destroy(_storage);
+            _ops = nullptr;
+        }
+    }
+
+private:
+    alignas(std::max_align_t) mutable unsigned char _storage[kInlineSize];
+    const Ops *_ops = nullptr;
+};
+
+template<typename R, typename... ArgTypes>
+template<typename F>
+const typename TaskFunc<R(ArgTypes...)>::Ops TaskFunc<R(ArgTypes...)>::InlineOps<F>::ops = {
+    &InlineOps<F>::invoke, &InlineOps<F>::move, &InlineOps<F>::destroy
+};
+
+template<typename R, typename... ArgTypes>
+template<typename F>
+const typename TaskFunc<R(ArgTypes...)>::Ops TaskFunc<R(ArgTypes...)>::HeapOps<F>::ops = {
+    &HeapOps<F>::invoke, &HeapOps<F>::move, &HeapOps<F>::destroy
+};
+
+} //namespace chw
+
+#endif //__TASK_FUNC_H
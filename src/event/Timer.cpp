@@ -5,11 +5,24 @@
 
 namespace chw {
 
-Timer::Timer(float second, const std::function<bool()> &cb, const EventLoop::Ptr &poller) {
+Timer::Timer(float second, const std::function<bool()> &cb, const EventLoop::Ptr &poller, bool precise) {
     _poller = poller;
     if (!_poller) {
         //_poller = EventPollerPool::Instance().getPoller();//chw:todo
     }
+    if (precise) {
+        uint64_t delay_ns = (uint64_t) ((double) second * 1000000000);
+        _tag = _poller->doDelayTaskPrecise(delay_ns, [cb, delay_ns]() {
+            try {
+                //返回下次执行延时，0表示不再重复
+                return cb() ? delay_ns : (uint64_t) 0;
+            } catch (std::exception &ex) {
+                ErrorL << "Exception occurred when do timer task: " << ex.what();
+                return delay_ns;
+            }
+        });
+        return;
+    }
     _tag = _poller->doDelayTask((uint64_t) (second * 1000), [cb, second]() {
         try {
             if (cb()) {
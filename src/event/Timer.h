@@ -18,8 +18,9 @@ public:
      * @param second 定时器重复秒数
      * @param cb 定时器任务，返回true表示重复下次任务，否则不重复，如果任务中抛异常，则默认重复下次任务
      * @param poller EventPoller对象，可以为nullptr
+     * @param precise 是否使用高精度定时器(EventLoop::doDelayTaskPrecise)，默认毫秒精度
      */
-    Timer(float second, const std::function<bool()> &cb, const EventLoop::Ptr &poller);
+    Timer(float second, const std::function<bool()> &cb, const EventLoop::Ptr &poller, bool precise = false);
     ~Timer();
 
 private:
@@ -0,0 +1,303 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#include "TimingWheel.h"
+#include "Logger.h"
+#include "TimeThread.h"
+
+namespace chw {
+
+// 第level层(1~4)槽位对应的时间位移
+#define LEVEL_SHIFT(level) (8 + 6 * ((level) - 1))
+
+TimingWheel::TimingWheel(uint64_t now_ms) : _jiffies(now_ms) {
+}
+
+TimingWheel::~TimingWheel() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (Node *node = _slot0[i].head; node;) {
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+    for (int level = 1; level < kLevels; ++level) {
+        for (uint32_t i = 0; i < 64; ++i) {
+            for (Node *node = _slots[level - 1][i].head; node;) {
+                Node *next = node->next;
+                delete node;
+                node = next;
+            }
+        }
+    }
+    while (_free_list) {
+        Node *next = _free_list->next;
+        delete _free_list;
+        _free_list = next;
+    }
+}
+
+TimingWheel::Node *TimingWheel::allocNode() {
+    if (_free_list) {
+        Node *node = _free_list;
+        _free_list = node->next;
+        return node;
+    }
+    return new Node;
+}
+
+void TimingWheel::freeNode(Node *node) {
+    node->task = nullptr;
+    node->next = _free_list;
+    _free_list = node;
+}
+
+/**
+ * @brief 添加延时任务
+ *
+ * @param expire_ms [in]到期时间，毫秒
+ * @param task      [in]任务
+ */
+void TimingWheel::add(uint64_t expire_ms, DelayTask::Ptr task) {
+    Node *node = allocNode();
+    node->expire = expire_ms;
+    node->task = std::move(task);
+    node->next = nullptr;
+    addNode(node);
+    ++_size;
+}
+
+void TimingWheel::addNode(Node *node) {
+    if (node->expire < _jiffies) {
+        //已经过期的任务放到下一个要处理的槽
+        node->expire = _jiffies;
+    }
+
+    uint64_t idx = node->expire - _jiffies;
+    Slot *slot = nullptr;
+    if (idx < 256) {
+        uint32_t i = node->expire & 255;
+        slot = &_slot0[i];
+        _bitmap0[i >> 6] |= 1ULL << (i & 63);
+    } else {
+        int level = 1;
+        while (level < kLevels - 1 && idx >= (1ULL << LEVEL_SHIFT(level + 1))) {
+            ++level;
+        }
+        if (idx >= (1ULL << 32)) {
+            //超出最大延时
+            node->expire = _jiffies + (1ULL << 32) - 1;
+        }
+        uint32_t i = (node->expire >> LEVEL_SHIFT(level)) & 63;
+        slot = &_slots[level - 1][i];
+        _bitmap[level - 1] |= 1ULL << i;
+    }
+
+    //同一个槽内保持插入顺序
+    if (slot->tail) {
+        slot->tail->next = node;
+    } else {
+        slot->head = node;
+    }
+    slot->tail = node;
+}
+
+TimingWheel::Node *TimingWheel::detach(int level, uint32_t index) {
+    Slot *slot = nullptr;
+    if (level == 0) {
+        slot = &_slot0[index];
+        _bitmap0[index >> 6] &= ~(1ULL << (index & 63));
+    } else {
+        slot = &_slots[level - 1][index];
+        _bitmap[level - 1] &= ~(1ULL << index);
+    }
+    Node *list = slot->head;
+    slot->head = slot->tail = nullptr;
+    return list;
+}
+
+void TimingWheel::cascade(int level, uint32_t index) {
+    //高层槽内的任务重新分配到低层
+    Node *node = detach(level, index);
+    while (node) {
+        Node *next = node->next;
+        node->next = nullptr;
+        addNode(node);
+        node = next;
+    }
+}
+
+void TimingWheel::runSlot(Node *node, uint64_t now_ms, uint64_t now_us) {
+    while (node) {
+        Node *next = node->next;
+        uint64_t deadline_us = node->expire * 1000;
+        _lateness.record(now_us > deadline_us ? now_us - deadline_us : 0);
+        DelayTask::Ptr task = std::move(node->task);
+        freeNode(node);
+        --_size;
+        node = next;
+
+        try {
+            auto next_delay = (*task)();
+            if (next_delay) {
+                //可重复任务,更新时间截止线
+                add(now_ms + next_delay, std::move(task));
+            }
+        } catch (std::exception &ex) {
+            ErrorL << "Exception occurred when do delay task: " << ex.what();
+        }
+    }
+}
+
+/**
+ * @brief 通知有任务被取消，已取消的任务超过一半时回收它们的节点，避免空转唤醒和占用内存
+ */
+void TimingWheel::onCancel() {
+    //每次回收的节点数不少于剩余任务数，回收开销均摊到每次取消是O(1)
+    if (++_canceled * 2 > _size) {
+        compact();
+    }
+}
+
+void TimingWheel::compact() {
+    for (uint32_t w = 0; w < 4; ++w) {
+        for (uint64_t bits = _bitmap0[w]; bits; bits &= bits - 1) {
+            uint32_t i = (w << 6) + __builtin_ctzll(bits);
+            if (compactSlot(_slot0[i])) {
+                _bitmap0[w] &= ~(1ULL << (i & 63));
+            }
+        }
+    }
+    for (int level = 1; level < kLevels; ++level) {
+        for (uint64_t bits = _bitmap[level - 1]; bits; bits &= bits - 1) {
+            uint32_t i = __builtin_ctzll(bits);
+            if (compactSlot(_slots[level - 1][i])) {
+                _bitmap[level - 1] &= ~(1ULL << i);
+            }
+        }
+    }
+    _canceled = 0;
+}
+
+/**
+ * @brief 回收槽内已取消的任务，保持其余任务的顺序
+ *
+ * @return bool 槽是否变为空
+ */
+bool TimingWheel::compactSlot(Slot &slot) {
+    Node *head = nullptr;
+    Node *tail = nullptr;
+    for (Node *node = slot.head; node;) {
+        Node *next = node->next;
+        if (*node->task) {
+            node->next = nullptr;
+            if (tail) {
+                tail->next = node;
+            } else {
+                head = node;
+            }
+            tail = node;
+        } else {
+            freeNode(node);
+            --_size;
+        }
+        node = next;
+    }
+    slot.head = head;
+    slot.tail = tail;
+    return head == nullptr;
+}
+
+/**
+ * @brief 推进时间轮，执行所有已到期的任务，可重复任务按返回值重新加入
+ *
+ * @param now_ms [in]当前时间，毫秒
+ */
+void TimingWheel::advance(uint64_t now_ms) {
+    //和getCurrentMillisecond同一时间基准，用于统计到期延时
+    uint64_t now_us = getCurrentMicrosecond();
+    while (_jiffies <= now_ms) {
+        if (_size == 0) {
+            _jiffies = now_ms + 1;
+            break;
+        }
+
+        uint32_t index = _jiffies & 255;
+        if (index == 0) {
+            //第0层转完一圈，依次把高层当前槽降级
+            for (int level = 1; level < kLevels; ++level) {
+                uint32_t i = (_jiffies >> LEVEL_SHIFT(level)) & 63;
+                cascade(level, i);
+                if (i != 0) {
+                    break;
+                }
+            }
+        }
+
+        Node *list = detach(0, index);
+        ++_jiffies;
+        runSlot(list, now_ms, now_us);
+
+        //第0层剩余槽都为空时，直接跳到下一圈或当前时间
+        index = _jiffies & 255;
+        if (index != 0) {
+            bool empty = (_bitmap0[index >> 6] >> (index & 63)) == 0;
+            for (uint32_t w = (index >> 6) + 1; empty && w < 4; ++w) {
+                empty = _bitmap0[w] == 0;
+            }
+            if (empty) {
+                uint64_t boundary = (_jiffies | 255) + 1;
+                _jiffies = boundary < now_ms + 1 ? boundary : now_ms + 1;
+            }
+        }
+    }
+}
+
+/**
+ * @brief 获取最近一个任务到期时间的下限，高层的任务按其降级时间计算，可能早于实际到期时间
+ *
+ * @return uint64_t 到期时间，毫秒；没有任务时返回UINT64_MAX
+ */
+uint64_t TimingWheel::nextExpire() const {
+    if (_size == 0) {
+        return UINT64_MAX;
+    }
+
+    uint64_t ret = UINT64_MAX;
+
+    //第0层的任务都在[_jiffies, _jiffies + 255]内，从当前槽开始循环查找
+    uint32_t index = _jiffies & 255;
+    for (uint32_t n = 0; n <= 4; ++n) {
+        uint32_t w = ((index >> 6) + n) & 3;
+        uint64_t bits = _bitmap0[w];
+        if (n == 0) {
+            bits &= ~0ULL << (index & 63);
+        } else if (n == 4) {
+            bits &= (index & 63) ? ~(~0ULL << (index & 63)) : 0;
+        }
+        if (bits) {
+            uint32_t pos = (w << 6) + __builtin_ctzll(bits);
+            ret = _jiffies + ((pos - index) & 255);
+            break;
+        }
+    }
+
+    //高层的任务最早在其所在槽降级时到期
+    for (int level = 1; level < kLevels; ++level) {
+        uint64_t bits = _bitmap[level - 1];
+        if (!bits) {
+            continue;
+        }
+        uint64_t mask = (1ULL << LEVEL_SHIFT(level)) - 1;
+        uint64_t boundary = (_jiffies + mask) & ~mask;
+        uint32_t c = (boundary >> LEVEL_SHIFT(level)) & 63;
+        uint64_t rotated = c ? ((bits >> c) | (bits << (64 - c))) : bits;
+        uint64_t expire = boundary + ((uint64_t)__builtin_ctzll(rotated) << LEVEL_SHIFT(level));
+        if (expire < ret) {
+            ret = expire;
+        }
+    }
+    return ret;
+}
+
+} //namespace chw
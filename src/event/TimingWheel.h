@@ -0,0 +1,106 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __TIMING_WHEEL_H
+#define __TIMING_WHEEL_H
+
+#include <stdint.h>
+#include "PipeWrap.h"
+#include "LatencyHistogram.h"
+
+namespace chw {
+
+/**
+ * 分层时间轮，精度1毫秒，用于EventLoop的延时任务。
+ * 第0层256个槽，第1~4层各64个槽，最大延时2^32毫秒。
+ * 插入和到期执行都是O(1)，任务取消通过TaskCancelableImp::cancel完成，到期时跳过，
+ * 已取消的任务超过一半时从槽中回收。
+ * 只能在EventLoop线程使用。
+ */
+class TimingWheel : public noncopyable {
+public:
+    using DelayTask = TaskCancelableImp<uint64_t(void)>;
+
+    /**
+     * @brief 构造时间轮
+     *
+     * @param now_ms [in]当前时间，毫秒
+     */
+    explicit TimingWheel(uint64_t now_ms);
+    ~TimingWheel();
+
+    /**
+     * @brief 添加延时任务
+     *
+     * @param expire_ms [in]到期时间，毫秒
+     * @param task      [in]任务
+     */
+    void add(uint64_t expire_ms, DelayTask::Ptr task);
+
+    /**
+     * @brief 推进时间轮，执行所有已到期的任务，可重复任务按返回值重新加入
+     *
+     * @param now_ms [in]当前时间，毫秒
+     */
+    void advance(uint64_t now_ms);
+
+    /**
+     * @brief 获取最近一个任务到期时间的下限，高层的任务按其降级时间计算，可能早于实际到期时间
+     *
+     * @return uint64_t 到期时间，毫秒；没有任务时返回UINT64_MAX
+     */
+    uint64_t nextExpire() const;
+
+    /**
+     * @brief 是否没有任务
+     */
+    bool empty() const { return _size == 0; }
+
+    /**
+     * @brief 通知有任务被取消，已取消的任务超过一半时回收它们的节点，避免空转唤醒和占用内存
+     */
+    void onCancel();
+
+    /**
+     * @brief 获取任务从到期到执行的延时分布，微秒
+     */
+    const LatencyHistogram &lateness() const { return _lateness; }
+
+private:
+    struct Node {
+        uint64_t expire;
+        DelayTask::Ptr task;
+        Node *next;
+    };
+
+    struct Slot {
+        Node *head = nullptr;
+        Node *tail = nullptr;
+    };
+
+    void addNode(Node *node);
+    void cascade(int level, uint32_t index);
+    Node *detach(int level, uint32_t index);
+    void runSlot(Node *list, uint64_t now_ms, uint64_t now_us);
+    void compact();
+    bool compactSlot(Slot &slot);
+    Node *allocNode();
+    void freeNode(Node *node);
+
+private:
+    static const int kLevels = 5;
+
+    uint64_t _jiffies;// 下一个要处理的时刻，早于它的任务都已执行
+    size_t _size = 0;// 任务数量，包括尚未回收的已取消任务
+    size_t _canceled = 0;// 上次回收后被取消的任务数，可能包含不在时间轮中的任务
+    Slot _slot0[256];
+    Slot _slots[kLevels - 1][64];
+    uint64_t _bitmap0[4] = {0};// 第0层非空槽位图
+    uint64_t _bitmap[kLevels - 1] = {0};// 第1~4层非空槽位图
+    Node *_free_list = nullptr;// 回收的节点，避免每次插入都分配内存
+    LatencyHistogram _lateness;// 到期到执行的延时
+};
+
+} //namespace chw
+
+#endif //__TIMING_WHEEL_H
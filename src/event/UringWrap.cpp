@@ -0,0 +1,280 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#include "UringWrap.h"
+
+#if defined(HAS_IO_URING)
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include "Logger.h"
+#include "uv_errno.h"
+#include "SocketBase.h"
+
+namespace chw {
+
+#define uring_load_acquire(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define uring_store_release(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+UringWrap::~UringWrap() {
+    release();
+}
+
+void UringWrap::release() {
+    if (_sqes) {
+        munmap(_sqes, _sqes_size);
+        _sqes = nullptr;
+    }
+    if (_cq_ring && _cq_ring != _sq_ring) {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+    _cq_ring = nullptr;
+    if (_sq_ring) {
+        munmap(_sq_ring, _sq_ring_size);
+        _sq_ring = nullptr;
+    }
+    if (_ring_fd != -1) {
+        close(_ring_fd);
+        _ring_fd = -1;
+    }
+}
+
+/**
+ * @brief 创建io_uring，内核不支持时返回false
+ *
+ * @param entries [in]提交队列长度
+ * @return bool 是否成功
+ */
+bool UringWrap::init(uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (_ring_fd == -1) {
+        WarnL << "io_uring_setup failed: " << get_uv_errmsg();
+        return false;
+    }
+
+    // 需要IORING_FEAT_EXT_ARG(5.11)实现带超时的等待
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        WarnL << "io_uring not support IORING_FEAT_EXT_ARG, kernel is too old";
+        release();
+        return false;
+    }
+
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+    }
+
+    _sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED) {
+        _sq_ring = nullptr;
+        WarnL << "mmap io_uring sq ring failed: " << get_uv_errmsg();
+        release();
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        _cq_ring = _sq_ring;
+    } else {
+        _cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        if (_cq_ring == MAP_FAILED) {
+            _cq_ring = nullptr;
+            WarnL << "mmap io_uring cq ring failed: " << get_uv_errmsg();
+            release();
+            return false;
+        }
+    }
+
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = (struct io_uring_sqe *)mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    if (_sqes == MAP_FAILED) {
+        _sqes = nullptr;
+        WarnL << "mmap io_uring sqes failed: " << get_uv_errmsg();
+        release();
+        return false;
+    }
+
+    char *sq = (char *)_sq_ring;
+    _sq_head = (uint32_t *)(sq + params.sq_off.head);
+    _sq_tail = (uint32_t *)(sq + params.sq_off.tail);
+    _sq_mask = (uint32_t *)(sq + params.sq_off.ring_mask);
+    _sq_entries = (uint32_t *)(sq + params.sq_off.ring_entries);
+    _sq_array = (uint32_t *)(sq + params.sq_off.array);
+    _sq_local_tail = *_sq_tail;
+
+    char *cq = (char *)_cq_ring;
+    _cq_head = (uint32_t *)(cq + params.cq_off.head);
+    _cq_tail = (uint32_t *)(cq + params.cq_off.tail);
+    _cq_mask = (uint32_t *)(cq + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    SockUtil::setCloExec(_ring_fd);
+
+    // IORING_FEAT_EXT_ARG(5.11)早于multishot poll(5.13)，两者之间的内核只能使用oneshot poll
+    _multishot_poll = probeMultishotPoll();
+    if (!_multishot_poll) {
+        WarnL << "io_uring not support multishot poll, use oneshot poll instead";
+    }
+    return true;
+}
+
+/**
+ * @brief 在一个可读的eventfd上提交multishot poll，检测内核是否支持
+ *
+ * @return bool 是否支持
+ */
+bool UringWrap::probeMultishotPoll() {
+    int efd = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (efd == -1) {
+        return false;
+    }
+
+    // user_data为0的完成项EventLoop直接忽略
+    struct io_uring_sqe *sqe = getSqe();
+    if (!sqe) {
+        close(efd);
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = efd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = 0;
+
+    bool multishot = false;
+    struct io_uring_cqe cqe;
+    if (submitAndWait(1000) >= 0 && peekCqes(&cqe, 1) == 1) {
+        // 不支持时返回-EINVAL
+        multishot = cqe.res >= 0 && (cqe.flags & IORING_CQE_F_MORE);
+    }
+
+    if (multishot) {
+        // 取消仍在监听的poll请求，等待其结束后再关闭eventfd
+        sqe = getSqe();
+        if (sqe) {
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = 0;
+            sqe->user_data = 0;
+            // 取消请求和被取消的poll各有一个完成项
+            for (int i = 0; i < 2; ++i) {
+                if (!hasCqe() && submitAndWait(100) < 0) {
+                    break;
+                }
+                peekCqes(&cqe, 1);
+            }
+        }
+    }
+    while (peekCqes(&cqe, 1) == 1) {
+    }
+    close(efd);
+    return multishot;
+}
+
+int UringWrap::enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t argsz) {
+    return (int)syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/**
+ * @brief 获取一个空闲的提交项，提交队列满时先提交已有的提交项
+ *
+ * @return struct io_uring_sqe* 已清零的提交项，失败返回nullptr
+ */
+struct io_uring_sqe *UringWrap::getSqe() {
+    if (_sq_local_tail - uring_load_acquire(_sq_head) >= *_sq_entries) {
+        // 提交队列已满，先提交给内核
+        if (submit() <= 0 || _sq_local_tail - uring_load_acquire(_sq_head) >= *_sq_entries) {
+            return nullptr;
+        }
+    }
+
+    uint32_t index = _sq_local_tail & *_sq_mask;
+    _sq_array[index] = index;
+    ++_sq_local_tail;
+
+    struct io_uring_sqe *sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/**
+ * @brief 只提交不等待
+ *
+ * @return int 成功返回提交的数量，失败返回-1
+ */
+int UringWrap::submit() {
+    uring_store_release(_sq_tail, _sq_local_tail);
+    uint32_t to_submit = _sq_local_tail - uring_load_acquire(_sq_head);
+    if (to_submit == 0) {
+        return 0;
+    }
+    int ret = enter(to_submit, 0, 0, nullptr, 0);
+    if (ret == -1 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+        return 0;
+    }
+    return ret;
+}
+
+/**
+ * @brief 提交所有提交项，并等待至少一个完成项或超时
+ *
+ * @param timeout_ms [in]超时毫秒数，0表示一直等待
+ * @return int 成功返回提交的数量，失败返回-1
+ */
+int UringWrap::submitAndWait(uint64_t timeout_ms) {
+    uring_store_release(_sq_tail, _sq_local_tail);
+    uint32_t to_submit = _sq_local_tail - uring_load_acquire(_sq_head);
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    int ret = enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (ret == -1 && (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY)) {
+        // 超时或被打断，不是错误
+        return 0;
+    }
+    return ret;
+}
+
+/**
+ * @brief 批量读取完成项
+ *
+ * @param cqes [out]完成项拷贝
+ * @param count [in]最多读取数量
+ * @return uint32_t 读取到的数量
+ */
+uint32_t UringWrap::peekCqes(struct io_uring_cqe *cqes, uint32_t count) {
+    uint32_t head = *_cq_head;
+    uint32_t tail = uring_load_acquire(_cq_tail);
+    uint32_t n = 0;
+    while (head != tail && n < count) {
+        cqes[n++] = _cqes[head & *_cq_mask];
+        ++head;
+    }
+    // 拷贝出来后立即归还完成项，回调中提交新的请求不会受完成队列长度影响
+    uring_store_release(_cq_head, head);
+    return n;
+}
+
+/**
+ * @brief 是否有未读取的完成项
+ */
+bool UringWrap::hasCqe() const {
+    return *_cq_head != uring_load_acquire(_cq_tail);
+}
+
+} //namespace chw
+
+#endif //HAS_IO_URING
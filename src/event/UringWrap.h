@@ -0,0 +1,115 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __URING_WRAP_H
+#define __URING_WRAP_H
+
+#if defined(__linux__) || defined(__linux)
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAS_IO_URING
+#endif
+#endif
+#endif //__linux__
+
+#if defined(HAS_IO_URING)
+#include <stdint.h>
+#include <linux/io_uring.h>
+#include "util.h"
+
+namespace chw {
+
+/**
+ * io_uring的最小封装，直接使用系统调用，不依赖liburing。
+ * 只在EventLoop线程使用，提交队列在休眠等待时统一提交，完成队列批量收割。
+ */
+class UringWrap : public noncopyable {
+public:
+    UringWrap() = default;
+    ~UringWrap();
+
+    /**
+     * @brief 创建io_uring，内核不支持时返回false
+     *
+     * @param entries [in]提交队列长度
+     * @return bool 是否成功
+     */
+    bool init(uint32_t entries);
+
+    /**
+     * @brief 获取一个空闲的提交项，提交队列满时先提交已有的提交项
+     *
+     * @return struct io_uring_sqe* 已清零的提交项，失败返回nullptr
+     */
+    struct io_uring_sqe *getSqe();
+
+    /**
+     * @brief 提交所有提交项，并等待至少一个完成项或超时
+     *
+     * @param timeout_ms [in]超时毫秒数，0表示一直等待
+     * @return int 成功返回提交的数量，失败返回-1
+     */
+    int submitAndWait(uint64_t timeout_ms);
+
+    /**
+     * @brief 只提交不等待
+     *
+     * @return int 成功返回提交的数量，失败返回-1
+     */
+    int submit();
+
+    /**
+     * @brief 批量读取完成项
+     *
+     * @param cqes [out]完成项拷贝
+     * @param count [in]最多读取数量
+     * @return uint32_t 读取到的数量
+     */
+    uint32_t peekCqes(struct io_uring_cqe *cqes, uint32_t count);
+
+    /**
+     * @brief 是否有未读取的完成项
+     */
+    bool hasCqe() const;
+
+    bool valid() const { return _ring_fd != -1; }
+
+    /**
+     * @brief 是否支持multishot poll(IORING_POLL_ADD_MULTI, 5.13)，不支持时每次完成后需重新提交poll
+     */
+    bool multishotPoll() const { return _multishot_poll; }
+
+private:
+    int enter(uint32_t to_submit, uint32_t min_complete, uint32_t flags, void *arg, size_t argsz);
+    void release();
+    bool probeMultishotPoll();
+
+private:
+    int _ring_fd = -1;
+
+    // 提交队列
+    void *_sq_ring = nullptr;
+    size_t _sq_ring_size = 0;
+    uint32_t *_sq_head = nullptr;
+    uint32_t *_sq_tail = nullptr;
+    uint32_t *_sq_mask = nullptr;
+    uint32_t *_sq_entries = nullptr;
+    uint32_t *_sq_array = nullptr;
+    struct io_uring_sqe *_sqes = nullptr;
+    size_t _sqes_size = 0;
+    uint32_t _sq_local_tail = 0;// 本地队尾，提交时同步给内核
+    bool _multishot_poll = false;
+
+    // 完成队列
+    void *_cq_ring = nullptr;
+    size_t _cq_ring_size = 0;
+    uint32_t *_cq_head = nullptr;
+    uint32_t *_cq_tail = nullptr;
+    uint32_t *_cq_mask = nullptr;
+    struct io_uring_cqe *_cqes = nullptr;
+};
+
+} //namespace chw
+
+#endif //HAS_IO_URING
+#endif //__URING_WRAP_H
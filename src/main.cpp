@@ -18,6 +18,7 @@
 #include "FileModel.h"
 #include "util.h"
 #include "config.h"
+#include "EventLoopPool.h"
 #if defined(__linux__) || defined(__linux)
 #include "RawTextModel.h"
 #include "RawPressModel.h"
@@ -103,6 +104,27 @@ int main(int argc, char **argv)
         chw::Logger::Instance().add(fc);
     }
     chw::Logger::Instance().setWriter(std::make_shared<chw::AsyncLogWriter>());
+
+    // 在创建任何EventLoop之前选择轮询方式
+    chw::EventLoop::setUseUring(chw::gConfigCmd.io_uring);
+    chw::EventLoop::setBusyPoll(chw::gConfigCmd.busy_poll);
+    if(chw::gConfigCmd.sock_busy_poll)
+    {
+        chw::Socket::setBusyPoll(chw::gConfigCmd.busy_poll ? chw::gConfigCmd.busy_poll : SOCK_BUSY_POLL_DEFAULT);
+    }
+    chw::Socket::setReadBudget(chw::gConfigCmd.read_budget, chw::gConfigCmd.read_budget_bytes);
+    chw::Socket::setRecvBatch(chw::gConfigCmd.recv_batch);
+    // 只有压测会话按Buffer::SegSize拆分合并包
+    chw::Socket::setUdpGro(chw::gConfigCmd.gro && chw::gConfigCmd.workmodel == chw::PRESS_MODEL && chw::gConfigCmd.role == 's');
+    chw::Socket::setTimestamping(chw::gConfigCmd.timestamp && chw::gConfigCmd.workmodel == chw::PRESS_MODEL);
+
+    // 启动EventLoop线程池
+    if(chw::gConfigCmd.threads > 0)
+    {
+        chw::EventLoopPool::setPoolSize(chw::gConfigCmd.threads);
+        chw::EventLoopPool::setBalance(chw::gConfigCmd.least_loaded ? chw::EventLoopPool::BALANCE_LEAST_LOADED : chw::EventLoopPool::BALANCE_ROUND_ROBIN);
+        chw::EventLoopPool::Instance();
+    }
     
     switch (chw::gConfigCmd.workmodel)
     {
@@ -5,12 +5,17 @@
 #define __BUFFER_H
 
 #include <memory>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <functional>
 #include "MemoryHandle.h"
 #include "Logger.h"
 
 namespace chw {
 #define RAW_BUFFER_SIZE     2 * 1024
 #define TCP_BUFFER_SIZE     128 * 1024
+#define UDP_GRO_BUFFER_SIZE 64 * 1024    //UDP GRO合并包最大长度
 #define MAX_BUFFER_SIZE     16<<20       //buf最大大小,16MB
 
 /**
@@ -28,6 +33,9 @@ public:
         _data = nullptr;
         _capacity = 0;
         _size = 0;
+        _seg_size = 0;
+        _stamp_sw = 0;
+        _stamp_hw = 0;
         _isNeedFree = true;
     }
 
@@ -43,6 +51,9 @@ public:
         _data = buf;
         _capacity = capacity;
         _size = size;
+        _seg_size = 0;
+        _stamp_sw = 0;
+        _stamp_hw = 0;
         _isNeedFree = isNeedFree;
     }
 
@@ -69,6 +80,8 @@ public:
             return chw::success;
         }
 
+        // 容量取整到内存池分级大小，分级内继续扩容不用重新分配
+        size = _RAM_FIT_(size);
         void* buffer = nullptr;
         try {
             buffer = _RAM_NEW_(size);
@@ -78,7 +91,8 @@ public:
         }
 
         if(_data != nullptr) {
-            _RAM_CPY_(buffer,size,_data,_capacity);
+            // 只需保留有效数据
+            _RAM_CPY_(buffer,size,_data,_size);
             _RAM_DEL_(_data);
             _data = nullptr;
             _capacity = 0;
@@ -172,6 +186,32 @@ public:
         return _size;
     }
 
+    // 设置UDP GRO合并包中每个udp包的长度，0表示不是合并包
+    void SetSegSize(size_t size) {
+        _seg_size = size;
+    }
+
+    // 返回UDP GRO合并包中每个udp包的长度，最后一个包可以更短，0表示不是合并包
+    size_t SegSize() {
+        return _seg_size;
+    }
+
+    // 设置接收时间戳(SO_TIMESTAMPING)，CLOCK_REALTIME纳秒，0表示没有
+    void SetStamp(uint64_t sw_ns, uint64_t hw_ns) {
+        _stamp_sw = sw_ns;
+        _stamp_hw = hw_ns;
+    }
+
+    // 返回内核软件接收时间戳，纳秒，0表示没有
+    uint64_t StampSw() {
+        return _stamp_sw;
+    }
+
+    // 返回网卡硬件接收时间戳，纳秒，0表示没有
+    uint64_t StampHw() {
+        return _stamp_hw;
+    }
+
     void Reset() {
         _size = 0;
     }
@@ -181,12 +221,85 @@ public:
         _size = 0;
     }
 
+    /**
+     * @brief 取走内存和数据，返回持有原内存的新Buffer，本对象变为容量为0的空缓存
+     * 数据生产者(如Socket读缓存)发现容量为0时需要重新SetCapacity
+     * 
+     * @return std::shared_ptr<Buffer> 持有原内存的Buffer
+     */
+    std::shared_ptr<Buffer> Detach() {
+        auto ret = std::make_shared<Buffer>((char*)_data, _capacity, _size, _isNeedFree);
+        ret->_seg_size = _seg_size;
+        ret->_stamp_sw = _stamp_sw;
+        ret->_stamp_hw = _stamp_hw;
+        _data = nullptr;
+        _capacity = 0;
+        _size = 0;
+        _seg_size = 0;
+        _stamp_sw = 0;
+        _stamp_hw = 0;
+        _isNeedFree = true;
+        return ret;
+    }
+
 private:
     void* _data;//堆空间
     size_t _capacity;//堆空间总大小
     size_t _size;//有效数据大小
+    size_t _seg_size;//UDP GRO合并包中每个udp包的长度
+    uint64_t _stamp_sw;//内核软件接收时间戳
+    uint64_t _stamp_hw;//网卡硬件接收时间戳
     bool _isNeedFree;//析构时是否需要释放_data
 };
 
+/**
+ * 发送缓存环，用于tcp零拷贝发送(Socket::send_z)
+ * Socket在内核发送完成前持有Buffer，只剩本对象引用时才能复用
+ */
+class BufferRing {
+public:
+    /**
+     * @brief 分配count个容量为size的Buffer
+     * 
+     * @param count [in]Buffer个数
+     * @param size  [in]每个Buffer的容量
+     * @return uint32_t 成功返回chw::success，失败返回chw::fail
+     */
+    uint32_t Init(uint32_t count, size_t size) {
+        _bufs.clear();
+        _index = 0;
+        for(uint32_t i = 0; i < count; i++) {
+            auto buf = std::make_shared<Buffer>();
+            if(buf->SetCapacity(size) == chw::fail) {
+                return chw::fail;
+            }
+            _bufs.emplace_back(std::move(buf));
+        }
+        return _bufs.empty() ? chw::fail : chw::success;
+    }
+
+    /**
+     * @brief 获取下一个可复用的Buffer，仍被Socket持有时等待内核完成通知
+     * 
+     * @param stop [in]等待期间返回true则放弃等待
+     * @return Buffer::Ptr 可复用的Buffer，放弃等待时返回nullptr
+     */
+    Buffer::Ptr Next(const std::function<bool()> &stop = nullptr) {
+        auto &buf = _bufs[_index];
+        while(buf.use_count() > 1) {
+            if(stop && stop()) {
+                return nullptr;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        _index = (_index + 1) % _bufs.size();
+        return buf;
+    }
+
+private:
+    std::vector<Buffer::Ptr> _bufs;
+    size_t _index = 0;
+};
+
 }//namespace chw
 #endif //__BUFFER_H
@@ -0,0 +1,212 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __BUFFER_CHAIN_H
+#define __BUFFER_CHAIN_H
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include "Buffer.h"
+
+namespace chw {
+
+/**
+ * Buffer中的一段数据，持有Buffer引用
+ */
+struct BufferSlice {
+    Buffer::Ptr buf;
+    size_t offset = 0;
+    size_t len = 0;
+
+    char* data() const {
+        return (char*)buf->data() + offset;
+    }
+};
+
+/**
+ * 跨多个Buffer的连续数据视图，不拷贝数据
+ */
+class BufferView {
+public:
+    // 数据总长度
+    size_t Size() const {
+        return _size;
+    }
+
+    // 分段数量
+    size_t Count() const {
+        return _slices.size();
+    }
+
+    const BufferSlice &operator[](size_t i) const {
+        return _slices[i];
+    }
+
+    /**
+     * @brief 数据在一个分段内时返回数据指针，跨分段时返回nullptr
+     */
+    char* Contiguous() const {
+        return _slices.size() == 1 ? _slices[0].data() : nullptr;
+    }
+
+    /**
+     * @brief 拷贝从offset开始的len字节，用于读取跨分段的消息头
+     *
+     * @param offset [in]起始位置
+     * @param dst    [out]目的内存
+     * @param len    [in]长度
+     * @return size_t 拷贝的长度
+     */
+    size_t Copy(size_t offset, void* dst, size_t len) const {
+        size_t copied = 0;
+        for (auto &slice : _slices) {
+            if (copied == len) {
+                break;
+            }
+            if (offset >= slice.len) {
+                offset -= slice.len;
+                continue;
+            }
+            size_t n = std::min(slice.len - offset, len - copied);
+            _RAM_CPY_((char*)dst + copied, len - copied, slice.data() + offset, n);
+            copied += n;
+            offset = 0;
+        }
+        return copied;
+    }
+
+    void Clear() {
+        _slices.clear();
+        _size = 0;
+    }
+
+private:
+    friend class BufferChain;
+    std::vector<BufferSlice> _slices;
+    size_t _size = 0;
+};
+
+/**
+ * 分段缓存链，tcp粘包处理时接收的Buffer直接挂到链上，不搬移半包、不为大包重新分配内存。
+ * 只在poller线程使用。
+ */
+class BufferChain {
+public:
+    /**
+     * @brief 把buf中[offset, offset+len)的数据挂到链尾
+     *
+     * @param buf    [in]缓存，链持有其引用直到数据被取走
+     * @param offset [in]起始位置
+     * @param len    [in]长度
+     */
+    void Append(const Buffer::Ptr &buf, size_t offset, size_t len) {
+        if (len == 0) {
+            return;
+        }
+        BufferSlice slice;
+        slice.buf = buf;
+        slice.offset = offset;
+        slice.len = len;
+        _slices.emplace_back(std::move(slice));
+        _size += len;
+    }
+
+    // 数据总长度
+    size_t Size() const {
+        return _size;
+    }
+
+    bool Empty() const {
+        return _size == 0;
+    }
+
+    /**
+     * @brief 拷贝链首的len字节，不取走，用于读取消息头
+     *
+     * @param dst [out]目的内存
+     * @param len [in]长度
+     * @return size_t 拷贝的长度
+     */
+    size_t Peek(void* dst, size_t len) const {
+        size_t copied = 0;
+        for (auto it = _slices.begin(); it != _slices.end() && copied < len; ++it) {
+            size_t n = std::min(it->len, len - copied);
+            _RAM_CPY_((char*)dst + copied, len - copied, it->data(), n);
+            copied += n;
+        }
+        return copied;
+    }
+
+    /**
+     * @brief 链首len字节的数据指针，数据跨分段时返回nullptr
+     */
+    char* Front(size_t len) const {
+        if (_slices.empty() || _slices.front().len < len) {
+            return nullptr;
+        }
+        return _slices.front().data();
+    }
+
+    /**
+     * @brief 取走链首len字节，返回不拷贝数据的视图，视图在下次Take前有效
+     *
+     * @param len [in]长度，不能超过Size()
+     * @return const BufferView& 视图
+     */
+    const BufferView &Take(size_t len) {
+        _view.Clear();
+        while (len > 0 && !_slices.empty()) {
+            auto &front = _slices.front();
+            size_t n = std::min(front.len, len);
+            BufferSlice slice;
+            slice.buf = front.buf;
+            slice.offset = front.offset;
+            slice.len = n;
+            _view._slices.emplace_back(std::move(slice));
+            _view._size += n;
+            len -= n;
+            _size -= n;
+            if (n == front.len) {
+                _slices.pop_front();
+            } else {
+                front.offset += n;
+                front.len -= n;
+            }
+        }
+        return _view;
+    }
+
+    /**
+     * @brief 把buf中[offset, offset+len)包装成视图，不挂到链上，视图在下次Take/Wrap前有效
+     *
+     * @param buf    [in]缓存
+     * @param offset [in]起始位置
+     * @param len    [in]长度
+     * @return const BufferView& 视图
+     */
+    const BufferView &Wrap(const Buffer::Ptr &buf, size_t offset, size_t len) {
+        _view.Clear();
+        BufferSlice slice;
+        slice.buf = buf;
+        slice.offset = offset;
+        slice.len = len;
+        _view._slices.emplace_back(std::move(slice));
+        _view._size = len;
+        return _view;
+    }
+
+    void Clear() {
+        _slices.clear();
+        _view.Clear();
+        _size = 0;
+    }
+
+private:
+    std::deque<BufferSlice> _slices;
+    BufferView _view;// Take返回的视图，复用避免每条消息分配
+    size_t _size = 0;
+};
+
+}//namespace chw
+#endif //__BUFFER_CHAIN_H
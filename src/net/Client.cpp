@@ -3,6 +3,8 @@
 
 #include "Client.h"
 #include <atomic>
+#include "TimeTicker.h"
+#include "config.h"
 
 namespace chw {
 
@@ -45,6 +47,40 @@ const Socket::Ptr &Client::getSock() const
     return _socket;
 }
 
+/**
+ * @brief 等待socket可写，发送缓存满时阻塞到排队数据发完（发送线程执行，poller线程中调用直接返回）
+ * 
+ * @return bool 可写返回true，连接断开或等待超时返回false
+ */
+bool Client::waitWritable()
+{
+    if (!_socket || _poller->isCurrentThread()) {
+        // poller线程等待会导致可写事件无法处理，数据由Socket排队发送
+        return true;
+    }
+
+    Ticker ticker;
+    while (_socket->isSocketBusy()) {
+        if (!_socket->alive()) {
+            return false;
+        }
+        if (ticker.elapsedTime() > SEND_TIME_OUT_SEC * 1000) {
+            ErrorL << getIdentifier() << " wait writable timeout";
+            return false;
+        }
+        _sem_writable.waitFor(WAIT_WRITABLE_SLICE_MS);
+    }
+    return true;
+}
+
+/**
+ * @brief socket排队数据发完时的回调，唤醒waitWritable（poller线程执行）
+ */
+void Client::onFlushed()
+{
+    _sem_writable.post();
+}
+
 /**
  * @brief 发送数据（任意线程执行）
  * 
@@ -78,6 +114,84 @@ uint32_t Client::senddata_b(char* buff, uint32_t len)
     } 
 }
 
+/**
+ * @brief udp批量发送数据，攒够批量后一次sendmmsg发送（任意线程执行）
+ * 
+ * @param buff [in]数据
+ * @param len  [in]数据长度
+ * @return uint32_t 成功返回len，失败返回0
+ */
+uint32_t Client::senddata_m(char* buff, uint32_t len)
+{
+    if(_socket) {
+        return _socket->send_m(buff,len);
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * @brief 立即发送批量缓存中的数据（任意线程执行）
+ * 
+ * @return uint32_t 全部发出或放入发送队列返回chw::success，还有包留在批量缓存返回chw::fail
+ */
+uint32_t Client::flushdata_m()
+{
+    if(_socket) {
+        return _socket->flush_m();
+    } else {
+        PrintE("_socket==nullptr");
+        return chw::fail;
+    }
+}
+
+/**
+ * @brief udp GSO发送数据，buff中是首尾相连的等长udp包（任意线程执行）
+ * 
+ * @param buff      [in]数据
+ * @param len       [in]数据总长度
+ * @param seg_size  [in]每个udp包长度
+ * @return uint32_t 发送成功的数据长度
+ */
+uint32_t Client::senddata_g(char* buff, uint32_t len, uint32_t seg_size)
+{
+    if(_socket) {
+        return _socket->send_g(buff,len,seg_size);
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * @brief tcp零拷贝发送数据（任意线程执行）
+ * 
+ * @param buf [in]数据，内核发送完成前被Socket持有
+ * @return uint32_t 发送成功的数据长度
+ */
+uint32_t Client::senddata_z(const Buffer::Ptr &buf)
+{
+    if(_socket) {
+        return _socket->send_z(buf);
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * @brief 把数据放入Socket发送队列（任意线程执行）
+ * 
+ * @param buf [in]数据，发送完成前被Socket持有
+ * @return uint32_t 成功返回数据长度，失败返回0
+ */
+uint32_t Client::senddata_l(const Buffer::Ptr &buf)
+{
+    if(_socket) {
+        return _socket->send_l(buf);
+    } else {
+        return 0;
+    }
+}
+
 /**
  * @brief 使用网络地址发送数据，用于udp和raw
  * 
@@ -7,6 +7,7 @@
 #include <memory>
 #include <functional>
 #include "Socket.h"
+#include "Semaphore.h"
 
 namespace chw {
 
@@ -72,6 +73,48 @@ public:
      */
     uint32_t senddata_b(char* buff, uint32_t len);
 
+    /**
+     * @brief udp批量发送数据，攒够批量后一次sendmmsg发送（任意线程执行）
+     * 
+     * @param buff [in]数据
+     * @param len  [in]数据长度
+     * @return uint32_t 成功返回len，失败返回0
+     */
+    uint32_t senddata_m(char* buff, uint32_t len);
+
+    /**
+     * @brief 立即发送批量缓存中的数据（任意线程执行）
+     * 
+     * @return uint32_t 全部发出或放入发送队列返回chw::success，还有包留在批量缓存返回chw::fail
+     */
+    uint32_t flushdata_m();
+
+    /**
+     * @brief udp GSO发送数据，buff中是首尾相连的等长udp包（任意线程执行）
+     * 
+     * @param buff      [in]数据
+     * @param len       [in]数据总长度
+     * @param seg_size  [in]每个udp包长度
+     * @return uint32_t 发送成功的数据长度
+     */
+    uint32_t senddata_g(char* buff, uint32_t len, uint32_t seg_size);
+
+    /**
+     * @brief tcp零拷贝发送数据，内核发送完成后Socket才释放buf，buf.use_count()==1时可以复用（任意线程执行）
+     * 
+     * @param buf [in]数据
+     * @return uint32_t 发送成功的数据长度
+     */
+    uint32_t senddata_z(const Buffer::Ptr &buf);
+
+    /**
+     * @brief 把数据放入Socket发送队列，由poller线程批量发送，发送完成前buf被Socket持有（任意线程执行）
+     * 
+     * @param buf [in]数据
+     * @return uint32_t 成功返回数据长度，失败返回0
+     */
+    uint32_t senddata_l(const Buffer::Ptr &buf);
+
     /**
      * @brief 使用网络地址发送数据，用于udp和raw
      * 
@@ -83,9 +126,21 @@ public:
      */
     uint32_t send_addr(char* buff, uint32_t len, struct sockaddr* addr, int32_t socklen);
 
+    /**
+     * @brief 等待socket可写，发送缓存满时阻塞到排队数据发完（发送线程执行，poller线程中调用直接返回）
+     * 
+     * @return bool 可写返回true，连接断开或等待超时返回false
+     */
+    bool waitWritable();
+
     const Socket::Ptr &getSock() const;
 
 protected:
+    /**
+     * @brief socket排队数据发完时的回调，唤醒waitWritable（poller线程执行）
+     */
+    void onFlushed();
+
     /**
      * 派生类收到 eof 或其他导致脱离 Server 事件的回调
      * 收到该事件时, 该对象一般将立即被销毁
@@ -104,6 +159,7 @@ protected:
     Socket::Ptr _socket;// 客户端Socket
     EventLoop::Ptr _poller;// 绑定的事件循环
     onConCB _on_con;// 派生类tcp连接结果回调，或udp创建socket回调
+    Semaphore _sem_writable;// socket重新可写时通知发送线程
 };
 
 
@@ -0,0 +1,208 @@
+// Copyright (c) 2024 The nethello project authors. SPDX-License-Identifier: MIT.
+// This file is part of nethello(https://github.com/wichue/nethello).
+
+#ifndef __PEER_TABLE_H
+#define __PEER_TABLE_H
+
+#include <vector>
+#include <utility>
+#include <cstring>
+#include <stdint.h>
+
+namespace chw {
+
+/**
+ * udp对端地址，ipv4地址按ipv4映射的ipv6地址保存，按字节比较和哈希，不分配内存
+ */
+struct PeerKey {
+    uint8_t addr[16] = {0};
+    uint16_t port = 0;// 网络字节序
+
+    bool operator==(const PeerKey &other) const {
+        return port == other.port && memcmp(addr, other.addr, sizeof(addr)) == 0;
+    }
+
+    bool operator!=(const PeerKey &other) const {
+        return !(*this == other);
+    }
+
+    uint64_t hash() const {
+        uint64_t a, b;
+        memcpy(&a, addr, 8);
+        memcpy(&b, addr + 8, 8);
+        uint64_t h = (a ^ (b * 0x9e3779b97f4a7c15ULL)) + port;
+        // murmur3 fmix64
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
+/**
+ * 以PeerKey为键的开放寻址哈希表(线性探测)，所有元素保存在一块连续内存中，插入不为每个元素分配内存，
+ * 删除时后移补位，不留墓碑。不加锁，调用者保证互斥。
+ */
+template<typename V>
+class PeerTable {
+public:
+    explicit PeerTable(size_t capacity = 64) {
+        size_t cap = 8;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        _slots.resize(cap);
+        _mask = cap - 1;
+    }
+
+    /**
+     * @brief 查找
+     *
+     * @param key [in]对端地址
+     * @return V* 值，不存在返回nullptr，插入或删除后失效
+     */
+    V *find(const PeerKey &key) {
+        size_t i = indexOf(key, key.hash());
+        return i == npos ? nullptr : &_slots[i].value;
+    }
+
+    /**
+     * @brief 插入，已存在时不覆盖
+     *
+     * @param key   [in]对端地址
+     * @param value [in]值
+     * @return std::pair<V *, bool> 表中的值和是否新插入，插入或删除后失效
+     */
+    std::pair<V *, bool> emplace(const PeerKey &key, V value) {
+        uint64_t h = key.hash();
+        size_t i = indexOf(key, h);
+        if (i != npos) {
+            return std::make_pair(&_slots[i].value, false);
+        }
+        // 负载超过3/4时扩容
+        if ((_size + 1) * 4 > _slots.size() * 3) {
+            grow();
+        }
+        i = h & _mask;
+        while (_slots[i].used) {
+            i = (i + 1) & _mask;
+        }
+        auto &slot = _slots[i];
+        slot.used = true;
+        slot.hash = h;
+        slot.key = key;
+        slot.value = std::move(value);
+        ++_size;
+        return std::make_pair(&slot.value, true);
+    }
+
+    /**
+     * @brief 删除
+     *
+     * @param key [in]对端地址
+     * @return bool 是否存在
+     */
+    bool erase(const PeerKey &key) {
+        size_t i = indexOf(key, key.hash());
+        if (i == npos) {
+            return false;
+        }
+        // 后面同一探测链上的元素前移补位，保证查找遇到空槽即可停止
+        size_t j = i;
+        while (true) {
+            j = (j + 1) & _mask;
+            if (!_slots[j].used) {
+                break;
+            }
+            size_t home = _slots[j].hash & _mask;
+            // home在(i, j]之间时元素不能前移到i
+            bool stay = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+            if (!stay) {
+                _slots[i] = std::move(_slots[j]);
+                i = j;
+            }
+        }
+        _slots[i].used = false;
+        _slots[i].value = V();
+        --_size;
+        return true;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    void clear() {
+        for (auto &slot : _slots) {
+            slot.used = false;
+            slot.value = V();
+        }
+        _size = 0;
+    }
+
+    /**
+     * @brief 遍历，回调中不能插入或删除
+     *
+     * @param func [in]回调，参数为(const PeerKey &, V &)
+     */
+    template<typename FUNC>
+    void for_each(FUNC &&func) {
+        for (auto &slot : _slots) {
+            if (slot.used) {
+                func(slot.key, slot.value);
+            }
+        }
+    }
+
+private:
+    static const size_t npos = (size_t)-1;
+
+    struct Slot {
+        PeerKey key;
+        bool used = false;
+        uint64_t hash = 0;
+        V value;
+    };
+
+    size_t indexOf(const PeerKey &key, uint64_t h) const {
+        size_t i = h & _mask;
+        while (_slots[i].used) {
+            if (_slots[i].hash == h && _slots[i].key == key) {
+                return i;
+            }
+            i = (i + 1) & _mask;
+        }
+        return npos;
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(_slots);
+        _slots.resize(old.size() * 2);
+        _mask = _slots.size() - 1;
+        for (auto &slot : old) {
+            if (!slot.used) {
+                continue;
+            }
+            size_t i = slot.hash & _mask;
+            while (_slots[i].used) {
+                i = (i + 1) & _mask;
+            }
+            _slots[i] = std::move(slot);
+        }
+    }
+
+private:
+    std::vector<Slot> _slots;
+    size_t _mask = 0;
+    size_t _size = 0;
+};
+
+} //namespace chw
+#endif //__PEER_TABLE_H
@@ -53,4 +53,16 @@ Socket::Ptr Server::createSocket(const EventLoop::Ptr &poller)
     return _on_create_socket(poller);
 }
 
+void Server::keepStampStat(const Socket::StampStat &stat)
+{
+    std::lock_guard<std::mutex> lck(_stamp_mtx);
+    _closed_stamp += stat;
+}
+
+Socket::StampStat Server::closedStampStat()
+{
+    std::lock_guard<std::mutex> lck(_stamp_mtx);
+    return _closed_stamp;
+}
+
 }//namespace chw
\ No newline at end of file
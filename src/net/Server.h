@@ -5,6 +5,7 @@
 #define __SERVER_H
 
 #include <memory>
+#include <mutex>
 #include <functional>
 #include "Socket.h"
 #include "Session.h"
@@ -82,6 +83,22 @@ public:
      */
     virtual void GetRcvInfo(uint64_t& rcv_num,uint64_t& rcv_seq,uint64_t& rcv_len,uint64_t& rcv_speed) = 0;
 
+    /**
+     * @brief 汇总所有socket的收发时间戳统计(--timestamp)
+     * 
+     * @param stat [out]时间戳统计
+     */
+    virtual void GetStampStat(Socket::StampStat &stat) = 0;
+
+    /**
+     * @brief 采样并合并所有tcp会话的连接状态(TCP_INFO)
+     * 
+     * @param info     [out]各会话当前值之和
+     * @param interval [out]各会话与上次采样的差值之和
+     * @param conns    [out]采样成功的会话数量
+     */
+    virtual void GetTcpInfo(SockUtil::TcpInfo &info, SockUtil::TcpInfo &interval, uint32_t &conns) = 0;
+
 protected:
     /**
      * @brief 开始 server
@@ -104,10 +121,25 @@ protected:
      */
     Socket::Ptr createSocket(const EventLoop::Ptr &poller);
 
+protected:
+    /**
+     * @brief 会话移除前保存其socket的时间戳统计，GetStampStat汇总时加上（任意线程执行）
+     * 
+     * @param stat [in]时间戳统计
+     */
+    void keepStampStat(const Socket::StampStat &stat);
+
+    /**
+     * @brief 获取已移除会话的时间戳统计（任意线程执行）
+     */
+    Socket::StampStat closedStampStat();
+
 protected:
     Socket::Ptr _socket;// 服务端Socket
     EventLoop::Ptr _poller;// 绑定的事件循环
     std::function<Session::Ptr(const Socket::Ptr &)> _session_alloc;// 会话分配回调
+    std::mutex _stamp_mtx;// 会话可能在线程池的其他poller关闭
+    Socket::StampStat _closed_stamp;// 已移除会话的时间戳统计
 };
 
 } // namespace chw
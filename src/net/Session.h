@@ -47,6 +47,15 @@ public:
     virtual uint64_t GetSeq() = 0;
     virtual uint64_t GetRcvLen() = 0;
 
+    /**
+     * @brief 采样tcp连接状态(TCP_INFO)，默认不采样
+     * 
+     * @param info     [out]当前值
+     * @param interval [out]与上次采样的差值
+     * @return bool 是否采样成功
+     */
+    virtual bool SampleTcpInfo(SockUtil::TcpInfo &, SockUtil::TcpInfo &) { return false; }
+
 private:
     mutable std::string _id;
     Socket::Ptr _sock;
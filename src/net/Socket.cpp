@@ -2,6 +2,8 @@
 // This file is part of nethello(https://github.com/wichue/nethello).
 
 #include <type_traits>
+#include <limits.h>
+#include <cassert>
 #include "SocketBase.h"
 #include "Socket.h"
 #include "util.h"
@@ -9,11 +11,21 @@
 #include "uv_errno.h"
 #include "Semaphore.h"
 #include "EventLoop.h"
+#include "config.h"
 //#include "Thread/WorkThreadPool.h"
 using namespace std;
 
 #define LOCK_GUARD(mtx) lock_guard<decltype(mtx)> lck(mtx)
 
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+#if defined(HAS_SO_TIMESTAMPING)
+#include <time.h>
+#include <linux/errqueue.h>
+#endif //HAS_SO_TIMESTAMPING
+
 namespace chw {
 
 //StatisticImp(Socket)
@@ -42,6 +54,140 @@ static SockException getSockErr(int sock, bool try_errno = true) {
     return toSockException(error);
 }
 
+static uint32_t s_sock_busy_poll_us = 0;
+
+void Socket::setBusyPoll(uint32_t us) {
+    s_sock_busy_poll_us = us;
+}
+
+static uint32_t s_read_budget_count = SOCK_READ_BUDGET_DEFAULT;
+static uint64_t s_read_budget_bytes = 0;
+
+void Socket::setReadBudget(uint32_t count, uint64_t bytes) {
+    s_read_budget_count = count;
+    s_read_budget_bytes = bytes;
+}
+
+static uint32_t s_recv_batch = SOCK_RECV_BATCH_DEFAULT;
+
+void Socket::setRecvBatch(uint32_t count) {
+    s_recv_batch = count ? count : 1;
+}
+
+static bool s_udp_gro = false;
+
+void Socket::setUdpGro(bool on) {
+    s_udp_gro = on;
+}
+
+static bool s_timestamping = false;
+
+void Socket::setTimestamping(bool on) {
+    s_timestamping = on;
+}
+
+#if defined(HAS_SO_TIMESTAMPING)
+// 与内核软件时间戳同一时钟
+static inline uint64_t realtimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+#endif //HAS_SO_TIMESTAMPING
+
+void Socket::setSharedRecvBuffer(bool on) {
+    if (_shared_recv == on) {
+        return;
+    }
+    if (_buffer && _buffer->Size()) {
+        // 读缓存中还有上层未处理的数据，不能更换
+        WarnL << "recv buffer not empty, keep current buffer,fd=" << rawFD();
+        return;
+    }
+    _shared_recv = on;
+    // 下次读取时重新获取读缓存
+    _buffer = nullptr;
+}
+
+uint32_t Socket::prepareRecvBuffer() {
+    auto type = _sock_fd->type();
+    if (_shared_recv) {
+        if (!_buffer) {
+            _buffer = _poller->getSharedBuffer(type == SockNum::Sock_UDP);
+            if (!_buffer) {
+                return chw::fail;
+            }
+        }
+        if (_buffer->Capacity() == 0) {
+            // 上层通过Buffer::Detach取走了共享缓存的内存，重新分配
+            return _buffer->SetCapacity(type == SockNum::Sock_UDP ? RAW_BUFFER_SIZE : TCP_BUFFER_SIZE);
+        }
+        return chw::success;
+    }
+
+    if (!_buffer) {
+        _buffer = std::make_shared<Buffer>();
+        _recv_small_times = 0;
+        if (type == SockNum::Sock_UDP) {
+            _recv_buf_size = RAW_BUFFER_SIZE;
+        } else {
+            _recv_buf_size = type == SockNum::Sock_TCP ? SOCK_RECV_BUF_MIN : TCP_BUFFER_SIZE;
+        }
+        return _buffer->SetCapacity(std::max<size_t>(_recv_buf_size, SOCK_RECV_BUF_MIN));
+    }
+
+    if (_buffer->Capacity() == 0) {
+        // 上层通过Buffer::Detach取走了读缓存（如粘包处理把半包挂到缓存链上），按原大小重新分配
+        return _buffer->SetCapacity(_recv_buf_size);
+    }
+
+    if (type == SockNum::Sock_TCP && _buffer->Size() == 0 && _recv_small_times >= SOCK_RECV_SHRINK_TIMES
+        && _buffer->Capacity() > SOCK_RECV_BUF_MIN) {
+        // 连接空闲或流量变小，缩小读缓存
+        size_t size = std::max<size_t>(_buffer->Capacity() / 2, SOCK_RECV_BUF_MIN);
+        _buffer->Free();
+        _recv_small_times = 0;
+        return _buffer->SetCapacity(size);
+    }
+    return chw::success;
+}
+
+void Socket::adaptRecvBuffer(ssize_t nread) {
+    if (!_shared_recv && _sock_fd->type() == SockNum::Sock_TCP) {
+        if (_buffer->Idle() == 0 && _buffer->Capacity() < TCP_BUFFER_SIZE) {
+            // 读满了，扩容后下次多读一些
+            _buffer->SetCapacity(std::min<size_t>(_buffer->Capacity() * 2, TCP_BUFFER_SIZE));
+        }
+        if ((size_t)nread < _buffer->Capacity() / 4) {
+            ++_recv_small_times;
+        } else {
+            _recv_small_times = 0;
+        }
+        _recv_buf_size = _buffer->Capacity();
+    }
+    // 缓存不再清零，有空间时在数据后补结束符，方便上层按字符串处理
+    if (_buffer->Idle()) {
+        ((char *)_buffer->data())[_buffer->Size()] = '\0';
+    }
+}
+
+void Socket::detachSharedBuffer() {
+    auto buf = std::make_shared<Buffer>();
+    if (buf->SetCapacity(_buffer->Size() + SOCK_RECV_BUF_MIN) == chw::fail) {
+        _buffer->Reset();
+        shutdown();
+        return;
+    }
+    _RAM_CPY_(buf->data(), buf->Capacity(), _buffer->data(), _buffer->Size());
+    buf->SetSize(_buffer->Size());
+    _buffer->Reset();
+    _buffer = std::move(buf);
+    _shared_recv = false;
+    _recv_small_times = 0;
+    _recv_buf_size = _buffer->Capacity();
+    WarnL << "recv data kept by upper layer, use private recv buffer,fd=" << rawFD();
+}
+
 Socket::Ptr Socket::createSocket(const EventLoop::Ptr &poller_in, bool enable_mutex) {
     //auto poller = poller_in ? poller_in : EventPollerPool::Instance().getPoller();
     std::weak_ptr<EventLoop> weak_poller = poller_in;
@@ -58,16 +204,19 @@ Socket::Socket(EventLoop::Ptr poller, bool enable_mutex)
     : _poller(std::move(poller))
     , _mtx_sock_fd(enable_mutex)
     , _mtx_event(enable_mutex)
+    , _mtx_send_list(enable_mutex)
     // , _mtx_send_buf_waiting(enable_mutex)
     // , _mtx_send_buf_sending(enable_mutex)
 {
     setOnRead(nullptr);
     setOnErr(nullptr);
     setOnAccept(nullptr);
-    // setOnFlush(nullptr);
+    setOnFlush(nullptr);
     setOnBeforeAccept(nullptr);
     // setOnSendResult(nullptr);
     SetSndType(SEND_IMMED);
+    _max_list_bytes = SEND_LIST_MAX_BYTES;
+    _batch_l = SEND_LIST_BATCH;
 }
 
 Socket::~Socket() {
@@ -75,37 +224,30 @@ Socket::~Socket() {
 }
 
 void Socket::setOnRead(onReadCB cb) {
-    if(cb) {
-        _on_read = std::move(cb);
+    onMultiReadCB cb2;
+    if (cb) {
+        cb2 = [cb](Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count) {
+            for (auto i = 0u; i < count; ++i) {
+                cb(buf[i], (struct sockaddr *)(addr + i), sizeof(struct sockaddr_storage));
+            }
+        };
+    }
+    setOnMultiRead(std::move(cb2));
+}
+
+void Socket::setOnMultiRead(onMultiReadCB cb) {
+    LOCK_GUARD(_mtx_event);
+    if (cb) {
+        _on_multi_read = std::move(cb);
     } else {
-        _on_read = [](Buffer::Ptr &buf, struct sockaddr *addr, int addr_len) {
-            WarnL << "Socket not set read callback, data ignored: " << buf->Size();
-            buf->SetSize(0);
+        _on_multi_read = [](Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count) {
+            for (auto i = 0u; i < count; ++i) {
+                WarnL << "Socket not set read callback, data ignored: " << buf[i]->Size();
+                buf[i]->SetSize(0);
+            }
         };
     }
-    // onMultiReadCB cb2;
-    // if (cb) {
-    //     cb2 = [cb](Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count) {
-    //         for (auto i = 0u; i < count; ++i) {
-    //             cb(buf[i], (struct sockaddr *)(addr + i), sizeof(struct sockaddr_storage));
-    //         }
-    //     };
-    // }
-    // setOnMultiRead(std::move(cb2));
-}
-
-// void Socket::setOnMultiRead(onMultiReadCB cb) {
-    // LOCK_GUARD(_mtx_event);
-    // if (cb) {
-    //     _on_multi_read = std::move(cb);
-    // } else {
-    //     _on_multi_read = [](Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count) {
-    //         for (auto i = 0u; i < count; ++i) {
-    //             WarnL << "Socket not set read callback, data ignored: " << buf[i]->size();
-    //         }
-    //     };
-    // }
-// }
+}
 
 void Socket::setOnErr(onErrCB cb) {
     LOCK_GUARD(_mtx_event);
@@ -125,14 +267,14 @@ void Socket::setOnAccept(onAcceptCB cb) {
     }
 }
 
-// void Socket::setOnFlush(onFlush cb) {
-//     LOCK_GUARD(_mtx_event);
-//     if (cb) {
-//         _on_flush = std::move(cb);
-//     } else {
-//         _on_flush = []() { return true; };
-//     }
-// }
+void Socket::setOnFlush(onFlush cb) {
+    LOCK_GUARD(_mtx_event);
+    if (cb) {
+        _on_flush = std::move(cb);
+    } else {
+        _on_flush = []() { return true; };
+    }
+}
 
 void Socket::setOnBeforeAccept(onCreateSocket cb) {
     LOCK_GUARD(_mtx_event);
@@ -270,6 +412,27 @@ bool Socket::attachEvent(const SockNum::Ptr &sock) {
         return -1 != result;
     }
 
+    if (s_sock_busy_poll_us) {
+        //socket读取时也在驱动队列上自旋
+        SockUtil::setBusyPoll(sock->rawFd(), s_sock_busy_poll_us);
+    }
+
+#if defined(HAS_UDP_GSO) && defined(HAS_RECVMMSG)
+    if (s_udp_gro && sock->type() == SockNum::Sock_UDP) {
+        //内核不支持或raw socket时设置失败，按普通udp包接收
+        _udp_gro = SockUtil::setUdpGro(sock->rawFd()) == 0;
+    }
+#endif
+
+#if defined(HAS_SO_TIMESTAMPING)
+    if (s_timestamping && (sock->type() == SockNum::Sock_TCP || sock->type() == SockNum::Sock_UDP)) {
+        _timestamping = SockUtil::setTimestamping(sock->rawFd()) == 0;
+        if (_timestamping && _tx_stamps.empty()) {
+            _tx_stamps.resize(SOCK_TX_STAMP_SLOTS);
+        }
+    }
+#endif
+
     // tcp客户端或udp，监听读、写、错误
     //auto read_buffer = _poller->getSharedBuffer(sock->type() == SockNum::Sock_UDP);
     //chw:: 暂不监听Event_Write事件，当前发送方案没有使用Event_Write
@@ -286,8 +449,19 @@ bool Socket::attachEvent(const SockNum::Ptr &sock) {
             strong_self->onWriteAble(sock);
         }
         if (event & EventLoop::Event_Error) {
+            bool errqueue = strong_self->_timestamping || strong_self->_zc_state == 1;
+            if (errqueue) {
+                // 零拷贝完成通知和发送时间戳也会触发错误事件，先读完错误队列
+                strong_self->onErrQueue(sock);
+            }
             if (sock->type() == SockNum::Sock_UDP) {
                 // udp ignore error
+            } else if (errqueue) {
+                // 读完错误队列后socket没有出错则忽略
+                auto err = getSockErr(sock->rawFd(), false);
+                if (err) {
+                    strong_self->emitErr(err);
+                }
             } else {
                 strong_self->emitErr(getSockErr(sock->rawFd()));
             }
@@ -301,8 +475,30 @@ bool Socket::attachEvent(const SockNum::Ptr &sock) {
 ssize_t Socket::onRead(const SockNum::Ptr &sock/*, const SocketRecvBuffer::Ptr &buffer*/) noexcept {
     //todo
     ssize_t ret = 0, nread = 0, count = 0;
+    uint32_t times = 0;
+    _read_pending = false;
+
+    Buffer::Ptr *buffers = &_buffer;
+    struct sockaddr_storage *addresses = &_address;
+#if defined(HAS_RECVMMSG)
+    // udp和raw socket使用recvmmsg批量接收，开启UDP GRO或时间戳时需要读取辅助数据，也使用recvmmsg
+    bool batch = (s_recv_batch > 1 || _udp_gro || _timestamping) && sock->type() == SockNum::Sock_UDP;
+#endif //HAS_RECVMMSG
 
     while (_enable_recv) {
+        if ((s_read_budget_count && times >= s_read_budget_count) || (s_read_budget_bytes && (uint64_t)ret >= s_read_budget_bytes)) {
+            //本轮读取配额用完，剩余数据排到任务队列下一轮再读，避免一个socket占满轮询线程
+            deferRead(sock);
+            return ret;
+        }
+        ++times;
+#if defined(HAS_RECVMMSG)
+        if (batch) {
+            nread = recvFromSocketBatch(sock->rawFd(), count);
+            buffers = _buffers.data();
+            addresses = _addresses.data();
+        } else
+#endif //HAS_RECVMMSG
         nread = /*buffer->*/recvFromSocket(sock->rawFd(), count);
         if (nread == 0) {
             if (sock->type() == SockNum::Sock_TCP) {
@@ -339,21 +535,171 @@ ssize_t Socket::onRead(const SockNum::Ptr &sock/*, const SocketRecvBuffer::Ptr &
             _recv_speed += nread;
         }
 
-        // auto &buf = buffer->getBuffer(0);
-        auto &addr = /*buffer->*/getAddress(0);
+#if defined(HAS_SO_TIMESTAMPING)
+        uint64_t app_ns = _timestamping ? realtimeNs() : 0;
+#endif //HAS_SO_TIMESTAMPING
         try {
             // 此处捕获异常，目的是防止数据未读尽，epoll边沿触发失效的问题  [AUTO-TRANSLATED:2f3f813b]
             //Catch exception here, the purpose is to prevent data from not being read completely, and the epoll edge trigger fails
             LOCK_GUARD(_mtx_event);
-            // _on_multi_read(&buf, &addr, count);
-            _on_read(_buffer,(struct sockaddr *)&addr,sizeof(struct sockaddr_storage));
+            _on_multi_read(buffers, addresses, count);
         } catch (std::exception &ex) {
             ErrorL << "Exception occurred when emit on_read: " << ex.what();
         }
+#if defined(HAS_SO_TIMESTAMPING)
+        if (_timestamping) {
+            _rx_app.record((realtimeNs() - app_ns) / 1000);
+        }
+#endif //HAS_SO_TIMESTAMPING
+
+        if (_shared_recv && buffers == &_buffer && _buffer->Size()) {
+            // 上层保留了数据，共享缓存要给同线程的其他socket使用
+            detachSharedBuffer();
+        }
     }
     return 0;
 }
 
+#if defined(HAS_RECVMMSG)
+ssize_t Socket::recvFromSocketBatch(int fd, ssize_t &count) {
+    if (_buffers.size() != s_recv_batch) {
+        _buffers.resize(s_recv_batch);
+        _addresses.resize(s_recv_batch);
+        _iovec_r.resize(s_recv_batch);
+        _mmsghdr_r.resize(s_recv_batch);
+        for (auto &buffer : _buffers) {
+            if (buffer) {
+                continue;
+            }
+            buffer = std::make_shared<Buffer>();
+            // GRO合并包最大64KB，缓存不足时内核会截断
+            if (buffer->SetCapacity(_udp_gro ? UDP_GRO_BUFFER_SIZE : RAW_BUFFER_SIZE) == chw::fail) {
+                shutdown();
+                return -1;
+            }
+            buffer->Reset0();
+        }
+    }
+
+    size_t control_size = (_udp_gro ? UDP_GRO_CONTROL_SIZE : 0) + (_timestamping ? TIMESTAMPING_CONTROL_SIZE : 0);
+    if (_control_r.size() != s_recv_batch * control_size) {
+        _control_r.resize(s_recv_batch * control_size);
+    }
+
+    for (uint32_t i = 0; i < s_recv_batch; ++i) {
+        // 上层没有取走的数据保留，接着写在后面，与recvFromSocket一致
+        auto &io = _iovec_r[i];
+        io.iov_base = (char *)_buffers[i]->data() + _buffers[i]->Size();
+        io.iov_len = _buffers[i]->Idle();
+
+        auto &mmsg = _mmsghdr_r[i];
+        memset(&mmsg, 0, sizeof(struct mmsghdr));
+        mmsg.msg_hdr.msg_name = &_addresses[i];
+        mmsg.msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        mmsg.msg_hdr.msg_iov = &io;
+        mmsg.msg_hdr.msg_iovlen = 1;
+        if (control_size) {
+            mmsg.msg_hdr.msg_control = &_control_r[i * control_size];
+            mmsg.msg_hdr.msg_controllen = control_size;
+        }
+    }
+
+    int n;
+    do {
+        n = recvmmsg(fd, _mmsghdr_r.data(), s_recv_batch, 0, nullptr);
+    } while (-1 == n && UV_EINTR == get_uv_error(true));
+
+    if (n <= 0) {
+        return n;
+    }
+
+#if defined(HAS_SO_TIMESTAMPING)
+    uint64_t now_ns = _timestamping ? realtimeNs() : 0;
+#endif //HAS_SO_TIMESTAMPING
+    ssize_t nread = 0;
+    for (int i = 0; i < n; ++i) {
+        auto len = _mmsghdr_r[i].msg_len;
+        _buffers[i]->SetSize(_buffers[i]->Size() + len);
+#if defined(HAS_UDP_GSO)
+        _buffers[i]->SetSegSize(_udp_gro ? SockUtil::getUdpGroSize(&_mmsghdr_r[i].msg_hdr) : 0);
+#endif //HAS_UDP_GSO
+#if defined(HAS_SO_TIMESTAMPING)
+        if (_timestamping) {
+            uint64_t sw_ns, hw_ns;
+            SockUtil::getRxTimestamp(&_mmsghdr_r[i].msg_hdr, sw_ns, hw_ns);
+            _buffers[i]->SetStamp(sw_ns, hw_ns);
+            recordRxStamp(sw_ns, hw_ns, now_ns);
+        }
+#endif //HAS_SO_TIMESTAMPING
+        nread += len;
+    }
+    count = n;
+    return nread;
+}
+#endif //HAS_RECVMMSG
+
+#if defined(HAS_SO_TIMESTAMPING)
+ssize_t Socket::recvFromSocketStamp(int fd, ssize_t &count) {
+    if (prepareRecvBuffer() == chw::fail) {
+        shutdown();
+        return 0;
+    }
+
+    char control[TIMESTAMPING_CONTROL_SIZE];
+    struct iovec io;
+    io.iov_base = (char *)_buffer->data() + _buffer->Size();
+    io.iov_len = _buffer->Idle();
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &_address;
+    msg.msg_namelen = sizeof(_address);
+    msg.msg_iov = &io;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t nread;
+    do {
+        nread = recvmsg(fd, &msg, 0);
+    } while (-1 == nread && UV_EINTR == get_uv_error(true));
+
+    if (nread > 0) {
+        // tcp一次读取多个报文时，时间戳是最后一个报文的
+        uint64_t sw_ns, hw_ns;
+        SockUtil::getRxTimestamp(&msg, sw_ns, hw_ns);
+        _buffer->SetStamp(sw_ns, hw_ns);
+        recordRxStamp(sw_ns, hw_ns, realtimeNs());
+        _buffer->SetSize(_buffer->Size() + nread);
+        adaptRecvBuffer(nread);
+        count = 1;
+    }
+    return nread;
+}
+#endif //HAS_SO_TIMESTAMPING
+
+void Socket::deferRead(const SockNum::Ptr &sock) {
+    if (_read_pending) {
+        return;
+    }
+    _read_pending = true;
+    weak_ptr<Socket> weak_self = shared_from_this();
+    //从轮询线程投递，排在本轮已有任务之后执行，多个socket之间轮流读取
+    _poller->async([weak_self, sock]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self || !strong_self->_read_pending) {
+            return;
+        }
+        {
+            //排队期间socket可能已关闭或更换
+            LOCK_GUARD(strong_self->_mtx_sock_fd);
+            if (!strong_self->_sock_fd || strong_self->_sock_fd->sockNum() != sock) {
+                return;
+            }
+        }
+        strong_self->onRead(sock);
+    }, false);
+}
+
 bool Socket::emitErr(const SockException &err) noexcept {
     if (_err_emit) {
         return true;
@@ -452,16 +798,16 @@ bool Socket::emitErr(const SockException &err) noexcept {
 //     return 0;
 // }
 
-// void Socket::onFlushed() {
-//     bool flag;
-//     {
-//         LOCK_GUARD(_mtx_event);
-//         flag = _on_flush();
-//     }
-//     if (!flag) {
-//         setOnFlush(nullptr);
-//     }
-// }
+void Socket::onFlushed() {
+    bool flag;
+    {
+        LOCK_GUARD(_mtx_event);
+        flag = _on_flush();
+    }
+    if (!flag) {
+        setOnFlush(nullptr);
+    }
+}
 
 void Socket::closeSock(bool close_fd) {
     _sendable = true;
@@ -472,13 +818,12 @@ void Socket::closeSock(bool close_fd) {
     _send_flush_ticker.resetTime();
 
     {
-        // LOCK_GUARD(_mtx_send_buf_waiting);
-        // _send_buf_waiting.clear();
-    }
-
-    {
-        // LOCK_GUARD(_mtx_send_buf_sending);
-        // _send_buf_sending.clear();
+        LOCK_GUARD(_mtx_send_list);
+        _send_list.clear();
+        _send_list_offset = 0;
+        _send_list_bytes = 0;
+        _send_list_posted = false;
+        _send_list_delayed = false;
     }
 
     {
@@ -486,9 +831,13 @@ void Socket::closeSock(bool close_fd) {
         if (close_fd) {
             _err_emit = false;
             _sock_fd = nullptr;
+            ++_sock_gen;
+            _buf_m.clear();
+            _len_m.clear();
         } else if (_sock_fd) {
             _sock_fd->delEvent();
         }
+        resetZeroCopy_l();
     }
 }
 
@@ -670,6 +1019,9 @@ void Socket::setSock(SockNum::Ptr sock) {
     } else {
         _sock_fd = nullptr;
     }
+    _shared_sock = false;
+    ++_sock_gen;
+    resetZeroCopy_l();
 }
 
 string Socket::get_local_ip() {
@@ -688,6 +1040,14 @@ uint16_t Socket::get_local_port() {
     return SockUtil::inet_port((struct sockaddr *)&_local_addr);
 }
 
+int Socket::getTcpInfo(SockUtil::TcpInfo &info) {
+    LOCK_GUARD(_mtx_sock_fd);
+    if (!_sock_fd || _sock_fd->type() != SockNum::Sock_TCP) {
+        return -1;
+    }
+    return SockUtil::getTcpInfo(_sock_fd->rawFd(), info);
+}
+
 string Socket::get_peer_ip() {
     LOCK_GUARD(_mtx_sock_fd);
     if (!_sock_fd) {
@@ -838,47 +1198,20 @@ string Socket::getIdentifier() const {
 // }
 
 void Socket::onWriteAble(const SockNum::Ptr &sock) {
-    // bool empty_waiting;
-    // bool empty_sending;
-    // {
-    //     LOCK_GUARD(_mtx_send_buf_waiting);
-    //     empty_waiting = _send_buf_waiting.empty();
-    // }
-
-    // {
-    //     LOCK_GUARD(_mtx_send_buf_sending);
-    //     empty_sending = _send_buf_sending.empty();
-    // }
-
-    // if(_sendable == false) {
-    //     stopWriteAbleEvent(sock);
-    // }
-    //         if(_snd_type == SEND_BUFF)
-    //     {
-    //         flush_b(true);
-    //     }
-    // return;
-
-    // bool empty_sending;
-    // {
-    //     LOCK_GUARD(_mtx_sock_fd);
-    //     if(_snd_type == SEND_BUFF)
-    //     {
-    //         empty_sending = _SndBuffer->Size() == 0 ? true : false;
-    //     }
-    // }
-
-    // if (/*empty_waiting && */empty_sending) {
-    //     // 数据已经清空了，我们停止监听可写事件
-    //     stopWriteAbleEvent(sock);
-    // } else {
-    //     // socket可写，我们尝试发送剩余的数据
-    //     if(_snd_type == SEND_BUFF)
-    //     {
-    //         flush_b(true);
-    //     }
-    //     // flushData(sock, true);
-    // }
+    bool empty;
+    {
+        LOCK_GUARD(_mtx_send_list);
+        empty = _send_list.empty();
+    }
+
+    if (empty) {
+        // 数据已经清空了，我们停止监听可写事件
+        stopWriteAbleEvent(sock);
+        onFlushed();
+    } else {
+        // socket可写，我们尝试发送剩余的数据
+        flush_l(sock);
+    }
 }
 
 void Socket::startWriteAbleEvent(const SockNum::Ptr &sock) {
@@ -956,6 +1289,27 @@ bool Socket::cloneSocket(const Socket &other) {
     return fromSock_l(sock);
 }
 
+bool Socket::shareSock(const Socket &other) {
+    closeSock();
+    SockNum::Ptr sock;
+    {
+        LOCK_GUARD(other._mtx_sock_fd);
+        if (!other._sock_fd) {
+            WarnL << "sockfd of src socket is null";
+            return false;
+        }
+        sock = other._sock_fd->sockNum();
+    }
+    LOCK_GUARD(_mtx_sock_fd);
+    // SockFD不绑定poller，释放时不会移除原Socket监听的事件，fd由最后一个持有者关闭
+    _sock_fd = std::make_shared<SockFD>(std::move(sock), nullptr);
+    SockUtil::get_sock_local_addr(_sock_fd->rawFd(), _local_addr);
+    _shared_sock = true;
+    ++_sock_gen;
+    resetZeroCopy_l();
+    return true;
+}
+
 bool Socket::bindPeerAddr(const struct sockaddr *dst_addr, socklen_t addr_len, bool soft_bind) {
     LOCK_GUARD(_mtx_sock_fd);
     if (!_sock_fd) {
@@ -1048,76 +1402,918 @@ void Socket::SetSndType(SEND_TYPE type)
     }
 }
 
+void Socket::setSendOwner(const std::thread::id &owner)
+{
+    _send_owner = owner;
+    _owner_sock = nullptr;
+    _owner_gen = 0;
+    // 原发送线程没来得及执行的转发按新的模式发送
+    runForwarded();
+}
+
+void Socket::runForwarded()
+{
+    if (!_forward_pending.load(std::memory_order_acquire)) {
+        return;
+    }
+    decltype(_forward_list) tasks;
+    {
+        std::lock_guard<std::mutex> lck(_mtx_forward);
+        tasks.swap(_forward_list);
+        _forward_pending.store(false, std::memory_order_relaxed);
+    }
+    for (auto &task : tasks) {
+        task();
+    }
+}
+
+const SockNum::Ptr &Socket::ownerSock()
+{
+    if (_sock_gen.load(std::memory_order_acquire) != _owner_gen) {
+        LOCK_GUARD(_mtx_sock_fd);
+        _owner_sock = _sock_fd ? _sock_fd->sockNum() : nullptr;
+        _owner_gen = _sock_gen.load(std::memory_order_relaxed);
+    }
+    return _owner_sock;
+}
+
+bool Socket::sendOwner(char* buff, uint32_t len, uint32_t &sent, const struct sockaddr *dst, socklen_t dst_len)
+{
+    sent = 0;
+    const SockNum::Ptr &sock = ownerSock();
+    // _sendable为false时有数据排队，只有发送线程会排队，poller线程发完后才会置为true
+    if (!sock || len == 0 || buff == nullptr || !_sendable.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    bool tcp = sock->type() == SockNum::Sock_TCP;
+    if (tcp && dst) {
+        PrintE("send_addr not support tcp.");
+        return true;
+    }
+    const struct sockaddr *addr = dst;
+    socklen_t addr_len = dst_len;
+    if (!tcp && !addr) {
+        addr = _udp_send_dst ? (struct sockaddr *)_udp_send_dst.get() : (struct sockaddr *)&_peer_addr;
+        addr_len = SockUtil::get_sock_len(addr);
+    }
+
+    while (sent < len) {
+        ssize_t n = tcp ? ::send(sock->rawFd(), buff + sent, len - sent, _sock_flags)
+                        : ::sendto(sock->rawFd(), buff, len, _sock_flags, addr, addr_len);
+        if (n >= 0) {
+            sent += n;
+            continue;
+        }
+        int err = get_uv_error(true);
+        if (err == UV_EINTR) {
+            continue;
+        }
+        _send_speed += sent;
+        if (err == UV_EAGAIN) {
+            return false;
+        }
+        //发送失败由上层处理
+        ErrorL << "send failed:" << uv_strerror(err) << ",fd=" << sock->rawFd();
+        return true;
+    }
+    _send_speed += sent;
+    return true;
+}
+
+uint32_t Socket::forwardSend(char* buff, uint32_t len, const std::function<void(const Socket::Ptr &, const Buffer::Ptr &)> &send, bool to_poller)
+{
+    if (len == 0 || buff == nullptr) {
+        return 0;
+    }
+
+    auto buf = std::make_shared<Buffer>();
+    if (buf->SetCapacity(len) == chw::fail) {
+        return 0;
+    }
+    _RAM_CPY_(buf->data(), len, buff, len);
+    buf->SetSize(len);
+
+    weak_ptr<Socket> weak_self = shared_from_this();
+    auto task = [weak_self, buf, send]() {
+        auto strong_self = weak_self.lock();
+        if (strong_self) {
+            send(strong_self, buf);
+        }
+    };
+    if (to_poller || _poller->getThreadId() == _send_owner) {
+        _poller->async(std::move(task), false);
+        return len;
+    }
+
+    // 发送线程不是poller线程，由发送线程下次发送时执行，避免和发送线程同时发送
+    {
+        std::lock_guard<std::mutex> lck(_mtx_forward);
+        _forward_list.emplace_back(std::move(task));
+    }
+    _forward_pending.store(true, std::memory_order_release);
+    return len;
+}
+
 uint32_t Socket::send_i(char* buff, uint32_t len)
 {
-    LOCK_GUARD(_mtx_sock_fd);
+    uint32_t sent = 0;
+    if (_send_owner != std::thread::id()) {
+        if (std::this_thread::get_id() != _send_owner) {
+            return forwardSend(buff, len, [](const Socket::Ptr &sock, const Buffer::Ptr &buf) {
+                sock->send_i((char *)buf->data(), buf->Size());
+            });
+        }
+        runForwarded();
+        if (sendOwner(buff, len, sent)) {
+            return sent;
+        }
+    }
 
-    if (!_sock_fd) {
-        PrintE("socket is null.");
-        // 如果已断开连接或者发送超时
+    return sent + send_i_l(buff + sent, len - sent);
+}
+
+uint32_t Socket::send_i_l(char* buff, uint32_t len, const struct sockaddr *dst, socklen_t dst_len)
+{
+    SockNum::Ptr sock;
+    {
+        LOCK_GUARD(_mtx_sock_fd);
+        if (!_sock_fd) {
+            PrintE("socket is null.");
+            // 如果已断开连接或者发送超时
+            return 0;
+        }
+        sock = _sock_fd->sockNum();
+    }
+    if (len == 0 || buff == nullptr) {
         return 0;
     }
-    //发送失败由上层处理
-    if (_sendable) {
-        // 该socket可写
-        uint32_t _snd_bytes = 0;
-        if(len > 0 && buff != nullptr) {
-            if(_sock_fd->type() == SockNum::Sock_TCP) {
-                _snd_bytes =  SockUtil::send_tcp_data(_sock_fd->rawFd(),buff,len);
-            } else {
-                if(_udp_send_dst) {
-                    struct sockaddr *addr = (struct sockaddr *)_udp_send_dst.get();
-                    socklen_t addr_len = SockUtil::get_sock_len(addr);
-                    _snd_bytes =  SockUtil::send_udp_data(_sock_fd->rawFd(),buff,len,addr,addr_len);
-                } else {
-                    struct sockaddr *addr = (struct sockaddr *)&_peer_addr;
-                    socklen_t addr_len = SockUtil::get_sock_len(addr);
-                    _snd_bytes =  SockUtil::send_udp_data(_sock_fd->rawFd(),buff,len,addr,addr_len);
-                    // PrintD("_snd_bytes=%d", _snd_bytes);
-                }
-            }
 
-            _send_speed += _snd_bytes;
-            return _snd_bytes;
+    bool tcp = sock->type() == SockNum::Sock_TCP;
+    if (tcp && dst) {
+        PrintE("send_addr not support tcp.");
+        return 0;
+    }
+    const struct sockaddr *addr = dst;
+    socklen_t addr_len = dst_len;
+    if (!tcp && !addr) {
+        addr = _udp_send_dst ? (struct sockaddr *)_udp_send_dst.get() : (struct sockaddr *)&_peer_addr;
+        addr_len = SockUtil::get_sock_len(addr);
+    }
+
+    LOCK_GUARD(_mtx_send_list);
+    uint32_t snd_bytes = 0;
+    if (_send_list.empty()) {
+        // 没有排队的数据时直接发送，直到socket发送缓存满
+        while (snd_bytes < len) {
+            ssize_t n = tcp ? ::send(sock->rawFd(), buff + snd_bytes, len - snd_bytes, _sock_flags)
+                            : ::sendto(sock->rawFd(), buff, len, _sock_flags, addr, addr_len);
+            if (n >= 0) {
+                snd_bytes += n;
+                continue;
+            }
+            int err = get_uv_error(true);
+            if (err == UV_EINTR) {
+                continue;
+            }
+            if (err == UV_EAGAIN) {
+                break;
+            }
+            //发送失败由上层处理
+            ErrorL << "send failed:" << uv_strerror(err) << ",fd=" << sock->rawFd();
+            _send_speed += snd_bytes;
+            return snd_bytes;
+        }
+        _send_speed += snd_bytes;
+        if (snd_bytes == len) {
+            return len;
         }
+    }
+
+    // socket发送缓存已满或有数据在排队，剩余数据拷贝到发送队列，可写时由poller线程发送
+    return queueCopy_l(sock, buff + snd_bytes, len - snd_bytes, dst, dst_len) ? len : snd_bytes;
+}
+
+bool Socket::queueSend_l(const SockNum::Ptr &sock, const Buffer::Ptr &buf, size_t offset, const struct sockaddr *dst, socklen_t dst_len)
+{
+    if (_shared_sock) {
+        // 共享的fd由原Socket监听事件，本对象收不到可写事件，发送缓存满时丢弃，与udp丢包一致
+        return false;
+    }
+    size_t left = buf->Size() - offset;
+    if (_send_list_bytes + left > _max_list_bytes) {
+        ErrorL << "send list full, bytes=" << _send_list_bytes << ",max=" << _max_list_bytes << ",fd=" << sock->rawFd();
+        return false;
+    }
+    if (!_sendable && _send_flush_ticker.elapsedTime() > _max_send_buffer_ms) {
+        // 等待可写事件超时，对端可能已经不再接收
+        emitErr(SockException(Err_other, "socket send timeout"));
+        return false;
+    }
+    if (_send_list.empty()) {
+        _send_flush_ticker.resetTime();
+        _send_list_offset = offset;
     } else {
-        PrintE("send able is false.");
-        return 0;
+        // 只有tcp部分发送后的剩余数据带偏移，此时队列一定为空
+        assert(offset == 0);
+    }
+    _send_list.emplace_back(buf);
+    if (dst) {
+        // 目的地址随数据排队，可写时发往同一地址
+        auto &item = _send_list.back();
+        item.dst = std::make_shared<struct sockaddr_storage>();
+        item.dst_len = std::min<socklen_t>(dst_len, sizeof(struct sockaddr_storage));
+        memcpy(item.dst.get(), dst, item.dst_len);
     }
+    _send_list_bytes += left;
+    if (!_send_list_posted) {
+        _send_list_posted = true;
+        startWriteAbleEvent(sock);
+    }
+    return true;
+}
 
-    return 0;
+bool Socket::queueCopy_l(const SockNum::Ptr &sock, const char *data, size_t len, const struct sockaddr *dst, socklen_t dst_len)
+{
+    if (_shared_sock) {
+        return false;
+    }
+    auto buf = std::make_shared<Buffer>();
+    if (buf->SetCapacity(len) == chw::fail) {
+        return false;
+    }
+    _RAM_CPY_(buf->data(), len, data, len);
+    buf->SetSize(len);
+    return queueSend_l(sock, buf, 0, dst, dst_len);
 }
 
 uint32_t Socket::send_addr(char* buff, uint32_t len, struct sockaddr* addr, int32_t socklen)
+{
+    // 与send_i相同，socket发送缓存满时放入发送队列等待可写事件，不在调用线程中休眠重试
+    uint32_t sent = 0;
+    if (_send_owner != std::thread::id()) {
+        if (std::this_thread::get_id() != _send_owner) {
+            struct sockaddr_storage dst;
+            memcpy(&dst, addr, std::min<size_t>(socklen, sizeof(dst)));
+            return forwardSend(buff, len, [dst, socklen](const Socket::Ptr &sock, const Buffer::Ptr &buf) {
+                sock->send_addr((char *)buf->data(), buf->Size(), (struct sockaddr *)&dst, socklen);
+            });
+        }
+        runForwarded();
+        if (sendOwner(buff, len, sent, addr, socklen)) {
+            return sent;
+        }
+    }
+
+    return sent + send_i_l(buff + sent, len - sent, addr, socklen);
+}
+
+uint32_t Socket::send_m(char* buff, uint32_t len)
 {
     LOCK_GUARD(_mtx_sock_fd);
 
     if (!_sock_fd) {
         PrintE("socket not connected.");
-        // 如果已断开连接或者发送超时
         return 0;
     }
-    //发送失败由上层处理
-    if (_sendable) {
-        // 该socket可写
-        uint32_t _snd_bytes = 0;
-        if(len > 0 && buff != nullptr) {
-            if(_sock_fd->type() == SockNum::Sock_TCP) {
-                PrintE("send_addr not support tcp.");
-                return 0;
-            } else {
-                _snd_bytes =  SockUtil::send_udp_data(_sock_fd->rawFd(),buff,len,addr,socklen);
+    if (_sock_fd->type() != SockNum::Sock_UDP) {
+        PrintE("send_m only support udp.");
+        return 0;
+    }
+    if (len == 0 || buff == nullptr) {
+        return 0;
+    }
+    if (_len_m.size() >= _batch_m && flush_m_l() == chw::fail) {
+        // 上次未能发出的包还在批量缓存中，不再接收新的包
+        return 0;
+    }
+
+    _buf_m.insert(_buf_m.end(), buff, buff + len);
+    _len_m.emplace_back(len);
+    if (_len_m.size() >= _batch_m) {
+        // 未能发出也未能排队的包留在批量缓存中，下次调用时再发送
+        flush_m_l();
+    }
+
+    return len;
+}
+
+uint32_t Socket::flush_m()
+{
+    LOCK_GUARD(_mtx_sock_fd);
+    if (!_sock_fd) {
+        return chw::fail;
+    }
+
+    return flush_m_l();
+}
+
+uint32_t Socket::flush_m_l()
+{
+    uint32_t count = _len_m.size();
+    if (count == 0) {
+        return chw::success;
+    }
+
+    struct sockaddr *addr = _udp_send_dst ? (struct sockaddr *)_udp_send_dst.get() : (struct sockaddr *)&_peer_addr;
+    socklen_t addr_len = SockUtil::get_sock_len(addr);
+    uint32_t sent = 0;
+    uint64_t bytes = 0;
+    auto sock = _sock_fd->sockNum();
+
+    LOCK_GUARD(_mtx_send_list);
+    if (!_send_list.empty()) {
+        // 有数据在排队，全部放入发送队列保持顺序
+        count = 0;
+    }
+#if defined(HAS_SENDMMSG)
+    // 缓存可能扩容，每次发送前重新填写iovec
+    _iov_m.resize(count);
+    _hdr_m.resize(count);
+    char *data = _buf_m.data();
+    for (uint32_t i = 0; i < count; ++i) {
+        auto &io = _iov_m[i];
+        io.iov_base = data;
+        io.iov_len = _len_m[i];
+        data += _len_m[i];
+
+        auto &msg = _hdr_m[i].msg_hdr;
+        memset(&_hdr_m[i], 0, sizeof(struct mmsghdr));
+        msg.msg_name = (void *)addr;
+        msg.msg_namelen = addr_len;
+        msg.msg_iov = &io;
+        msg.msg_iovlen = 1;
+    }
+
+    sent = count ? SockUtil::send_udp_mmsg(_sock_fd->rawFd(), _hdr_m.data(), count) : 0;
+    for (uint32_t i = 0; i < sent; ++i) {
+        bytes += _hdr_m[i].msg_len;
+    }
+#else
+    for (char *data = _buf_m.data(); sent < count; ++sent) {
+        uint32_t snd = SockUtil::send_udp_data(_sock_fd->rawFd(), data, _len_m[sent], addr, addr_len);
+        if (snd == 0) {
+            break;
+        }
+        bytes += snd;
+        data += _len_m[sent];
+    }
+#endif //HAS_SENDMMSG
+    _send_speed += bytes;
+
+    // socket发送缓存满或有数据在排队，剩余的包拷贝到发送队列，可写时由poller线程发送
+    uint32_t done = sent;
+    size_t offset = 0;
+    for (uint32_t i = 0; i < done; ++i) {
+        offset += _len_m[i];
+    }
+    for (; done < _len_m.size(); ++done) {
+        if (!queueCopy_l(sock, _buf_m.data() + offset, _len_m[done], addr, addr_len)) {
+            break;
+        }
+        offset += _len_m[done];
+    }
+
+    // 发送队列已满的情况下保留未处理的包，由下次 send_m/flush_m 继续发送
+    _buf_m.erase(_buf_m.begin(), _buf_m.begin() + offset);
+    _len_m.erase(_len_m.begin(), _len_m.begin() + done);
+
+    return _len_m.empty() ? chw::success : chw::fail;
+}
+
+bool Socket::gsoEnabled()
+{
+    LOCK_GUARD(_mtx_sock_fd);
+    if (_gso_state == -1 && _sock_fd) {
+#if defined(HAS_UDP_GSO)
+        _gso_state = _sock_fd->type() == SockNum::Sock_UDP && SockUtil::support_udp_gso(_sock_fd->rawFd()) ? 1 : 0;
+#else
+        _gso_state = 0;
+#endif //HAS_UDP_GSO
+    }
+
+    return _gso_state == 1;
+}
+
+uint32_t Socket::send_g(char* buff, uint32_t len, uint32_t seg_size)
+{
+    if (len == 0 || buff == nullptr || seg_size == 0) {
+        return 0;
+    }
+    bool gso = gsoEnabled();
+
+    LOCK_GUARD(_mtx_sock_fd);
+    if (!_sock_fd) {
+        PrintE("socket not connected.");
+        return 0;
+    }
+    if (_sock_fd->type() != SockNum::Sock_UDP) {
+        PrintE("send_g only support udp.");
+        return 0;
+    }
+
+    struct sockaddr *addr = _udp_send_dst ? (struct sockaddr *)_udp_send_dst.get() : (struct sockaddr *)&_peer_addr;
+    socklen_t addr_len = SockUtil::get_sock_len(addr);
+
+#if defined(HAS_UDP_GSO)
+    // 有数据在排队时不能插队，由 send_segments_l 全部放入发送队列
+    lock_guard<decltype(_mtx_send_list)> lck_list(_mtx_send_list);
+    if (gso && len > seg_size && _send_list.empty()) {
+        int32_t snd_len = SockUtil::send_udp_gso(_sock_fd->rawFd(), buff, len, seg_size, addr, addr_len);
+        if (snd_len > 0) {
+            _send_speed += snd_len;
+            return snd_len;
+        }
+        if (snd_len == 0) {
+            // 发送缓存满，由 send_segments_l 把各个包拷贝到发送队列
+            return send_segments_l(buff, len, seg_size, addr, addr_len);
+        }
+
+        auto err = get_uv_error(true);
+        if (err != UV_EIO && err != UV_EINVAL && err != UV_ENOPROTOOPT && err != UV_ENOTSUP) {
+            ErrorL << "udp gso send failed,err=" << uv_strerror(err) << ",len=" << len << ",seg_size=" << seg_size << ",fd=" << _sock_fd->rawFd();
+            return 0;
+        }
+        // 网卡不支持校验和卸载等原因，以后都逐包发送
+        WarnL << "udp gso not available(" << uv_strerror(err) << "), fallback to per packet send.";
+        _gso_state = 0;
+    }
+#endif //HAS_UDP_GSO
+
+    return send_segments_l(buff, len, seg_size, addr, addr_len);
+}
+
+uint32_t Socket::send_segments_l(char* buff, uint32_t len, uint32_t seg_size, struct sockaddr *addr, socklen_t addr_len)
+{
+    uint32_t count = (len + seg_size - 1) / seg_size;
+    uint64_t bytes = 0;
+    uint32_t sent = 0;
+    auto sock = _sock_fd->sockNum();
+
+    LOCK_GUARD(_mtx_send_list);
+    if (!_send_list.empty()) {
+        // 有数据在排队，全部放入发送队列保持顺序
+        count = 0;
+    }
+#if defined(HAS_SENDMMSG)
+    _iov_m.resize(count);
+    _hdr_m.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        auto &io = _iov_m[i];
+        io.iov_base = buff + i * seg_size;
+        io.iov_len = std::min(seg_size, len - i * seg_size);
+
+        auto &msg = _hdr_m[i].msg_hdr;
+        memset(&_hdr_m[i], 0, sizeof(struct mmsghdr));
+        msg.msg_name = (void *)addr;
+        msg.msg_namelen = addr_len;
+        msg.msg_iov = &io;
+        msg.msg_iovlen = 1;
+    }
+
+    sent = count ? SockUtil::send_udp_mmsg(_sock_fd->rawFd(), _hdr_m.data(), count) : 0;
+    for (uint32_t i = 0; i < sent; ++i) {
+        bytes += _hdr_m[i].msg_len;
+    }
+#else
+    for (; sent < count; ++sent) {
+        uint32_t snd = SockUtil::send_udp_data(_sock_fd->rawFd(), buff + sent * seg_size, std::min(seg_size, len - sent * seg_size), addr, addr_len);
+        if (snd == 0) {
+            break;
+        }
+        bytes += snd;
+    }
+#endif //HAS_SENDMMSG
+    _send_speed += bytes;
+
+    // socket发送缓存满或有数据在排队，剩余的包拷贝到发送队列，可写时由poller线程发送
+    uint32_t total = (len + seg_size - 1) / seg_size;
+    for (uint32_t i = sent; i < total; ++i) {
+        uint32_t seg_len = std::min(seg_size, len - i * seg_size);
+        if (!queueCopy_l(sock, buff + i * seg_size, seg_len)) {
+            break;
+        }
+        bytes += seg_len;
+    }
+    return bytes;
+}
+
+bool Socket::zerocopyEnabled()
+{
+    LOCK_GUARD(_mtx_sock_fd);
+    if (_zc_state == -1 && _sock_fd) {
+        _zc_state = _sock_fd->type() == SockNum::Sock_TCP && SockUtil::setZeroCopy(_sock_fd->rawFd()) == 0 ? 1 : 0;
+        if (_zc_state == 0) {
+            WarnL << "tcp zerocopy not available, fallback to copy send.";
+        }
+    }
+
+    return _zc_state == 1;
+}
+
+uint32_t Socket::send_z(const Buffer::Ptr &buf)
+{
+    if (!buf || buf->Size() == 0) {
+        return 0;
+    }
+    bool zc = zerocopyEnabled();
+
+    LOCK_GUARD(_mtx_sock_fd);
+    if (!_sock_fd) {
+        PrintE("socket is null.");
+        return 0;
+    }
+    if (_sock_fd->type() != SockNum::Sock_TCP) {
+        PrintE("send_z only support tcp.");
+        return 0;
+    }
+
+    char *data = (char *)buf->data();
+    uint32_t len = buf->Size();
+#if defined(HAS_MSG_ZEROCOPY)
+    if (zc) {
+        auto sock = _sock_fd->sockNum();
+        lock_guard<decltype(_mtx_send_list)> lck_list(_mtx_send_list);
+        if (!_send_list.empty()) {
+            // 有数据在排队，不拷贝直接把buf放入发送队列，发送完成后释放
+            return queueSend_l(sock, buf) ? len : 0;
+        }
+
+        uint32_t calls = 0;
+        uint32_t snd_len = SockUtil::send_tcp_zerocopy(_sock_fd->rawFd(), data, len, calls);
+        if (calls > 0) {
+            _zc_next_id += calls;
+            uint32_t last_id = _zc_next_id - 1;
+
+            std::lock_guard<std::mutex> lck(_mtx_zc);
+            // 完成通知可能已经先到了
+            if ((int32_t)(last_id - _zc_done_id) >= 0) {
+                _zc_pending.emplace_back(last_id, buf);
+            }
+        }
+        _send_speed += snd_len;
+        if (snd_len < len && queueSend_l(sock, buf, snd_len)) {
+            // 发送缓存满或通知占满选项内存，剩余部分由poller线程可写时发送，不在持锁时等待
+            return len;
+        }
+        return snd_len;
+    }
+#endif //HAS_MSG_ZEROCOPY
+
+    // 拷贝发送，发送缓存满时剩余数据拷贝到发送队列，返回时buf已经可以复用
+    return send_i_l(data, len);
+}
+
+void Socket::onErrQueue(const SockNum::Ptr &sock)
+{
+#if defined(HAS_MSG_ZEROCOPY) || defined(HAS_SO_TIMESTAMPING)
+    SockUtil::ErrQueueMsg msg;
+    while (SockUtil::recv_errqueue(sock->rawFd(), msg) > 0) {
+        if (msg.origin == SockUtil::ERRQUEUE_ZEROCOPY) {
+            if (msg.copied && _zc_copied == 0) {
+                WarnL << "tcp zerocopy fallback to copy by kernel(loopback or nic without scatter-gather), fd=" << sock->rawFd();
             }
+            onZeroCopyNotify(msg.info, msg.data, msg.copied);
+        } else if (msg.origin == SockUtil::ERRQUEUE_TIMESTAMPING) {
+            onTxStamp(msg.info, msg.data, msg.sw_ns, msg.hw_ns);
+        }
+    }
+#endif
+}
+
+void Socket::onZeroCopyNotify(uint32_t lo, uint32_t hi, bool copied)
+{
+    uint32_t sends = hi - lo + 1;
+    _zc_sends += sends;
+    if (copied) {
+        _zc_copied += sends;
+    }
+
+    // tcp的完成通知按序号顺序到达
+    std::lock_guard<std::mutex> lck(_mtx_zc);
+    if ((int32_t)(hi + 1 - _zc_done_id) > 0) {
+        _zc_done_id = hi + 1;
+    }
+    while (!_zc_pending.empty() && (int32_t)(_zc_pending.front().first - _zc_done_id) < 0) {
+        _zc_pending.pop_front();
+    }
+}
+
+void Socket::resetZeroCopy_l()
+{
+    _zc_state = -1;// 新fd需要重新设置SO_ZEROCOPY
+    _zc_next_id = 0;
+
+    decltype(_zc_pending) pending;
+    {
+        std::lock_guard<std::mutex> lck(_mtx_zc);
+        _zc_done_id = 0;
+        pending.swap(_zc_pending);
+    }
+    // 锁外释放，BufferRing等待中的发送线程可以复用这些buf
+}
+
+void Socket::getZeroCopyStat(uint64_t &sends, uint64_t &copied)
+{
+    sends = _zc_sends;
+    copied = _zc_copied;
+}
+
+void Socket::onTxStamp(uint32_t type, uint32_t key, uint64_t sw_ns, uint64_t hw_ns)
+{
+#if defined(HAS_SO_TIMESTAMPING)
+    if (_tx_stamps.empty()) {
+        return;
+    }
+    auto &slot = _tx_stamps[key % _tx_stamps.size()];
+    if (slot.key != key) {
+        // 槽被更早的发送占用，或该次发送的时间戳丢失，重新开始
+        slot = TxStamp();
+        slot.key = key;
+    }
 
-            _send_speed += _snd_bytes;
-            return _snd_bytes;
+    if (type == SCM_TSTAMP_SCHED) {
+        slot.sched = sw_ns;
+    } else if (type == SCM_TSTAMP_SND) {
+        // 软件和硬件SND时间戳分两个消息返回，软件的先到
+        if (sw_ns) {
+            slot.snd = sw_ns;
+            if (slot.sched && sw_ns >= slot.sched) {
+                _tx_stack.record((sw_ns - slot.sched) / 1000);
+            }
         }
+        if (hw_ns && slot.snd && hw_ns >= slot.snd) {
+            _tx_wire.record((hw_ns - slot.snd) / 1000);
+        }
+    }
+#endif //HAS_SO_TIMESTAMPING
+}
+
+void Socket::recordRxStamp(uint64_t sw_ns, uint64_t hw_ns, uint64_t now_ns)
+{
+    if (sw_ns == 0) {
+        return;
+    }
+    if (now_ns >= sw_ns) {
+        _rx_stack.record((now_ns - sw_ns) / 1000);
+    }
+    // 硬件时间戳是网卡时钟，需要与系统时钟同步(如phc2sys)差值才有意义
+    if (hw_ns && sw_ns >= hw_ns) {
+        _rx_wire.record((sw_ns - hw_ns) / 1000);
+    }
+}
+
+Socket::StampStat Socket::getStampStat() const
+{
+    StampStat stat;
+    stat.rx_wire = _rx_wire.snapshot();
+    stat.rx_stack = _rx_stack.snapshot();
+    stat.rx_app = _rx_app.snapshot();
+    stat.tx_stack = _tx_stack.snapshot();
+    stat.tx_wire = _tx_wire.snapshot();
+    return stat;
+}
+
+std::string Socket::StampStat::toString() const
+{
+    return "rx wire:" + rx_wire.toString() + ",stack:" + rx_stack.toString() + ",app:" + rx_app.toString()
+        + " tx stack:" + tx_stack.toString() + ",wire:" + tx_wire.toString();
+}
+
+uint32_t Socket::send_l(char* buff, uint32_t len, bool give_up_owner)
+{
+    if (len == 0 || buff == nullptr) {
+        return 0;
+    }
+
+    Buffer::Ptr buf;
+    if (give_up_owner) {
+        buf = std::make_shared<Buffer>(buff, len, len, true);
     } else {
-        PrintE("send able is false.");
+        buf = std::make_shared<Buffer>();
+        if (buf->SetCapacity(len) == chw::fail) {
+            return 0;
+        }
+        _RAM_CPY_(buf->data(), len, buff, len);
+        buf->SetSize(len);
+    }
+
+    return send_l(buf);
+}
+
+uint32_t Socket::send_l(const Buffer::Ptr &buf)
+{
+    if (!buf || buf->Size() == 0) {
         return 0;
     }
+    uint32_t len = buf->Size();
 
-    return 0;
+    SockNum::Ptr sock;
+    {
+        LOCK_GUARD(_mtx_sock_fd);
+        if (!_sock_fd) {
+            PrintE("socket is null.");
+            return 0;
+        }
+        sock = _sock_fd->sockNum();
+    }
+    if (sock->type() != SockNum::Sock_TCP && sock->type() != SockNum::Sock_UDP) {
+        PrintE("send_l only support tcp and udp.");
+        return 0;
+    }
+
+    bool post = false;
+    bool delay = false;
+    {
+        LOCK_GUARD(_mtx_send_list);
+        if (_send_list_bytes + len > _max_list_bytes) {
+            ErrorL << "send list full, bytes=" << _send_list_bytes << ",max=" << _max_list_bytes << ",fd=" << sock->rawFd();
+            return 0;
+        }
+        if (_send_list.empty()) {
+            _send_flush_ticker.resetTime();
+        }
+        _send_list.emplace_back(buf);
+        _send_list_bytes += len;
+        if (!_send_list_posted) {
+            if (_send_list.size() >= _batch_l || _send_list_bytes >= TCP_BUFFER_SIZE) {
+                // 攒够一批，立即发送
+                _send_list_posted = true;
+                post = true;
+            } else if (!_send_list_delayed) {
+                // 不足一批，延时发送，期间入队的消息一起发送
+                _send_list_delayed = true;
+                delay = true;
+            }
+        }
+    }
+
+    if (!_sendable && _send_flush_ticker.elapsedTime() > _max_send_buffer_ms) {
+        // 等待可写事件超时，对端可能已经不再接收
+        emitErr(SockException(Err_other, "socket send timeout"));
+        return 0;
+    }
+
+    weak_ptr<Socket> weak_self = shared_from_this();
+    if (post) {
+        // 投递到poller线程发送，任务执行前入队的消息一起发送
+        _poller->async([weak_self, sock]() {
+            if (auto strong_self = weak_self.lock()) {
+                strong_self->flush_l(sock);
+            }
+        }, false);
+    }
+    if (delay) {
+        _poller->doDelayTask(SEND_LIST_DELAY_MS, [weak_self, sock]() -> uint64_t {
+            if (auto strong_self = weak_self.lock()) {
+                {
+                    LOCK_GUARD(strong_self->_mtx_send_list);
+                    strong_self->_send_list_delayed = false;
+                }
+                strong_self->flush_l(sock);
+            }
+            return 0;
+        });
+    }
+
+    return len;
+}
+
+void Socket::flush_l(const SockNum::Ptr &sock)
+{
+    {
+        LOCK_GUARD(_mtx_sock_fd);
+        if (!_sock_fd || _sock_fd->sockNum() != sock) {
+            // socket已关闭或已更换
+            return;
+        }
+    }
+
+    LOCK_GUARD(_mtx_send_list);
+    while (!_send_list.empty()) {
+        ssize_t n = flush_l_once(sock);
+        if (n > 0) {
+            _send_speed += n;
+            _send_flush_ticker.resetTime();
+            continue;
+        }
+
+        int err = get_uv_error(true);
+        if (err == UV_EINTR) {
+            continue;
+        }
+        if (err == UV_EAGAIN) {
+            // socket发送缓存满了，等待可写事件
+            if (_sendable) {
+                startWriteAbleEvent(sock);
+            }
+            return;
+        }
+
+        if (sock->type() != SockNum::Sock_TCP) {
+            // udp/raw发送异常，把数据丢弃
+            WarnL << "send list udp failed, data ignored: " << uv_strerror(err) << ",fd=" << sock->rawFd();
+            _send_list_bytes -= _send_list.front()->Size();
+            _send_list.pop_front();
+            continue;
+        }
+        // tcp发送失败时，触发异常
+        emitErr(toSockException(err));
+        return;
+    }
+
+    _send_list_posted = false;
+    if (!_sendable) {
+        stopWriteAbleEvent(sock);
+        // 等待可写期间排队的数据已发完，通知发送者
+        onFlushed();
+    }
+}
+
+ssize_t Socket::flush_l_once(const SockNum::Ptr &sock)
+{
+    size_t count = std::min<size_t>(_send_list.size(), IOV_MAX);
+    ssize_t n = -1;
+
+    if (sock->type() == SockNum::Sock_TCP) {
+#if !defined(_WIN32)
+        _iov_l.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            auto &buf = _send_list[i];
+            size_t offset = i == 0 ? _send_list_offset : 0;
+            _iov_l[i].iov_base = (char *)buf->data() + offset;
+            _iov_l[i].iov_len = buf->Size() - offset;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = _iov_l.data();
+        msg.msg_iovlen = count;
+        n = sendmsg(sock->rawFd(), &msg, _sock_flags);
+#else
+        auto &front = _send_list.front();
+        n = ::send(sock->rawFd(), (char *)front->data() + _send_list_offset, front->Size() - _send_list_offset, _sock_flags);
+#endif //!_WIN32
+        if (n <= 0) {
+            return -1;
+        }
+
+        // 移除已经发送完的Buffer，部分发送的记录偏移
+        size_t left = n;
+        while (left > 0) {
+            size_t remain = _send_list.front()->Size() - _send_list_offset;
+            if (left < remain) {
+                _send_list_offset += left;
+                break;
+            }
+            left -= remain;
+            _send_list_offset = 0;
+            _send_list.pop_front();
+        }
+        _send_list_bytes -= n;
+        return n;
+    }
+
+    // send_addr排队的消息带有自己的目的地址
+    struct sockaddr *addr = _udp_send_dst ? (struct sockaddr *)_udp_send_dst.get() : (struct sockaddr *)&_peer_addr;
+    socklen_t addr_len = SockUtil::get_sock_len(addr);
+#if defined(HAS_SENDMMSG)
+    _iov_l.resize(count);
+    _hdr_l.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        auto &buf = _send_list[i];
+        _iov_l[i].iov_base = buf->data();
+        _iov_l[i].iov_len = buf->Size();
+
+        memset(&_hdr_l[i], 0, sizeof(struct mmsghdr));
+        auto &msg = _hdr_l[i].msg_hdr;
+        msg.msg_name = buf.dst ? (void *)buf.dst.get() : (void *)addr;
+        msg.msg_namelen = buf.dst ? buf.dst_len : addr_len;
+        msg.msg_iov = &_iov_l[i];
+        msg.msg_iovlen = 1;
+    }
+
+    int sent = sendmmsg(sock->rawFd(), _hdr_l.data(), count, _sock_flags);
+    if (sent <= 0) {
+        return -1;
+    }
+    n = 0;
+    for (int i = 0; i < sent; ++i) {
+        n += _send_list.front()->Size();
+        _send_list.pop_front();
+    }
+#else
+    auto &front = _send_list.front();
+    n = ::sendto(sock->rawFd(), (char *)front->data(), front->Size(), _sock_flags,
+                 front.dst ? (struct sockaddr *)front.dst.get() : addr, front.dst ? front.dst_len : addr_len);
+    if (n < 0) {
+        return -1;
+    }
+    n = front->Size();
+    _send_list.pop_front();
+#endif //HAS_SENDMMSG
+    _send_list_bytes -= n;
+    return n;
 }
 
 /**
@@ -1130,8 +2326,23 @@ uint32_t Socket::send_addr(char* buff, uint32_t len, struct sockaddr* addr, int3
  */
 uint32_t Socket::send_b(char* buff, uint32_t len)
 {
+    if (_send_owner != std::thread::id()) {
+        if (_poller->isCurrentThread()) {
+            // timer_b也在poller线程执行，不需要加锁
+            return send_b_l(buff, len);
+        }
+        // 发送缓存只在poller线程访问，包括不是poller的发送线程
+        return forwardSend(buff, len, [](const Socket::Ptr &sock, const Buffer::Ptr &buf) {
+            sock->send_b((char *)buf->data(), buf->Size());
+        }, true) ? chw::success : chw::fail;
+    }
+
     LOCK_GUARD(_mtx_sock_fd);
+    return send_b_l(buff, len);
+}
 
+uint32_t Socket::send_b_l(char* buff, uint32_t len)
+{
     if (!_SndBuffer)
     {
         _SndBuffer = std::make_shared<Buffer>();
@@ -11,6 +11,8 @@
 #include <sstream>
 #include <functional>
 #include <string>
+#include <deque>
+#include <thread>
 #include "SpeedStatistic.h"
 #include "SocketBase.h"
 #include "Timer.h"
@@ -263,7 +265,8 @@ public:
     using Ptr = std::shared_ptr<Socket>;
     //接收数据回调
     using onReadCB = std::function<void(Buffer::Ptr &buf, struct sockaddr *addr, int addr_len)>;
-    // using onMultiReadCB = std::function<void(Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count)>;
+    //批量接收数据回调，recvmmsg一次收到的多个包一起回调
+    using onMultiReadCB = std::function<void(Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count)>;
 
     //发生错误回调
     using onErrCB = std::function<void(const SockException &err)>;
@@ -284,6 +287,46 @@ public:
     static Ptr createSocket(const EventLoop::Ptr &poller, bool enable_mutex = true);
     ~Socket();
 
+    /**
+     * 设置之后加入poller的socket的SO_BUSY_POLL时长(--sock-busy-poll)，0为不设置
+     * @param us 自旋时长，微秒
+     */
+    static void setBusyPoll(uint32_t us);
+
+    /**
+     * 设置socket每次可读事件的读取配额(--read-budget)，用完后剩余数据排队到下一轮读取
+     * @param count 最多读取次数，0为不限
+     * @param bytes 最多读取字节数，0为不限
+     */
+    static void setReadBudget(uint32_t count, uint64_t bytes);
+
+    /**
+     * 设置udp和raw socket每次recvmmsg最多接收的包数(--recv-batch)，1为逐包recvfrom
+     * @param count 包数
+     */
+    static void setRecvBatch(uint32_t count);
+
+    /**
+     * 设置之后加入poller的udp socket是否开启UDP GRO(--gro)，收到的合并包通过Buffer::SegSize拆分
+     * @param on 是否开启
+     */
+    static void setUdpGro(bool on);
+
+    /**
+     * 设置之后加入poller的tcp/udp socket是否开启SO_TIMESTAMPING(--timestamp)
+     * 读回调的Buffer通过StampSw/StampHw获取接收时间戳，发送时间戳从错误队列读取，都汇总到 getStampStat
+     * @param on 是否开启
+     */
+    static void setTimestamping(bool on);
+
+    /**
+     * 设置是否使用poller线程共享的读缓存，适用于在回调中同步处理完数据的socket（如压测统计）
+     * 回调返回时缓存中还有数据（如粘包处理保留的半包），自动改回私有缓存
+     * 不使用共享缓存时，tcp私有读缓存按接收量在SOCK_RECV_BUF_MIN和TCP_BUFFER_SIZE之间伸缩
+     * @param on 是否使用共享缓存
+     */
+    void setSharedRecvBuffer(bool on);
+
     /**
      * 创建tcp客户端并异步连接服务器
      * @param url 目标服务器ip或域名
@@ -327,6 +370,14 @@ public:
      */
     bool cloneSocket(const Socket &other);
 
+    /**
+     * 共享另外一个Socket的fd，只用于发送，不监听事件，本对象关闭或释放时不影响原Socket
+     * 用于udp服务端单socket模式，会话通过服务端Socket发送，配合bindPeerAddr软绑定对端地址
+     * @param other 原始的socket对象
+     * @return 是否成功
+     */
+    bool shareSock(const Socket &other);
+
     ////////////设置事件回调////////////
 
     /**
@@ -334,7 +385,12 @@ public:
      * @param cb 回调对象
      */
     void setOnRead(onReadCB cb);
-    // void setOnMultiRead(onMultiReadCB cb);
+
+    /**
+     * 设置批量数据接收回调，与setOnRead二选一，后设置的生效
+     * @param cb 回调对象
+     */
+    void setOnMultiRead(onMultiReadCB cb);
 
     /**
      * 设置异常事件(包括eof等)回调
@@ -348,12 +404,12 @@ public:
      */
     void setOnAccept(onAcceptCB cb);
 
-    // /**
-    //  * 设置socket写缓存清空事件回调
-    //  * 通过该回调可以实现发送流控
-    //  * @param cb 回调对象
-    //  */
-    // void setOnFlush(onFlush cb);
+    /**
+     * 设置socket写缓存清空事件回调
+     * 通过该回调可以实现发送流控
+     * @param cb 回调对象，返回false时不再回调
+     */
+    void setOnFlush(onFlush cb);
 
     /**
      * 设置accept时，socket构造事件回调
@@ -504,6 +560,12 @@ public:
     //获取标识符
     std::string getIdentifier() const;
 
+    /**
+     * 获取tcp连接状态(TCP_INFO)，非tcp或未连接时返回-1
+     * @param info [out]连接状态
+     */
+    int getTcpInfo(SockUtil::TcpInfo &info);
+
 private:
     /**
      * @brief Socket私有构造函数，只能通过静态方法 createSocket 创建
@@ -535,6 +597,12 @@ private:
      */
     ssize_t onRead(const SockNum::Ptr &sock/*, const SocketRecvBuffer::Ptr &buffer*/) noexcept;
 
+    /**
+     * @brief 读取配额用完时，把剩余数据的读取投递到轮询线程的任务队列
+     * @param sock [in]fd
+     */
+    void deferRead(const SockNum::Ptr &sock);
+
     /**
      * @brief epoll可写事件回调
      * 
@@ -549,7 +617,11 @@ private:
      * @param cb    回调
      */
     void onConnected(const SockNum::Ptr &sock, const onErrCB &cb);
-    // void onFlushed();
+
+    /**
+     * @brief 等待可写事件期间排队的数据已全部发出，触发写缓存清空回调
+     */
+    void onFlushed();
 
     /**
      * @brief 开始监听socket可写事件
@@ -608,6 +680,20 @@ private:
     std::atomic<bool> _sendable { true };
     // 是否已经触发err回调了
     bool _err_emit = false;
+    // 读取配额用完，已投递下一轮读取任务
+    bool _read_pending = false;
+    // 已开启UDP GRO，需要用recvmmsg读取合并包
+    bool _udp_gro = false;
+    // fd与其他Socket共享(shareSock)，只发送不监听事件
+    bool _shared_sock = false;
+    // 已开启SO_TIMESTAMPING，需要用recvmsg/recvmmsg读取接收时间戳
+    bool _timestamping = false;
+    // 使用poller线程共享的读缓存
+    bool _shared_recv = false;
+    // 连续读取量不足私有读缓存1/4的次数，达到SOCK_RECV_SHRINK_TIMES后缩小缓存
+    uint32_t _recv_small_times = 0;
+    // 私有读缓存的大小，读缓存被上层Detach后按此大小重新分配
+    size_t _recv_buf_size = 0;
     // 是否启用网速统计
     bool _enable_speed = false;
     // udp发送目标地址
@@ -635,7 +721,7 @@ private:
     // socket异常事件(比如说断开)
     onErrCB _on_err;
     // 收到数据事件
-    // onMultiReadCB _on_multi_read;
+    onMultiReadCB _on_multi_read;
     // socket缓存清空事件(可用于发送流速控制)
     onFlush _on_flush;
     // tcp监听收到accept请求事件
@@ -672,7 +758,6 @@ public:
     }SEND_TYPE;
 private:
     SEND_TYPE _snd_type;
-    onReadCB _on_read;
 public:
     /**
      * 触发onErr事件
@@ -694,6 +779,16 @@ public:
      */
     void SetSndType(SEND_TYPE type);
 
+    /**
+     * @brief 指定唯一的发送线程，该线程调用 send_i/send_addr 时不加锁
+     * 其他线程的发送拷贝数据后转发给发送线程：发送线程是poller线程时投递到poller，否则放入转发队列，由发送线程下次发送时执行
+     * send_b 绑定后总是在poller线程不加锁执行，因为 timer_b 也在poller线程访问发送缓存，其他线程调用时拷贝后投递到poller
+     * 不要和 send_l 混用，需要在开始发送前设置，发送线程结束发送后取消绑定，取消时执行转发队列中剩余的发送
+     * 
+     * @param owner [in]发送线程id，默认值取消绑定，恢复加锁发送
+     */
+    void setSendOwner(const std::thread::id &owner = std::thread::id());
+
     /**
      * @brief 不缓存，立刻同步发送数据；失败时丢弃数据，并建议上层断开重联
      * tcp:发送失败会阻塞尝试一定次数重发
@@ -719,6 +814,250 @@ public:
      */
     uint32_t send_addr(char* buff, uint32_t len, struct sockaddr* addr, int32_t socklen);
 
+private:
+    /**
+     * @brief 加锁发送，见 send_i，socket发送缓存满时剩余数据放入发送队列，不阻塞
+     * 
+     * @param dst     [in]udp/raw目的地址，nullptr时发往绑定的对端地址，随排队的数据一起保存
+     * @param dst_len [in]目的地址长度
+     */
+    uint32_t send_i_l(char* buff, uint32_t len, const struct sockaddr *dst = nullptr, socklen_t dst_len = 0);
+
+    /**
+     * @brief 把buf中offset开始的数据放入发送队列，不拷贝，启动可写监听由poller线程发送，调用者持有 _mtx_send_list
+     * offset只用于tcp部分发送后的剩余数据，此时队列为空
+     * 
+     * @param sock    [in]fd
+     * @param buf     [in]数据，发送完成前被Socket持有
+     * @param offset  [in]已经发送的长度
+     * @param dst     [in]udp/raw目的地址，nullptr时发往绑定的对端地址
+     * @param dst_len [in]目的地址长度
+     * @return bool 是否放入，队列超过 _max_list_bytes、等待可写超时或共享fd时返回false
+     */
+    bool queueSend_l(const SockNum::Ptr &sock, const Buffer::Ptr &buf, size_t offset = 0, const struct sockaddr *dst = nullptr, socklen_t dst_len = 0);
+
+    // 同 queueSend_l ，先把数据拷贝到新的Buffer
+    bool queueCopy_l(const SockNum::Ptr &sock, const char *data, size_t len, const struct sockaddr *dst = nullptr, socklen_t dst_len = 0);
+
+    /**
+     * @brief 发送线程获取fd，fd变化时才加锁更新；发送线程持有fd的引用，关闭的fd在发送线程更新时才释放
+     */
+    const SockNum::Ptr &ownerSock();
+
+    /**
+     * @brief 发送线程不加锁发送，socket发送缓存满或有数据等待可写事件时停止，剩余数据由加锁发送排队
+     * 
+     * @param buff [in]数据
+     * @param len  [in]数据长度
+     * @param sent [out]已发送的长度
+     * @param dst     [in]udp/raw目的地址，nullptr时发往绑定的对端地址
+     * @param dst_len [in]目的地址长度
+     * @return bool true发送结束(全部发送或出错)，false剩余数据需要加锁发送
+     */
+    bool sendOwner(char* buff, uint32_t len, uint32_t &sent, const struct sockaddr *dst = nullptr, socklen_t dst_len = 0);
+
+    /**
+     * @brief 非发送线程的发送，拷贝数据后转发给发送线程执行，见 setSendOwner
+     * 
+     * @param buff [in]数据
+     * @param len  [in]数据长度
+     * @param send [in]发送线程执行的发送
+     * @param to_poller [in]true总是投递到poller线程(send_b)
+     * @return uint32_t 转发成功返回len，失败返回0
+     */
+    uint32_t forwardSend(char* buff, uint32_t len, const std::function<void(const Socket::Ptr &, const Buffer::Ptr &)> &send, bool to_poller = false);
+
+    // 发送线程执行其他线程转发的发送
+    void runForwarded();
+
+    std::thread::id _send_owner;// 唯一发送线程，默认值表示未绑定
+    std::mutex _mtx_forward;
+    std::deque<std::function<void()>> _forward_list;// 转发给非poller发送线程的发送
+    std::atomic<bool> _forward_pending{false};// _forward_list 是否非空，发送线程不加锁检查
+    SockNum::Ptr _owner_sock;// 发送线程缓存的fd，只在发送线程访问
+    uint32_t _owner_gen = 0;// _owner_sock 对应的 _sock_gen，只在发送线程访问
+    std::atomic<uint32_t> _sock_gen{1};// _sock_fd 变化时加1，持有 _mtx_sock_fd 时修改
+public:
+
+///////////////////////////////////////send_m///////////////////////////////////////
+    /**
+     * @brief udp批量发送，先把数据包拷贝到批量缓存，攒够 _batch_m 个包后执行一次sendmmsg，仅用于udp
+     * 每个包单独拷贝，调用者可以在两次调用之间修改buff(如序列号)
+     * 不支持sendmmsg的平台逐包sendto
+     * 注意：返回成功表示数据已经放入批量缓存，不代表已经发送，结束发送时需要执行 flush_m
+     * 发送缓存满时剩余的包放入发送队列，发送队列也满时留在批量缓存，批量缓存满了之前不再接收新的包
+     * 
+     * @param buff  [in]数据
+     * @param len   [in]数据长度
+     * @return uint32_t 成功返回len，失败返回0
+     */
+    uint32_t send_m(char* buff, uint32_t len);
+
+    /**
+     * @brief 立即发送批量缓存中的数据包
+     * 
+     * @return uint32_t 全部发出或放入发送队列返回chw::success，还有包留在批量缓存返回chw::fail
+     */
+    uint32_t flush_m();
+
+    // 设置 _batch_m ，每次sendmmsg发送的包数
+    void SetBatchM(uint32_t batch) {_batch_m = batch ? batch : 1;}
+private:
+    // 执行批量发送，需要已经持有 _mtx_sock_fd
+    uint32_t flush_m_l();
+
+    std::vector<char> _buf_m;// send_m 批量缓存，数据包首尾相连
+    std::vector<uint32_t> _len_m;// 批量缓存中每个包的长度
+#if defined(HAS_SENDMMSG)
+    std::vector<struct iovec> _iov_m;
+    std::vector<struct mmsghdr> _hdr_m;
+#endif //HAS_SENDMMSG
+    uint32_t _batch_m = 1;// 攒够多少个包执行一次发送
+public:
+///////////////////////////////////////send_m///////////////////////////////////////
+
+///////////////////////////////////////send_g///////////////////////////////////////
+    /**
+     * @brief udp GSO发送，buff中是首尾相连的等长udp包，一次sendmsg带UDP_SEGMENT由内核分段，仅用于udp
+     * 内核或网卡不支持时退回逐包发送(sendmmsg或sendto)，之后不再尝试GSO
+     * 
+     * @param buff      [in]数据，多个udp包首尾相连
+     * @param len       [in]数据总长度，不超过 UDP_GSO_MAX_SIZE
+     * @param seg_size  [in]每个udp包长度，最后一个包可以更短
+     * @return uint32_t 发送成功的数据长度
+     */
+    uint32_t send_g(char* buff, uint32_t len, uint32_t seg_size);
+
+    /**
+     * @brief 是否使用UDP GSO发送，首次调用时检测内核是否支持
+     */
+    bool gsoEnabled();
+private:
+    // 逐包发送buff中首尾相连的udp包，GSO不可用时使用，需要已经持有 _mtx_sock_fd
+    uint32_t send_segments_l(char* buff, uint32_t len, uint32_t seg_size, struct sockaddr *addr, socklen_t addr_len);
+
+    int _gso_state = -1;// UDP GSO是否可用，-1未检测，0不可用，1可用
+public:
+///////////////////////////////////////send_g///////////////////////////////////////
+
+///////////////////////////////////////send_z///////////////////////////////////////
+    /**
+     * @brief tcp零拷贝发送(MSG_ZEROCOPY)，内核直接引用buf的内存，不拷贝到socket发送缓存，仅用于tcp
+     * 发送后Socket持有buf，poller线程从错误队列读到完成通知后才释放，调用者在 buf.use_count()==1 时才能复用buf
+     * 内核不支持时退回 send_tcp_data 拷贝发送，返回时buf已经可以复用
+     * 
+     * @param buf   [in]数据，发送 buf->data() 开始的 buf->Size() 字节
+     * @return uint32_t 发送成功的数据长度
+     */
+    uint32_t send_z(const Buffer::Ptr &buf);
+
+    /**
+     * @brief 是否使用零拷贝发送，首次调用时开启SO_ZEROCOPY
+     */
+    bool zerocopyEnabled();
+
+    /**
+     * @brief 获取零拷贝完成通知统计
+     * 
+     * @param sends  [out]已完成的零拷贝send次数
+     * @param copied [out]其中内核退回拷贝发送的次数(回环网卡或网卡不支持scatter-gather)
+     */
+    void getZeroCopyStat(uint64_t &sends, uint64_t &copied);
+private:
+    /**
+     * @brief 处理零拷贝完成通知，序号[lo,hi]的send已完成，释放已完成的buf，poller线程执行
+     * 
+     * @param lo     [in]完成的起始序号
+     * @param hi     [in]完成的结束序号
+     * @param copied [in]内核是否退回了拷贝发送
+     */
+    void onZeroCopyNotify(uint32_t lo, uint32_t hi, bool copied);
+
+    /**
+     * @brief fd关闭或更换时重置零拷贝状态，释放等待完成通知的buf，关闭的fd不会再有完成通知，调用者持有 _mtx_sock_fd
+     */
+    void resetZeroCopy_l();
+
+    std::atomic<int> _zc_state { -1 };// 零拷贝是否可用，-1未检测，0不可用，1可用，poller线程也会读取
+    uint32_t _zc_next_id = 0;// 下一次零拷贝send的通知序号，和内核计数一致，受 _mtx_sock_fd 保护
+    uint32_t _zc_done_id = 0;// 该序号之前的send都已完成，受 _mtx_zc 保护
+    std::deque<std::pair<uint32_t, Buffer::Ptr>> _zc_pending;// 等待完成通知的buf及其最后一次send的序号，受 _mtx_zc 保护
+    std::mutex _mtx_zc;// 发送线程和poller线程访问 _zc_pending 的锁，不能用 _mtx_sock_fd，发送等待时poller线程要能释放buf
+    std::atomic<uint64_t> _zc_sends { 0 };// 已完成的零拷贝send次数
+    std::atomic<uint64_t> _zc_copied { 0 };// 内核退回拷贝发送的次数
+public:
+///////////////////////////////////////send_z///////////////////////////////////////
+
+///////////////////////////////////////timestamping///////////////////////////////////////
+    // SO_TIMESTAMPING统计的收发各阶段耗时，微秒
+    struct StampStat {
+        LatencyHistogram::Snapshot rx_wire;// 网卡硬件接收到内核软件接收，需要网卡已开启硬件时间戳且网卡时钟与系统时钟同步
+        LatencyHistogram::Snapshot rx_stack;// 内核软件接收到应用读取
+        LatencyHistogram::Snapshot rx_app;// 应用读回调处理耗时
+        LatencyHistogram::Snapshot tx_stack;// 进入发送队列(SCHED)到交给网卡驱动(SND)
+        LatencyHistogram::Snapshot tx_wire;// 交给网卡驱动到网卡硬件发送
+
+        StampStat &operator+=(const StampStat &other) {
+            rx_wire += other.rx_wire;
+            rx_stack += other.rx_stack;
+            rx_app += other.rx_app;
+            tx_stack += other.tx_stack;
+            tx_wire += other.tx_wire;
+            return *this;
+        }
+
+        /**
+         * @brief 格式化为"rx wire:-,stack:p50/p99/max,app:p50/p99/max tx stack:p50/p99/max,wire:-"
+         */
+        std::string toString() const;
+    };
+
+    /**
+     * @brief 获取收发时间戳统计（任意线程执行），未开启时各项没有样本
+     */
+    StampStat getStampStat() const;
+private:
+    /**
+     * @brief 读完错误队列，分发零拷贝完成通知和发送时间戳，poller线程执行
+     * 
+     * @param sock [in]fd
+     */
+    void onErrQueue(const SockNum::Ptr &sock);
+
+    /**
+     * @brief 处理一个发送时间戳，按OPT_ID序号关联同一次发送的各阶段时间戳，poller线程执行
+     * 
+     * @param type  [in]时间戳类型，SCM_TSTAMP_SCHED或SCM_TSTAMP_SND
+     * @param key   [in]OPT_ID序号，udp为发送次数，tcp为字节序号
+     * @param sw_ns [in]软件时间戳，纳秒
+     * @param hw_ns [in]硬件时间戳，纳秒
+     */
+    void onTxStamp(uint32_t type, uint32_t key, uint64_t sw_ns, uint64_t hw_ns);
+
+    /**
+     * @brief 记录一次读取的接收时间戳，poller线程执行
+     * 
+     * @param sw_ns  [in]软件时间戳，纳秒，0表示没有
+     * @param hw_ns  [in]硬件时间戳，纳秒，0表示没有
+     * @param now_ns [in]应用读取时间，纳秒
+     */
+    void recordRxStamp(uint64_t sw_ns, uint64_t hw_ns, uint64_t now_ns);
+
+    // 一次发送的各阶段时间戳
+    struct TxStamp {
+        uint32_t key = 0;
+        uint64_t sched = 0;
+        uint64_t snd = 0;
+    };
+    std::vector<TxStamp> _tx_stamps;// 按OPT_ID序号取模保存，SOCK_TX_STAMP_SLOTS个，poller线程访问
+    LatencyHistogram _rx_wire;
+    LatencyHistogram _rx_stack;
+    LatencyHistogram _rx_app;
+    LatencyHistogram _tx_stack;
+    LatencyHistogram _tx_wire;
+public:
+///////////////////////////////////////timestamping///////////////////////////////////////
+
 ///////////////////////////////////////send_b///////////////////////////////////////
     /**
      * @brief 先把数据拷贝到_SndBuffer，_SndBuffer足够大时执行系统调用send，适合小包较多的数据，并用定时器周期fulsh小包数据，仅用于tcp
@@ -752,6 +1091,9 @@ public:
     // 设置 _max_bufsize_b 、 _flush_b_times 、 _snd_timeout_b
     void SetBuffB(uint32_t size, uint32_t times, double timeout) {_max_bufsize_b = size;_flush_b_times = times;_snd_timeout_b = timeout;}
 private:
+    // send_b 的实现，需要已经持有 _mtx_sock_fd 或在poller线程执行
+    uint32_t send_b_l(char* buff, uint32_t len);
+
     Buffer::Ptr _SndBuffer;//send_b 的应用层发送缓存区
     uint32_t _max_bufsize_b = 128<<20;//_SndBuffer 允许扩容最大值，当前buf大小低于该值则允许扩容，防止无限制扩容导致分配失败
     Ticker _snd_ticker_b;//距离上一次执行flush_b时长
@@ -760,27 +1102,89 @@ private:
     double _snd_timeout_b = 1;// _snd_timer_b 超时时长，单位秒
 ///////////////////////////////////////send_b///////////////////////////////////////
 
-    // todo:发送失败时监听可写事件，没有发送成功的先放入缓存，可写时再发送（一直发送失败会出现大量缓存积压，不利于业务快速反映）
+public:
+///////////////////////////////////////send_l///////////////////////////////////////
     // _max_send_buffer_ms/_send_flush_ticker 控制一直发送失败的超时
     /**
      * 关于写事件，适用与 send_l
-     * 1、刚刚连接成功的tcp客户端是监听写事件的。
-     * 2、外部调用send时，如果部分发送成功或等待重发，则启动写监听。
-     * 3、如果监听到可写事件，有缓存数据则内部调用send，没有则停止监听。
-     * 4、内部调用send时，如果发送缓存清空了，则停止写监听。
-     * 5、发送需要获取锁，send由外部线程调用，如果有剩余没有发送的数据，则是由epoll线程触发发送。
-     * 6、使用写事件控制发送时，在高数据量情况下，容易导致应用层发送缓存太大，没有不监听写事件的发送效率高。
+     * 1、外部调用send_l只把Buffer放入 _send_list，攒够 _batch_l 个消息或 TCP_BUFFER_SIZE 字节时投递flush任务到poller线程，
+     *    不足时延时 SEND_LIST_DELAY_MS 毫秒发送，任务执行前入队的消息一起发送。
+     * 2、poller线程发送时，如果socket发送缓存满了，则启动写监听。
+     * 3、如果监听到可写事件，有缓存数据则继续发送，发送完则停止写监听。
+     * 4、tcp用sendmsg一次发送最多 IOV_MAX 个Buffer，udp用sendmmsg一次发送最多 IOV_MAX 个包，每个Buffer是一个udp包。
+     * 5、超过 _max_send_buffer_ms 没有发送出任何数据，触发onErr事件。
      */
     /**
-     * @brief 先把数据Buffer放入一个list，当epoll不可写时暂时挂起，不阻塞线程，最接近原flushData方案
-     * epoll可写时执行发送，不可写时暂停发送，需要设置发送失败超时时长
-     * todo:可设置buff是否托管，托管则无需拷贝直接放入list，不托管则拷贝到新Buffer后放入一个list，均在发送完成后释放
+     * @brief 把数据Buffer放入发送队列，不拷贝，由poller线程批量发送，不阻塞调用线程，适用tcp和udp
+     * Buffer在发送完成前被Socket持有，调用者在 buf.use_count()==1 时才能修改或复用
+     * 注意：返回成功表示数据已经放入发送队列，不代表已经发送
      * 
-     * @param buff  数据
-     * @param len   数据长度
-     * @return uint32_t 发送成功的数据长度
+     * @param buf   [in]数据，发送 data() 开始的 Size() 字节
+     * @return uint32_t 成功返回数据长度，socket无效或发送队列超过 _max_list_bytes 返回0
+     */
+    uint32_t send_l(const Buffer::Ptr &buf);
+
+    /**
+     * @brief 同上，give_up_owner为true时托管buff，无需拷贝直接放入发送队列，发送完成后用_RAM_DEL_释放；false时拷贝到新Buffer
+     * 
+     * @param buff  [in]数据，托管时必须是_RAM_NEW_分配的
+     * @param len   [in]数据长度
+     * @param give_up_owner [in]是否托管buff
+     * @return uint32_t 成功返回数据长度，失败返回0，失败时托管的buff也已释放
+     */
+    uint32_t send_l(char* buff, uint32_t len, bool give_up_owner);
+
+    /**
+     * @brief 获取发送队列中还没有发送的字节数
+     */
+    uint64_t getSendListBytes() const {return _send_list_bytes;}
+
+    // 设置 _max_list_bytes ，发送队列允许积压的最大字节数
+    void SetListMax(uint64_t bytes) {_max_list_bytes = bytes;}
+
+    // 设置 _batch_l ，发送队列攒够多少个消息立即发送
+    void SetBatchL(uint32_t batch) {_batch_l = batch ? batch : 1;}
+private:
+    /**
+     * @brief 发送 _send_list 中的数据，直到发送完或者socket发送缓存满，poller线程执行
+     * 
+     * @param sock [in]fd
      */
-    uint32_t send_l(char* buff, uint32_t len, bool give_up_owner){return 0;};
+    void flush_l(const SockNum::Ptr &sock);
+
+    /**
+     * @brief 执行一次系统调用发送队首的多个Buffer，需要已经持有 _mtx_send_list
+     * 
+     * @param sock [in]fd
+     * @return ssize_t 发送的字节数，出错返回-1
+     */
+    ssize_t flush_l_once(const SockNum::Ptr &sock);
+
+    // 发送队列中的一个消息，dst非空时发往send_addr指定的地址，否则发往绑定的对端地址
+    struct SendItem {
+        Buffer::Ptr buf;
+        std::shared_ptr<struct sockaddr_storage> dst;
+        socklen_t dst_len = 0;
+
+        SendItem(Buffer::Ptr b) : buf(std::move(b)) {}
+        Buffer *operator->() const { return buf.get(); }
+    };
+    std::deque<SendItem> _send_list;// send_l 发送队列
+    size_t _send_list_offset = 0;// tcp队首Buffer已经发送的字节数
+    std::atomic<uint64_t> _send_list_bytes { 0 };// 发送队列中还没有发送的字节数
+    uint64_t _max_list_bytes;// 发送队列允许积压的最大字节数
+    bool _send_list_posted = false;// 已投递flush任务或正在等待可写事件，受 _mtx_send_list 保护
+    bool _send_list_delayed = false;// 已添加延时flush任务，受 _mtx_send_list 保护
+    uint32_t _batch_l;// 发送队列攒够多少个消息立即发送，不足时延时 SEND_LIST_DELAY_MS 发送
+    MutexWrapper<std::recursive_mutex> _mtx_send_list;// 发送队列锁
+#if !defined(_WIN32)
+    std::vector<struct iovec> _iov_l;
+#endif //!_WIN32
+#if defined(HAS_SENDMMSG)
+    std::vector<struct mmsghdr> _hdr_l;
+#endif //HAS_SENDMMSG
+public:
+///////////////////////////////////////send_l///////////////////////////////////////
 
     /**
      * @brief 是否启动测速
@@ -793,26 +1197,37 @@ private://SocketRecvFromBuffer
     Buffer::Ptr _buffer;
     struct sockaddr_storage _address;
 
+    /**
+     * @brief 准备读缓存：获取共享缓存，或分配、缩小私有缓存
+     * 
+     * @return uint32_t 成功返回chw::success，分配失败返回chw::fail
+     */
+    uint32_t prepareRecvBuffer();
+
+    /**
+     * @brief 读取后调整私有读缓存，tcp读满时扩容
+     * 
+     * @param nread [in]本次读取长度
+     */
+    void adaptRecvBuffer(ssize_t nread);
+
+    /**
+     * @brief 回调返回后共享缓存中还有数据，拷贝到私有缓存并停止使用共享缓存
+     */
+    void detachSharedBuffer();
+
     // 只接收,数据交给上层处理
     ssize_t recvFromSocket(int fd, ssize_t &count) {
+#if defined(HAS_SO_TIMESTAMPING)
+        if (_timestamping) {
+            return recvFromSocketStamp(fd, count);
+        }
+#endif //HAS_SO_TIMESTAMPING
         ssize_t nread;
         socklen_t len = sizeof(_address);
-        if (!_buffer) {
-            // allocBuffer();
-            _buffer = std::make_shared<Buffer>();
-
-            uint32_t ret = chw::success;
-            if(_sock_fd->type() == SockNum::Sock_UDP) {
-                ret = _buffer->SetCapacity(RAW_BUFFER_SIZE);
-            } else {
-                ret = _buffer->SetCapacity(TCP_BUFFER_SIZE);
-            }
-
-            if(ret == chw::fail) {
-                shutdown();
-            } else {
-                _buffer->Reset0();
-            }
+        if (prepareRecvBuffer() == chw::fail) {
+            shutdown();
+            return 0;
         }
 
         do {
@@ -822,6 +1237,7 @@ private://SocketRecvFromBuffer
 
         if (nread > 0) {
             _buffer->SetSize(_buffer->Size() + nread);
+            adaptRecvBuffer(nread);
             count = 1;
             // _buffer->data()[nread] = '\0';
             // std::static_pointer_cast<BufferRaw>(_buffer)->setSize(nread);
@@ -829,7 +1245,34 @@ private://SocketRecvFromBuffer
         return nread;
     }
 
-    struct sockaddr_storage &getAddress(size_t index) { return _address; }
+#if defined(HAS_SO_TIMESTAMPING)
+    /**
+     * @brief 用recvmsg接收并读取接收时间戳，开启SO_TIMESTAMPING的tcp使用，只接收,数据交给上层处理
+     * 
+     * @param fd    [in]fd
+     * @param count [out]接收到的包数量
+     * @return ssize_t 接收到的字节数，出错返回-1
+     */
+    ssize_t recvFromSocketStamp(int fd, ssize_t &count);
+#endif //HAS_SO_TIMESTAMPING
+
+#if defined(HAS_RECVMMSG)
+    // recvmmsg批量接收缓存，每个包一个Buffer和对端地址
+    std::vector<Buffer::Ptr> _buffers;
+    std::vector<struct sockaddr_storage> _addresses;
+    std::vector<struct iovec> _iovec_r;
+    std::vector<struct mmsghdr> _mmsghdr_r;
+    std::vector<char> _control_r;// UDP GRO和接收时间戳辅助数据，每个包按开启的功能 UDP_GRO_CONTROL_SIZE + TIMESTAMPING_CONTROL_SIZE 字节
+
+    /**
+     * @brief 一次recvmmsg接收多个包，只接收,数据交给上层处理
+     * 
+     * @param fd    [in]fd
+     * @param count [out]接收到的包数量
+     * @return ssize_t 接收到的总字节数，出错返回-1
+     */
+    ssize_t recvFromSocketBatch(int fd, ssize_t &count);
+#endif //HAS_RECVMMSG
 };
 
 }  // namespace chw
@@ -20,6 +20,46 @@
 
 using namespace std;
 
+#if defined(HAS_UDP_GSO)
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif //HAS_UDP_GSO
+
+#if defined(__linux__) || defined(__linux)
+#include <linux/filter.h>
+#endif
+
+#if defined(HAS_MSG_ZEROCOPY)
+#include <linux/errqueue.h>
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+#endif //HAS_MSG_ZEROCOPY
+
+#if defined(HAS_SO_TIMESTAMPING)
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#ifndef SO_EE_ORIGIN_TIMESTAMPING
+#define SO_EE_ORIGIN_TIMESTAMPING 4
+#endif
+#endif //HAS_SO_TIMESTAMPING
+
 namespace chw {
 
 #if defined(_WIN32)
@@ -191,6 +231,138 @@ int SockUtil::setBroadcast(int fd, bool on) {
     return ret;
 }
 
+int SockUtil::setReuseportCpu(int fd, uint32_t groups) {
+#if defined(__linux__) || defined(__linux)
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+    if (groups == 0) {
+        return -1;
+    }
+    // A = 当前cpu; A = A % groups; return A
+    struct sock_filter code[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, groups },
+        { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    int ret = setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, (char *) &prog, static_cast<socklen_t>(sizeof(prog)));
+    if (ret == -1) {
+        TraceL << "setsockopt SO_ATTACH_REUSEPORT_CBPF failed";
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+int SockUtil::setBusyPoll(int fd, uint32_t us) {
+#if defined(__linux__) || defined(__linux)
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+    int opt = (int)us;
+    int ret = setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, (char *) &opt, static_cast<socklen_t>(sizeof(opt)));
+    if (ret == -1) {
+        //需要CAP_NET_ADMIN权限才能设置大于net.core.busy_poll的值
+        TraceL << "setsockopt SO_BUSY_POLL failed";
+        return ret;
+    }
+    //内核5.11之前不支持，失败不影响SO_BUSY_POLL
+    opt = us ? 1 : 0;
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, (char *) &opt, static_cast<socklen_t>(sizeof(opt))) == -1) {
+        TraceL << "setsockopt SO_PREFER_BUSY_POLL failed";
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+int SockUtil::setUdpGro(int fd, bool on) {
+#if defined(HAS_UDP_GSO)
+    int opt = on ? 1 : 0;
+    int ret = setsockopt(fd, SOL_UDP, UDP_GRO, (char *) &opt, static_cast<socklen_t>(sizeof(opt)));
+    if (ret == -1) {
+        //内核5.0之前不支持
+        TraceL << "setsockopt UDP_GRO failed";
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+int SockUtil::setZeroCopy(int fd, bool on) {
+#if defined(HAS_MSG_ZEROCOPY)
+    int opt = on ? 1 : 0;
+    int ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, (char *) &opt, static_cast<socklen_t>(sizeof(opt)));
+    if (ret == -1) {
+        //内核4.14之前不支持
+        TraceL << "setsockopt SO_ZEROCOPY failed";
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+int SockUtil::setTimestamping(int fd, bool on) {
+#if defined(HAS_SO_TIMESTAMPING)
+    // 发送时间戳只返回时间戳不回带数据，用OPT_ID序号关联同一次发送的SCHED和SND时间戳
+    int opt = on ? (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_RX_HARDWARE
+                    | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_TX_SCHED
+                    | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RAW_HARDWARE
+                    | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY) : 0;
+    int ret = setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, (char *) &opt, static_cast<socklen_t>(sizeof(opt)));
+    if (ret == -1) {
+        TraceL << "setsockopt SO_TIMESTAMPING failed";
+    }
+    return ret;
+#else
+    return -1;
+#endif
+}
+
+#if defined(HAS_SO_TIMESTAMPING)
+static inline uint64_t timespecToNs(const struct timespec &ts) {
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void SockUtil::getRxTimestamp(struct msghdr *msg, uint64_t &sw_ns, uint64_t &hw_ns) {
+    sw_ns = 0;
+    hw_ns = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping ts;
+            memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+            // ts[0]软件时间戳，ts[2]硬件原始时间戳，ts[1]已废弃
+            sw_ns = timespecToNs(ts.ts[0]);
+            hw_ns = timespecToNs(ts.ts[2]);
+            return;
+        }
+    }
+}
+#endif //HAS_SO_TIMESTAMPING
+
+#if defined(HAS_UDP_GSO)
+uint32_t SockUtil::getUdpGroSize(struct msghdr *msg) {
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+            int size = 0;
+            memcpy(&size, CMSG_DATA(cm), sizeof(size));
+            return size > 0 ? size : 0;
+        }
+    }
+    return 0;
+}
+#endif //HAS_UDP_GSO
+
 int SockUtil::setKeepAlive(int fd, bool on, int interval, int idle, int times) {
     // Enable/disable the keep-alive option
     int opt = on ? 1 : 0;
@@ -541,6 +713,53 @@ int SockUtil::getSockError(int fd) {
     }
 }
 
+#if defined(__linux__) || defined(__linux)
+// glibc的tcp_info只到tcpi_total_retrans，后面的字段按内核linux/tcp.h的布局补齐
+struct tcp_info_ext {
+    struct tcp_info base;
+    uint64_t tcpi_pacing_rate;
+    uint64_t tcpi_max_pacing_rate;
+    uint64_t tcpi_bytes_acked;
+    uint64_t tcpi_bytes_received;
+    uint32_t tcpi_segs_out;
+    uint32_t tcpi_segs_in;
+    uint32_t tcpi_notsent_bytes;
+    uint32_t tcpi_min_rtt;
+    uint32_t tcpi_data_segs_in;
+    uint32_t tcpi_data_segs_out;
+    uint64_t tcpi_delivery_rate;
+    uint64_t tcpi_busy_time;
+    uint64_t tcpi_rwnd_limited;
+    uint64_t tcpi_sndbuf_limited;
+};
+static_assert(sizeof(struct tcp_info) == 104, "unexpected glibc tcp_info layout");
+#endif
+
+int SockUtil::getTcpInfo(int fd, TcpInfo &info) {
+#if defined(__linux__) || defined(__linux)
+    struct tcp_info_ext ti;
+    memset(&ti, 0, sizeof(ti));
+    // 老内核返回的长度更短，未填充的字段保持为0
+    socklen_t len = static_cast<socklen_t>(sizeof(ti));
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, (char *) &ti, &len) == -1) {
+        TraceL << "getsockopt TCP_INFO failed";
+        return -1;
+    }
+    info.rtt = ti.base.tcpi_rtt;
+    info.rttvar = ti.base.tcpi_rttvar;
+    info.snd_cwnd = ti.base.tcpi_snd_cwnd;
+    info.total_retrans = ti.base.tcpi_total_retrans;
+    info.pacing_rate = ti.tcpi_pacing_rate;
+    info.delivery_rate = ti.tcpi_delivery_rate;
+    info.busy_time = ti.tcpi_busy_time;
+    info.rwnd_limited = ti.tcpi_rwnd_limited;
+    info.sndbuf_limited = ti.tcpi_sndbuf_limited;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
 using getsockname_type = decltype(getsockname);
 
 static bool get_socket_addr(int fd, struct sockaddr_storage &addr, getsockname_type func) {
@@ -1235,20 +1454,20 @@ uint32_t SockUtil::send_tcp_data(int32_t fd, char * buff, uint32_t len)
     uint32_t total_send_bytes = 0;
     int32_t curr_send_len = 0;
     uint32_t left_bytes = len;
-    uint32_t resendtimes = 0;
 
     while(total_send_bytes < len) {
         curr_send_len = send(fd, (char*)buff + total_send_bytes, left_bytes, MSG_NOSIGNAL);
         if(curr_send_len < 0) {
             auto err = get_uv_error(true);
-            if (err == UV_EAGAIN && (resendtimes++ < 10000))
-            // if( (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) && (resendtimes++ < 100000))
-            {
-                usleep(1000);
+            if (err == UV_EINTR) {
                 continue;
             }
+            if (err == UV_EAGAIN) {
+                // 发送缓存满，不在调用线程中休眠重试
+                return total_send_bytes;
+            }
 
-            ErrorL << "send failed,err=" << uv_strerror(err) << ",resendtimes=" << resendtimes << ",len=" << len 
+            ErrorL << "send failed,err=" << uv_strerror(err) << ",len=" << len 
             << ",total_send_bytes=" << total_send_bytes << ",fd=" << fd;
             return total_send_bytes;
         } else if(curr_send_len > 0) {
@@ -1296,19 +1515,20 @@ int32_t SockUtil::send_once_tcp(int32_t fd, char * buff, uint32_t len)
 uint32_t SockUtil::send_udp_data(int32_t fd, char* buff, uint32_t len, struct sockaddr* addr, int32_t socklen)
 {
     int32_t snd_len = 0;
-    uint32_t resendtimes = 0;
 
     while(snd_len <= 0) {
         snd_len = sendto(fd, buff, len, 0, addr, socklen);
         if(snd_len < 0) {
             auto err = get_uv_error(true);
-            if (err == UV_EAGAIN && (resendtimes++ < 10000))
-            {
-                usleep(1000);
+            if (err == UV_EINTR) {
                 continue;
             }
+            if (err == UV_EAGAIN) {
+                // 发送缓存满，不在调用线程中休眠重试
+                return 0;
+            }
 
-            ErrorL << "send failed,err=" << uv_strerror(err) << ",resendtimes=" << resendtimes << ",len=" << len << ",snd_len=" << snd_len << ",fd=" << fd;
+            ErrorL << "send failed,err=" << uv_strerror(err) << ",len=" << len << ",snd_len=" << snd_len << ",fd=" << fd;
             return 0;
         } else if(snd_len > 0) {
             return snd_len;
@@ -1342,4 +1562,174 @@ uint32_t SockUtil::send_udp_data(int32_t fd, char* buff, uint32_t len, struct so
     }
  }
 
+#if defined(HAS_SENDMMSG)
+uint32_t SockUtil::send_udp_mmsg(int32_t fd, struct mmsghdr* hdr, uint32_t count)
+{
+    while(true) {
+        int n = sendmmsg(fd, hdr, count, 0);
+        if(n >= 0) {
+            // 可能只发出前面一部分包
+            return n;
+        }
+
+        auto err = get_uv_error(true);
+        if (err == UV_EINTR) {
+            continue;
+        }
+        if (err != UV_EAGAIN) {
+            ErrorL << "sendmmsg failed,err=" << uv_strerror(err) << ",count=" << count << ",fd=" << fd;
+        }
+        // 发送缓存满，不在调用线程中休眠重试
+        return 0;
+    }
+}
+#endif //HAS_SENDMMSG
+
+#if defined(HAS_UDP_GSO)
+bool SockUtil::support_udp_gso(int32_t fd)
+{
+    int val = 0;
+    socklen_t len = sizeof(val);
+    //只读取选项，不影响socket的其他发送
+    return getsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, &len) == 0;
+}
+
+int32_t SockUtil::send_udp_gso(int32_t fd, char* buff, uint32_t len, uint16_t seg_size, struct sockaddr* addr, int32_t socklen)
+{
+    struct iovec iov;
+    iov.iov_base = buff;
+    iov.iov_len = len;
+
+    char control[CMSG_SPACE(sizeof(uint16_t))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (void *)addr;
+    msg.msg_namelen = socklen;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    // 每个udp包的长度
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(cm), &seg_size, sizeof(uint16_t));
+
+    while(true) {
+        ssize_t snd_len = sendmsg(fd, &msg, 0);
+        if(snd_len >= 0) {
+            return snd_len;
+        }
+        auto err = get_uv_error(true);
+        if (err == UV_EINTR) {
+            continue;
+        }
+        // 发送缓存满，不在调用线程中休眠重试
+        return err == UV_EAGAIN ? 0 : -1;
+    }
+}
+#endif //HAS_UDP_GSO
+
+#if defined(HAS_MSG_ZEROCOPY)
+uint32_t SockUtil::send_tcp_zerocopy(int32_t fd, char * buff, uint32_t len, uint32_t &calls)
+{
+    uint32_t total_send_bytes = 0;
+    calls = 0;
+
+    while(total_send_bytes < len) {
+        ssize_t curr_send_len = send(fd, buff + total_send_bytes, len - total_send_bytes, MSG_NOSIGNAL | MSG_ZEROCOPY);
+        if(curr_send_len > 0) {
+            total_send_bytes += curr_send_len;
+            ++calls;
+            continue;
+        }
+
+        auto err = get_uv_error(true);
+        if (err == UV_EINTR) {
+            continue;
+        }
+        // EAGAIN:发送缓存满；ENOBUFS:未完成的通知占满了socket选项内存，需要poller线程读取错误队列
+        // 两者都不在调用线程中休眠重试，返回已发送长度
+        if (err != UV_EAGAIN && err != UV_ENOBUFS) {
+            ErrorL << "zerocopy send failed,err=" << uv_strerror(err) << ",len=" << len
+            << ",total_send_bytes=" << total_send_bytes << ",fd=" << fd;
+        }
+        break;
+    }
+
+    return total_send_bytes;
+}
+#endif //HAS_MSG_ZEROCOPY
+
+#if defined(HAS_MSG_ZEROCOPY) || defined(HAS_SO_TIMESTAMPING)
+int32_t SockUtil::recv_errqueue(int32_t fd, ErrQueueMsg &eq)
+{
+    // 发送时间戳消息带SCM_TIMESTAMPING和扩展错误两个辅助数据
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_storage))
+                 + CMSG_SPACE(sizeof(struct scm_timestamping))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    while(true) {
+        ssize_t ret = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (ret >= 0) {
+            break;
+        }
+        auto err = get_uv_error(true);
+        if (err == UV_EINTR) {
+            continue;
+        }
+        return err == UV_EAGAIN ? 0 : -1;
+    }
+
+    eq = ErrQueueMsg();
+    bool stamped = false;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+#if defined(HAS_SO_TIMESTAMPING)
+        if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+            struct scm_timestamping ts;
+            memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+            eq.sw_ns = timespecToNs(ts.ts[0]);
+            eq.hw_ns = timespecToNs(ts.ts[2]);
+            stamped = true;
+            continue;
+        }
+#endif //HAS_SO_TIMESTAMPING
+        if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+            continue;
+        }
+        struct sock_extended_err serr;
+        memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+#if defined(HAS_MSG_ZEROCOPY)
+        if (serr.ee_origin == SO_EE_ORIGIN_ZEROCOPY && serr.ee_errno == 0) {
+            eq.origin = ERRQUEUE_ZEROCOPY;
+            eq.copied = serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED;
+            eq.info = serr.ee_info;
+            eq.data = serr.ee_data;
+        }
+#endif //HAS_MSG_ZEROCOPY
+#if defined(HAS_SO_TIMESTAMPING)
+        // 时间戳消息的ee_errno为ENOMSG
+        if (serr.ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+            eq.origin = ERRQUEUE_TIMESTAMPING;
+            eq.info = serr.ee_info;
+            eq.data = serr.ee_data;
+        }
+#endif //HAS_SO_TIMESTAMPING
+    }
+
+    if (eq.origin == ERRQUEUE_TIMESTAMPING && !stamped) {
+        eq.origin = 0;
+    }
+    // 不认识的消息origin为0，已从错误队列移除
+    return 1;
+}
+#endif
+
 }  // namespace chw
@@ -47,6 +47,26 @@ int close(int fd);
 #define SOCKET_DEFAULT_BUF_SIZE (256 * 1024)
 #endif
 #endif
+#if defined(__linux__) || defined(__linux)
+//支持sendmmsg/recvmmsg一次系统调用收发多个udp包
+#define HAS_SENDMMSG
+#define HAS_RECVMMSG
+//支持UDP GSO/GRO，一次收发多个等长udp包，由内核分段和合并，内核4.18/5.0以上
+#define HAS_UDP_GSO
+//支持tcp MSG_ZEROCOPY发送，内核通过错误队列通知发送完成，内核4.14以上
+#define HAS_MSG_ZEROCOPY
+//支持SO_TIMESTAMPING收发时间戳，发送时间戳通过错误队列返回，内核3.17以上
+#define HAS_SO_TIMESTAMPING
+#endif //__linux__
+
+// UDP GSO一次最多发送的包数和总长度
+#define UDP_GSO_MAX_SEGMENTS 64
+#define UDP_GSO_MAX_SIZE 65507
+// UDP GRO合并包辅助数据缓存大小
+#define UDP_GRO_CONTROL_SIZE 64
+// SO_TIMESTAMPING接收时间戳辅助数据缓存大小
+#define TIMESTAMPING_CONTROL_SIZE 64
+
 #define TCP_KEEPALIVE_INTERVAL 30
 #define TCP_KEEPALIVE_PROBE_TIMES 9
 #define TCP_KEEPALIVE_TIME 120
@@ -147,6 +167,68 @@ public:
      */
     static int setBroadcast(int fd, bool on = true);
 
+    /**
+     * 开启socket忙轮询，读取时在驱动队列上自旋等待数据，仅linux支持
+     * @param fd socket fd号
+     * @param us 自旋时长，微秒，0为关闭
+     * @return 0代表成功，-1为失败
+     */
+    static int setBusyPoll(int fd, uint32_t us);
+
+    /**
+     * 给SO_REUSEPORT组挂载cBPF程序，按接收数据包的cpu选择组内socket(cpu % groups)，仅linux支持
+     * 组内socket按绑定顺序编号，前groups个socket需要最先绑定
+     * @param fd 组内任意socket fd号
+     * @param groups 参与分发的socket数量
+     * @return 0代表成功，-1为失败
+     */
+    static int setReuseportCpu(int fd, uint32_t groups);
+
+    /**
+     * 开启UDP GRO，内核把同一对端连续的等长udp包合并后一次交给应用层，仅linux支持
+     * 开启后需要用recvmsg读取，通过 getUdpGroSize 获取每个udp包的长度
+     * @param fd socket fd号
+     * @param on 是否开启
+     * @return 0代表成功，-1为失败
+     */
+    static int setUdpGro(int fd, bool on = true);
+
+    /**
+     * 开启SO_ZEROCOPY，之后带MSG_ZEROCOPY的send不再拷贝数据到内核，仅linux支持
+     * @param fd socket fd号
+     * @param on 是否开启
+     * @return 0代表成功，-1为失败
+     */
+    static int setZeroCopy(int fd, bool on = true);
+
+    /**
+     * 开启SO_TIMESTAMPING，内核在收发时打软件时间戳，网卡已开启硬件时间戳时同时返回硬件时间戳，仅linux支持
+     * 接收时间戳需要用recvmsg读取，通过 getRxTimestamp 获取；发送时间戳带OPT_ID序号、不带数据，通过 recv_errqueue 读取
+     * @param fd socket fd号
+     * @param on 是否开启
+     * @return 0代表成功，-1为失败
+     */
+    static int setTimestamping(int fd, bool on = true);
+
+#if defined(HAS_UDP_GSO)
+    /**
+     * 从recvmsg的辅助数据中获取UDP GRO合并包中每个udp包的长度
+     * @param msg recvmsg的消息头
+     * @return 每个udp包的长度，0表示不是合并包
+     */
+    static uint32_t getUdpGroSize(struct msghdr *msg);
+#endif //HAS_UDP_GSO
+
+#if defined(HAS_SO_TIMESTAMPING)
+    /**
+     * 从recvmsg的辅助数据中获取接收时间戳，纳秒
+     * @param msg recvmsg的消息头
+     * @param sw_ns [out]内核软件时间戳(CLOCK_REALTIME)，没有时为0
+     * @param hw_ns [out]网卡硬件时间戳(网卡时钟)，没有时为0
+     */
+    static void getRxTimestamp(struct msghdr *msg, uint64_t &sw_ns, uint64_t &hw_ns);
+#endif //HAS_SO_TIMESTAMPING
+
     /**
      * 是否开启TCP KeepAlive特性
      * @param fd socket fd号
@@ -253,6 +335,51 @@ public:
      */
     static int getSockError(int fd);
 
+    // tcp连接状态，来自getsockopt(TCP_INFO)
+    struct TcpInfo {
+        uint32_t rtt = 0;           // 平滑rtt，微秒
+        uint32_t rttvar = 0;        // rtt抖动，微秒
+        uint32_t snd_cwnd = 0;      // 拥塞窗口，报文段数
+        uint32_t total_retrans = 0; // 累计重传报文段数
+        uint64_t pacing_rate = 0;   // 发送节奏速率，字节/秒
+        uint64_t delivery_rate = 0; // 最近的交付速率，字节/秒
+        uint64_t busy_time = 0;     // 有数据待发送的累计时间，微秒
+        uint64_t rwnd_limited = 0;  // 其中受对端接收窗口限制的累计时间，微秒
+        uint64_t sndbuf_limited = 0;// 其中受本端发送缓存限制的累计时间，微秒
+
+        // 累计量求差，rtt、窗口、速率等瞬时值取本次
+        TcpInfo operator-(const TcpInfo &other) const {
+            TcpInfo ret = *this;
+            ret.total_retrans = total_retrans - other.total_retrans;
+            ret.busy_time = busy_time - other.busy_time;
+            ret.rwnd_limited = rwnd_limited - other.rwnd_limited;
+            ret.sndbuf_limited = sndbuf_limited - other.sndbuf_limited;
+            return ret;
+        }
+
+        // 多个连接合并，各项累加
+        TcpInfo &operator+=(const TcpInfo &other) {
+            rtt += other.rtt;
+            rttvar += other.rttvar;
+            snd_cwnd += other.snd_cwnd;
+            total_retrans += other.total_retrans;
+            pacing_rate += other.pacing_rate;
+            delivery_rate += other.delivery_rate;
+            busy_time += other.busy_time;
+            rwnd_limited += other.rwnd_limited;
+            sndbuf_limited += other.sndbuf_limited;
+            return *this;
+        }
+    };
+
+    /**
+     * 获取tcp连接状态，仅linux支持，内核不支持的字段为0(pacing_rate需4.0，delivery_rate需4.9，busy_time等需4.10)
+     * @param fd socket fd号
+     * @param info [out]连接状态
+     * @return 0代表成功，-1为失败
+     */
+    static int getTcpInfo(int fd, TcpInfo &info);
+
     /**
      * 获取网卡列表
      * @return vector<map<ip:name> >
@@ -383,12 +510,12 @@ public:
 
 //chw
     /**
-     * @brief tcp发送数据
+     * @brief tcp发送数据，不阻塞，发送缓存满时返回已发送的长度，由调用者排队剩余数据
      * 
      * @param fd    fd
      * @param buff  数据
      * @param len   数据长度
-     * @return ssize_t 发送成功的数据长度，0则是发生了错误
+     * @return uint32_t 发送成功的数据长度，小于len则是发送缓存满或发生了错误(打印日志)
      */
     static uint32_t send_tcp_data(int32_t fd, char * buff, uint32_t len);
 
@@ -403,14 +530,14 @@ public:
     static int32_t send_once_tcp(int32_t fd, char * buff, uint32_t len);
 
     /**
-     * @brief udp发送数据
+     * @brief udp发送数据，执行一次系统调用，不阻塞
      * 
      * @param fd        fd
      * @param buff      数据
      * @param len       数据长度
      * @param addr      目标地址
      * @param socklen   地址长度
-     * @return uint32_t 发送成功的数据长度，0则是发生了错误
+     * @return uint32_t 发送成功的数据长度，0则是发送缓存满或发生了错误(打印日志)
      */
     static uint32_t send_udp_data(int32_t fd, char * buff, uint32_t len, struct sockaddr* addr, int32_t socklen);
 
@@ -425,6 +552,80 @@ public:
      * @return uint32_t 发送成功或部分成功，返回发送的数据长度；发生错误返回-1；下次重试返回0
      */
     static uint32_t send_once_udp(int32_t fd, char * buff, uint32_t len, struct sockaddr* addr, int32_t socklen);
+
+#if defined(HAS_SENDMMSG)
+    /**
+     * @brief udp批量发送数据，一次sendmmsg系统调用发送多个udp包，每个mmsghdr是一个udp包
+     * 非阻塞，发送缓存满时不等待，同 send_udp_data
+     * 
+     * @param fd        fd
+     * @param hdr       mmsghdr数组，已填好目标地址和数据
+     * @param count     数组成员个数
+     * @return uint32_t 发送成功的包个数，小于count时剩余的包由调用者处理
+     */
+    static uint32_t send_udp_mmsg(int32_t fd, struct mmsghdr* hdr, uint32_t count);
+#endif //HAS_SENDMMSG
+
+#if defined(HAS_UDP_GSO)
+    /**
+     * @brief 检测内核是否支持UDP GSO(UDP_SEGMENT)
+     * 
+     * @param fd    udp fd
+     * @return bool 支持返回true
+     */
+    static bool support_udp_gso(int32_t fd);
+
+    /**
+     * @brief udp GSO发送数据，buff中是首尾相连的等长udp包，一次sendmsg带UDP_SEGMENT，由内核分段
+     * 非阻塞，发送缓存满时返回0；出错时不打印日志，由调用者根据错误码决定是否退回逐包发送
+     * 
+     * @param fd        fd
+     * @param buff      数据
+     * @param len       数据总长度，不超过 UDP_GSO_MAX_SIZE
+     * @param seg_size  每个udp包长度，最后一个包可以更短
+     * @param addr      目标地址
+     * @param socklen   地址长度
+     * @return int32_t  发送成功的数据长度，发送缓存满返回0，出错返回-1
+     */
+    static int32_t send_udp_gso(int32_t fd, char * buff, uint32_t len, uint16_t seg_size, struct sockaddr* addr, int32_t socklen);
+#endif //HAS_UDP_GSO
+
+#if defined(HAS_MSG_ZEROCOPY)
+    /**
+     * @brief tcp零拷贝发送数据，带MSG_ZEROCOPY，内核直接引用buff的内存，收到完成通知前buff不能修改或释放
+     * 非阻塞，发送缓存满或通知占满socket选项内存(ENOBUFS)时不等待，同 send_tcp_data
+     * 
+     * @param fd    fd，已开启SO_ZEROCOPY
+     * @param buff  数据
+     * @param len   数据长度
+     * @param calls [out]成功的send次数，每次占用一个完成通知序号
+     * @return uint32_t 发送成功的数据长度，小于len时剩余数据由调用者处理
+     */
+    static uint32_t send_tcp_zerocopy(int32_t fd, char * buff, uint32_t len, uint32_t &calls);
+
+#endif //HAS_MSG_ZEROCOPY
+
+#if defined(HAS_MSG_ZEROCOPY) || defined(HAS_SO_TIMESTAMPING)
+    // 错误队列消息
+    struct ErrQueueMsg {
+        uint8_t origin = 0;// ERRQUEUE_ZEROCOPY或ERRQUEUE_TIMESTAMPING，其他消息为0
+        bool copied = false;// 零拷贝时内核是否退回了拷贝发送(如回环网卡或网卡不支持scatter-gather)
+        uint32_t info = 0;// 零拷贝时为完成的起始序号，时间戳时为类型(SCM_TSTAMP_SND等)
+        uint32_t data = 0;// 零拷贝时为完成的结束序号，时间戳时为OPT_ID序号
+        uint64_t sw_ns = 0;// 软件时间戳，纳秒
+        uint64_t hw_ns = 0;// 硬件时间戳，纳秒
+    };
+    enum { ERRQUEUE_ZEROCOPY = 1, ERRQUEUE_TIMESTAMPING = 2 };
+
+    /**
+     * @brief 从错误队列读取一个消息：零拷贝完成通知(序号[info,data]的send已完成)或发送时间戳
+     * 
+     * @param fd        fd
+     * @param msg       [out]消息
+     * @return int32_t  读到消息返回1(不认识的消息origin为0)，没有消息返回0，出错返回-1
+     */
+    static int32_t recv_errqueue(int32_t fd, ErrQueueMsg &msg);
+#endif
 };
 
 }  // namespace chw
@@ -82,4 +82,93 @@ uint32_t StickyPacket(const Buffer::Ptr &buf,const DispatchCB& cb)
     return chw::success;
 }
 
+/**
+ * @brief 检查消息总长度
+ * 
+ * @param total_len [in]消息头中的总长度
+ * @return bool 合法返回true
+ */
+static bool checkPktLen(uint32_t total_len)
+{
+    if(total_len < sizeof(MsgHdr) || total_len > MAX_PKT_SIZE)
+    {
+        ErrorL << "invalid net pkt size:" << total_len;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief tcp粘包处理，不拷贝数据：完整消息以视图分发，半包连同接收Buffer挂到chain上等待后续数据
+ * 
+ * @param buf   [in]接收数据
+ * @param chain [in]半包缓存链，每个连接一个
+ * @param cb    [in]消息分发回调，视图只在回调期间有效
+ * @return uint32_t 成功返回chw::success，发生错误返回chw::fail
+ */
+uint32_t StickyPacket(const Buffer::Ptr &buf,BufferChain &chain,const DispatchViewCB& cb)
+{
+    uint32_t head_len = sizeof(MsgHdr);
+    size_t size = buf->Size();
+
+    //1.没有等待中的半包，完整消息直接在接收Buffer中分发
+    if(chain.Empty())
+    {
+        size_t offset = 0;
+        while(size - offset >= head_len)
+        {
+            MsgHdr* pSubHdr = (MsgHdr*)((char*)buf->data() + offset);
+            if(!checkPktLen(pSubHdr->uTotalLen))
+            {
+                return chw::fail;
+            }
+            if(size - offset < pSubHdr->uTotalLen)
+            {
+                break;
+            }
+            cb(chain.Wrap(buf,offset,pSubHdr->uTotalLen));
+            offset += pSubHdr->uTotalLen;
+        }
+
+        //1.1尾部的半包不搬移，取走接收Buffer挂到链上
+        if(offset < size)
+        {
+            chain.Append(buf->Detach(),offset,size - offset);
+        }
+        else
+        {
+            buf->Reset();
+        }
+        return chw::success;
+    }
+
+    //2.已有半包，接收Buffer整体挂到链上，完整消息以跨分段视图分发
+    if(size > 0)
+    {
+        chain.Append(buf->Detach(),0,size);
+    }
+    while(chain.Size() >= head_len)
+    {
+        //2.1消息头跨分段时才拷贝消息头
+        MsgHdr hdr;
+        MsgHdr* pHdr = (MsgHdr*)chain.Front(head_len);
+        if(pHdr == nullptr)
+        {
+            chain.Peek(&hdr,head_len);
+            pHdr = &hdr;
+        }
+        if(!checkPktLen(pHdr->uTotalLen))
+        {
+            return chw::fail;
+        }
+        if(chain.Size() < pHdr->uTotalLen)
+        {
+            break;
+        }
+        cb(chain.Take(pHdr->uTotalLen));
+    }
+
+    return chw::success;
+}
+
 }
\ No newline at end of file
@@ -6,10 +6,12 @@
 
 #include <functional>
 #include "Buffer.h"
+#include "BufferChain.h"
 
 namespace chw {
 
 typedef std::function<void(char*,uint32_t)> DispatchCB;
+typedef std::function<void(const BufferView&)> DispatchViewCB;
 
 /**
  * @brief tcp粘包处理
@@ -20,6 +22,17 @@ typedef std::function<void(char*,uint32_t)> DispatchCB;
  */
 uint32_t StickyPacket(const Buffer::Ptr &buf,const DispatchCB& cb);
 
+/**
+ * @brief tcp粘包处理，不拷贝数据：完整消息以视图分发，半包连同接收Buffer挂到chain上等待后续数据
+ * 挂到chain上的接收Buffer会被Detach，数据生产者发现Buffer容量为0时需要重新分配
+ * 
+ * @param buf   [in]接收数据
+ * @param chain [in]半包缓存链，每个连接一个
+ * @param cb    [in]消息分发回调，视图只在回调期间有效
+ * @return uint32_t 成功返回chw::success，发生错误返回chw::fail
+ */
+uint32_t StickyPacket(const Buffer::Ptr &buf,BufferChain &chain,const DispatchViewCB& cb);
+
 }
 
 
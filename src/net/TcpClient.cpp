@@ -45,6 +45,14 @@ uint32_t TcpClient::create_client(const string &url, uint16_t port, uint16_t loc
         TraceL << strong_self->getIdentifier() << " on err: " << ex;
         strong_self->onError(ex);
     });
+    sock_ptr->setOnFlush([weak_self]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return false;
+        }
+        strong_self->onFlushed();
+        return true;
+    });
 
     //TraceL << getIdentifier() << " start connect " << url << ":" << port;
     sock_ptr->connect(url, port, [weak_self](const SockException &err) {
@@ -4,6 +4,7 @@
 #include "TcpServer.h"
 #include "uv_errno.h"
 #include "onceToken.h"
+#include "EventLoopPool.h"
 
 using namespace std;
 
@@ -49,8 +50,9 @@ TcpServer::~TcpServer() {
  */
 Socket::Ptr TcpServer::onBeforeAcceptConnection(const EventLoop::Ptr &poller) {
     assert(_poller->isCurrentThread());
-    //此处改成自定义获取poller对象，防止负载不均衡
-    return createSocket(poller);
+    //启用线程池(-j)时，新连接按负载均衡策略分散到线程池的poller
+    auto pool_poller = EventLoopPool::Instance().getPoller();
+    return createSocket(pool_poller ? pool_poller : poller);
 }
 
 /**
@@ -87,7 +89,19 @@ uint32_t TcpServer::onAcceptConnection(const Socket::Ptr &sock) {
         if (!strong_self) {
             return;
         }
-        strong_self->_last_session = strong_session;
+        //_last_session只在服务端poller线程修改，线程池中的会话切换到服务端poller线程记录
+        if (strong_self->_poller->isCurrentThread()) {
+            strong_self->_last_session = strong_session;
+            strong_self->_last_active.store(strong_session.get(), std::memory_order_relaxed);
+        } else if (strong_self->_last_active.exchange(strong_session.get(), std::memory_order_relaxed) != strong_session.get()) {
+            //活动的客户端变化时才切换线程，同一个会话连续收包不投递
+            strong_self->_poller->async([weak_self, weak_session]() {
+                auto strong_self = weak_self.lock();
+                if (strong_self) {
+                    strong_self->_last_session = weak_session;
+                }
+            }, false);
+        }
 
         try {
             strong_session->onRecv(buf);
@@ -111,13 +125,15 @@ uint32_t TcpServer::onAcceptConnection(const Socket::Ptr &sock) {
             if (!strong_self) {
                 return;
             }
+            if (auto strong_session = weak_session.lock()) {
+                strong_self->keepStampStat(strong_session->getSock()->getStampStat());
+            }
 
-            assert(strong_self->_poller->isCurrentThread());
-            if (!strong_self->_is_on_manager) {
+            if (strong_self->_poller->isCurrentThread() && !strong_self->_is_on_manager) {
                 //该事件不是onManager时触发的，直接操作map
                 strong_self->_session_map.erase(ptr);
             } else {
-                //遍历map时不能直接删除元素
+                //遍历map时不能直接删除元素;会话属于线程池中其他poller时，切换到服务端poller线程删除
                 strong_self->_poller->async([weak_self, ptr]() {
                     auto strong_self = weak_self.lock();
                     if (strong_self) {
@@ -181,6 +197,24 @@ void TcpServer::onManagerSession() {
     });
 
     for (auto &pr : _session_map) {
+        auto &poller = pr.second->getSock()->getPoller();
+        if (poller != _poller) {
+            //会话属于线程池中其他poller，切换到会话所在线程执行
+            weak_ptr<Session> weak_session = pr.second;
+            poller->async([weak_session]() {
+                auto strong_session = weak_session.lock();
+                if (!strong_session) {
+                    return;
+                }
+                try {
+                    strong_session->onManager();
+                } catch (exception &ex) {
+                    WarnL << ex.what();
+                }
+            });
+            continue;
+        }
+
         //遍历时，可能触发onErr事件(也会操作_session_map)
         try {
             pr.second->onManager();
@@ -191,7 +225,8 @@ void TcpServer::onManagerSession() {
 }
 
 /**
- * @brief 发送数据给最后一个活动的客户端（可在任意线程执行）
+ * @brief 发送数据给最后一个活动的客户端（服务端poller线程执行）
+ *        线程池中的会话收到数据后异步切换到服务端poller线程记录，刚切换的活动客户端可能稍后才生效
  * 
  * @param buf   [in]数据
  * @param len   [in]数据长度
@@ -210,6 +245,7 @@ uint32_t TcpServer::sendclientdata(char* buf, uint32_t len)
 
 /**
  * @brief 获取会话接收信息,避免session释放查询不到,包数量和总大小累加,序列号取最大值,速率采用当前值
+ *        会话可能分布在线程池的多个poller,会话的统计计数为原子变量,可跨线程汇总
  * 
  * @param rcv_num   [out]接收包的数量(每次调用后session保存的值清0,因此这里累加)
  * @param rcv_seq   [out]接收包的最大序列号
@@ -239,5 +275,38 @@ void TcpServer::GetRcvInfo(uint64_t& rcv_num,uint64_t& rcv_seq,uint64_t& rcv_len
     }
 }
 
+void TcpServer::GetStampStat(Socket::StampStat &stat)
+{
+    stat += closedStampStat();
+
+    onceToken token([&]() {
+        _is_on_manager = true;
+    }, [&]() {
+        _is_on_manager = false;
+    });
+
+    for (auto &pr : _session_map) {
+        stat += pr.second->getSock()->getStampStat();
+    }
+}
+
+void TcpServer::GetTcpInfo(SockUtil::TcpInfo &info, SockUtil::TcpInfo &interval, uint32_t &conns)
+{
+    onceToken token([&]() {
+        _is_on_manager = true;
+    }, [&]() {
+        _is_on_manager = false;
+    });
+
+    for (auto &pr : _session_map) {
+        SockUtil::TcpInfo cur, delta;
+        if (pr.second->SampleTcpInfo(cur, delta)) {
+            info += cur;
+            interval += delta;
+            ++conns;
+        }
+    }
+}
+
 } //namespace chw
 
@@ -6,6 +6,7 @@
 
 #include <memory>
 #include <functional>
+#include <atomic>
 #include <unordered_map>
 #include "Server.h"
 #include "Session.h"
@@ -36,6 +37,22 @@ public:
      */
     virtual void GetRcvInfo(uint64_t& rcv_num,uint64_t& rcv_seq,uint64_t& rcv_len,uint64_t& rcv_speed) override;
 
+    /**
+     * @brief 汇总所有socket的收发时间戳统计
+     * 
+     * @param stat [out]时间戳统计
+     */
+    virtual void GetStampStat(Socket::StampStat &stat) override;
+
+    /**
+     * @brief 采样并合并所有tcp会话的连接状态(TCP_INFO)
+     * 
+     * @param info     [out]各会话当前值之和
+     * @param interval [out]各会话与上次采样的差值之和
+     * @param conns    [out]采样成功的会话数量
+     */
+    virtual void GetTcpInfo(SockUtil::TcpInfo &info, SockUtil::TcpInfo &interval, uint32_t &conns) override;
+
 protected:
     /**
      * @brief 新接入连接回调（在epoll线程执行）
@@ -81,14 +98,16 @@ private:
 //chw
 public:
     /**
-     * @brief 发送数据给最后一个活动的客户端（可在任意线程执行）
+     * @brief 发送数据给最后一个活动的客户端（服务端poller线程执行）
+     *        线程池中的会话收到数据后异步切换到服务端poller线程记录，刚切换的活动客户端可能稍后才生效
      * 
      * @param buf   [in]数据
      * @param len   [in]数据长度
      * @return uint32_t 发送成功的数据长度
      */
     virtual uint32_t sendclientdata(char* buf, uint32_t len) override;
-    std::weak_ptr<Session> _last_session;// 最后一个活动的客户端
+    std::weak_ptr<Session> _last_session;// 最后一个活动的客户端，只在服务端poller线程访问
+    std::atomic<Session *> _last_active{nullptr};// 线程池中最后一个收到数据的会话，只用于判断是否需要切换线程记录
 private:
     std::unordered_map<Session *, Session::Ptr> _session_map;
 };
@@ -45,6 +45,14 @@ uint32_t UdpClient::create_client(const std::string &url, uint16_t port, uint16_
         TraceL << strong_self->getIdentifier() << " on err: " << ex;
         strong_self->onError(ex);
     });
+    sock_ptr->setOnFlush([weak_self]() {
+        auto strong_self = weak_self.lock();
+        if (!strong_self) {
+            return false;
+        }
+        strong_self->onFlushed();
+        return true;
+    });
 
     //udp绑定本地IP和端口
     if (!sock_ptr->bindUdpSock(localport, localip.c_str()))
@@ -4,6 +4,7 @@
 #include "uv_errno.h"
 #include "onceToken.h"
 #include "UdpServer.h"
+#include "EventLoopPool.h"
 
 using namespace std;
 
@@ -15,31 +16,53 @@ static const uint8_t s_in6_addr_maped[]
 static constexpr auto kUdpDelayCloseMS = 3 * 1000;
 
 /**
- * @brief 根据网络地址，返回唯一标识std::string
+ * @brief 根据网络地址，返回唯一标识
  * 
  * @param addr 网络地址
- * @return UdpServer::PeerIdType 唯一标识std::string
+ * @return UdpServer::PeerIdType 唯一标识，定长，不分配内存
  */
 static UdpServer::PeerIdType makeSockId(sockaddr *addr, int) {
     UdpServer::PeerIdType ret;
     switch (addr->sa_family) {
         case AF_INET : {
-            ret.resize(18);
-            ret[0] = ((struct sockaddr_in *) addr)->sin_port >> 8;
-            ret[1] = ((struct sockaddr_in *) addr)->sin_port & 0xFF;
+            ret.port = ((struct sockaddr_in *) addr)->sin_port;
             //ipv4地址统一转换为ipv6方式处理
-            memcpy(&ret[2], &s_in6_addr_maped, 12);
-            memcpy(&ret[14], &(((struct sockaddr_in *) addr)->sin_addr), 4);
+            memcpy(ret.addr, &s_in6_addr_maped, 12);
+            memcpy(ret.addr + 12, &(((struct sockaddr_in *) addr)->sin_addr), 4);
             return ret;
         }
         case AF_INET6 : {
-            ret.resize(18);
-            ret[0] = ((struct sockaddr_in6 *) addr)->sin6_port >> 8;
-            ret[1] = ((struct sockaddr_in6 *) addr)->sin6_port & 0xFF;
-            memcpy(&ret[2], &(((struct sockaddr_in6 *)addr)->sin6_addr), 16);
+            ret.port = ((struct sockaddr_in6 *) addr)->sin6_port;
+            memcpy(ret.addr, &(((struct sockaddr_in6 *)addr)->sin6_addr), 16);
             return ret;
         }
-        default: assert(0); return "";
+        default: assert(0); return ret;
+    }
+}
+
+/**
+ * @brief 判断两个网络地址是否是同一个对端，不分配内存，用于批量接收时跳过重复的会话查找
+ * 
+ * @param a 网络地址
+ * @param b 网络地址
+ * @return bool 地址族、ip和端口都相同返回true；ipv4与ipv4映射的ipv6地址返回false，由调用者按makeSockId比较
+ */
+static bool isSamePeer(const struct sockaddr_storage &a, const struct sockaddr_storage &b) {
+    if (a.ss_family != b.ss_family) {
+        return false;
+    }
+    switch (a.ss_family) {
+        case AF_INET : {
+            auto &a4 = (const struct sockaddr_in &) a;
+            auto &b4 = (const struct sockaddr_in &) b;
+            return a4.sin_port == b4.sin_port && a4.sin_addr.s_addr == b4.sin_addr.s_addr;
+        }
+        case AF_INET6 : {
+            auto &a6 = (const struct sockaddr_in6 &) a;
+            auto &b6 = (const struct sockaddr_in6 &) b;
+            return a6.sin6_port == b6.sin6_port && memcmp(&a6.sin6_addr, &b6.sin6_addr, sizeof(a6.sin6_addr)) == 0;
+        }
+        default: return false;
     }
 }
 
@@ -50,23 +73,27 @@ UdpServer::UdpServer(const EventLoop::Ptr &poller) : Server(poller) {
 /**
  * @brief 创建服务端Socket，设置接收回调
  * 
+ * @param poller [in]Socket绑定的poller
+ * @return Socket::Ptr 服务端Socket
  */
-void UdpServer::setupEvent() {
-    _socket = createSocket(_poller);
+Socket::Ptr UdpServer::setupEvent(const EventLoop::Ptr &poller) {
+    auto socket = createSocket(poller);
     std::weak_ptr<UdpServer> weak_self = std::static_pointer_cast<UdpServer>(shared_from_this());
-    _socket->setOnRead([weak_self](Buffer::Ptr &buf, struct sockaddr *addr, int addr_len) {
+    socket->setOnMultiRead([weak_self, poller](Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count) {
         if (auto strong_self = weak_self.lock()) {
-            strong_self->onRead(buf, addr, addr_len);
+            strong_self->onMultiRead(buf, addr, count, poller);
         }
     });
+    return socket;
 }
 
 UdpServer::~UdpServer() {
     InfoL << "Close udp server [" << _socket->get_local_ip() << "]: " << _socket->get_local_port();
 
     _timer.reset();
+    _shards.clear();
     _socket.reset();
-    _session_map->clear();
+    _session_map.clear();
 }
 
 /**
@@ -75,10 +102,31 @@ UdpServer::~UdpServer() {
  * @param host [in]监听网卡ip
  */
 void UdpServer::start_l(uint16_t port, const std::string &host) {
-    setupEvent();
-    //主server才创建session map，其他cloned server共享之
-    _session_mutex = std::make_shared<std::recursive_mutex>();
-    _session_map = std::make_shared<std::unordered_map<PeerIdType, Session::Ptr> >();
+    //启用线程池(-j)时每个poller绑定一个分片，否则只在本poller绑定
+    std::vector<EventLoop::Ptr> pollers;
+    EventLoopPool::Instance().for_each([&](const EventLoop::Ptr &poller) {
+        pollers.emplace_back(poller);
+    });
+    if (pollers.empty()) {
+        pollers.emplace_back(_poller);
+    }
+
+    for (auto &poller : pollers) {
+        auto socket = setupEvent(poller);
+        if (!socket->bindUdpSock(port, host.c_str())) {
+            // udp 绑定端口失败, 可能是由于端口占用或权限问题
+            std::string err = (StrPrinter << "Bind udp socket on " << host << " " << port << " failed: " << get_uv_errmsg(true));
+            throw std::runtime_error(err);
+        }
+        //端口为0时，其他分片绑定第一个分片随机到的端口
+        port = socket->get_local_port();
+        _shards.emplace_back(std::move(socket));
+    }
+    _socket = _shards.front();
+
+    if (_steer_cpu && _shards.size() > 1 && SockUtil::setReuseportCpu(_socket->rawFD(), _shards.size()) == -1) {
+        WarnL << "steer udp packets by cpu failed, fallback to hash by peer address: " << get_uv_errmsg(true);
+    }
 
     // 新建一个定时器定时管理这些 udp 会话
     std::weak_ptr<UdpServer> weak_self = std::static_pointer_cast<UdpServer>(shared_from_this());
@@ -90,25 +138,8 @@ void UdpServer::start_l(uint16_t port, const std::string &host) {
         return false;
     }, _poller);
 
-    if (!_socket->bindUdpSock(port, host.c_str())) {
-        // udp 绑定端口失败, 可能是由于端口占用或权限问题
-        std::string err = (StrPrinter << "Bind udp socket on " << host << " " << port << " failed: " << get_uv_errmsg(true));
-        throw std::runtime_error(err);
-    }
-
-    InfoL << "UDP server bind to [" << host << "]: " << port << ",fd:" << _socket->rawFD();
-}
-
-/**
- * @brief udp服务端Socket接收回调
- * 
- * @param buf       [in]数据
- * @param addr      [in]对端地址
- * @param addr_len  [in]对端地址长度
- */
-void UdpServer::onRead(Buffer::Ptr &buf, sockaddr *addr, int addr_len) {
-    const auto id = makeSockId((struct sockaddr *)addr, addr_len);
-    onRead_l(true, id, buf, addr, addr_len);
+    InfoL << "UDP server bind to [" << host << "]: " << port << ",fd:" << _socket->rawFD() << ",shards:" << _shards.size()
+          << (_single_socket ? ",single socket" : "");
 }
 
 /**
@@ -132,42 +163,97 @@ static void emitSessionRecv(const Session::Ptr &session, const Buffer::Ptr &buf)
 }
 
 /**
- * @brief udp服务端Socket接收到数据,获取或创建session,消息可能来自server fd，也可能来自peer fd
- * @param is_server_fd  [in]是否为server fd
- * @param id            [in]客户端id
- * @param buf           [in]数据
- * @param addr          [in]客户端地址
- * @param addr_len      [in]客户端地址长度
+ * @brief udp服务端Socket批量接收回调，连续来自同一对端的包只查找一次会话
+ * 
+ * @param buf   [in]数据数组
+ * @param addr  [in]对端地址数组
+ * @param count [in]包数量
+ * @param poller [in]收到数据的分片poller
  */
-void UdpServer::onRead_l(bool is_server_fd, const UdpServer::PeerIdType &id, Buffer::Ptr &buf, sockaddr *addr, int addr_len) {
-    // udp server fd收到数据时触发此函数；大部分情况下数据应该在peer fd触发，此函数应该不是热点函数
-    bool is_new = false;
-    if (auto helper = getOrCreateSession(id, buf, addr, addr_len, is_new)) {
-        //当前线程收到数据，直接处理数据
-        emitSessionRecv(helper, buf);
-        _last_session = helper;
-
-#if !defined(NDEBUG)
-        if (!is_new) {
-            // TraceL << "UDP packet incoming from " << (is_server_fd ? "server fd" : "other peer fd");//chw
+void UdpServer::onMultiRead(Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count, const EventLoop::Ptr &poller) {
+    Session::Ptr session;
+    EventLoop::Ptr session_poller;// 会话不在本分片时切换到会话所在poller处理
+    size_t peer = 0;// session对应的包序号
+    for (size_t i = 0; i < count; ++i) {
+        if (!session || !isSamePeer(addr[i], addr[peer])) {
+            auto id = makeSockId((struct sockaddr *)(addr + i), sizeof(struct sockaddr_storage));
+            bool is_new = false;
+            session = getOrCreateSession(id, buf[i], (struct sockaddr *)(addr + i), sizeof(struct sockaddr_storage), is_new, poller);
+            peer = i;
+            if (!session) {
+                continue;
+            }
+            auto &sock_poller = session->getSock()->getPoller();
+            session_poller = sock_poller == poller ? nullptr : sock_poller;
+        }
+        if (session_poller) {
+            // 同一对端的会话已由其他分片创建，数据交给会话所在poller
+            // buf[i]是本分片复用的接收缓存，下次recvmmsg会覆盖，拷贝一份再投递
+            auto data = std::make_shared<Buffer>();
+            if (data->SetCapacity(buf[i]->Size() + 1) == chw::fail) {
+                continue;
+            }
+            _RAM_CPY_(data->data(), data->Capacity(), buf[i]->data(), buf[i]->Size());
+            data->SetSize(buf[i]->Size());
+            data->SetSegSize(buf[i]->SegSize());
+            data->SetStamp(buf[i]->StampSw(), buf[i]->StampHw());
+            std::weak_ptr<Session> weak_session = session;
+            session_poller->async([weak_session, data]() {
+                if (auto strong_session = weak_session.lock()) {
+                    emitSessionRecv(strong_session, data);
+                }
+            }, false);
+            continue;
         }
-#endif
+        emitSessionRecv(session, buf[i]);
     }
+    if (session) {
+        setLastSession(session);
+    }
+}
+
+/**
+ * @brief 记录最后一个活动的客户端（任意分片poller线程执行）
+ * 
+ * @param session [in]会话
+ */
+void UdpServer::setLastSession(const Session::Ptr &session) {
+    std::lock_guard<std::mutex> lock(_session_mutex);
+    _last_session = session;
 }
 
 /**
  * @brief 定时管理 Session, UDP 会话需要根据需要处理超时
  */
 void UdpServer::onManagerSession() {
-    decltype(_session_map) copy_map;
+    std::vector<Session::Ptr> copy_map;
     {
-        std::lock_guard<std::recursive_mutex> lock(*_session_mutex);
-        //拷贝map，防止遍历时移除对象
-        copy_map = std::make_shared<std::unordered_map<PeerIdType, Session::Ptr> >(*_session_map);
+        std::lock_guard<std::mutex> lock(_session_mutex);
+        //拷贝会话，防止遍历时移除对象
+        copy_map.reserve(_session_map.size());
+        _session_map.for_each([&](const PeerIdType &, Session::Ptr &session) {
+            copy_map.emplace_back(session);
+        });
     }
-    auto lam = [copy_map]() {
-        for (auto &pr : *copy_map) {
-            auto &session = pr.second;
+    auto lam = [this, &copy_map]() {
+        for (auto &session : copy_map) {
+            auto &poller = session->getSock()->getPoller();
+            if (poller != _poller) {
+                //会话属于其他分片poller，切换到会话所在线程执行
+                std::weak_ptr<Session> weak_session = session;
+                poller->async([weak_session]() {
+                    auto strong_session = weak_session.lock();
+                    if (!strong_session) {
+                        return;
+                    }
+                    try {
+                        strong_session->onManager();
+                    } catch (exception &ex) {
+                        WarnL << "Exception occurred when emit onManager: " << ex.what();
+                    }
+                });
+                continue;
+            }
             try {
                 // UDP 会话需要处理超时
                 session->onManager();
@@ -188,19 +274,19 @@ void UdpServer::onManagerSession() {
  * @param addr      [in]对端地址
  * @param addr_len  [in]对端地址长度
  * @param is_new    [out]是否新接入连接
+ * @param poller    [in]新会话绑定的poller
  * @return Session::Ptr 会话
  */
-Session::Ptr UdpServer::getOrCreateSession(const UdpServer::PeerIdType &id, Buffer::Ptr &buf, sockaddr *addr, int addr_len, bool &is_new) {
+Session::Ptr UdpServer::getOrCreateSession(const UdpServer::PeerIdType &id, Buffer::Ptr &buf, sockaddr *addr, int addr_len, bool &is_new, const EventLoop::Ptr &poller) {
     {
         //减小临界区
-        std::lock_guard<std::recursive_mutex> lock(*_session_mutex);
-        auto it = _session_map->find(id);
-        if (it != _session_map->end()) {
-            return it->second;
+        std::lock_guard<std::mutex> lock(_session_mutex);
+        if (auto session = _session_map.find(id)) {
+            return *session;
         }
     }
     is_new = true;
-    return createSession(id, buf, addr, addr_len);
+    return createSession(id, buf, addr, addr_len, poller);
 }
 
 /**
@@ -210,35 +296,53 @@ Session::Ptr UdpServer::getOrCreateSession(const UdpServer::PeerIdType &id, Buff
  * @param buf       [in]buf
  * @param addr      [in]对端地址
  * @param addr_len  [in]对端地址长度
+ * @param poller    [in]会话绑定的poller
  * @return Session::Ptr 会话
  */
-Session::Ptr UdpServer::createSession(const PeerIdType &id, Buffer::Ptr &buf, struct sockaddr *addr, int addr_len) {
-    // 此处改成自定义获取poller对象，防止负载不均衡
-    auto socket = createSocket(_poller);
+Session::Ptr UdpServer::createSession(const PeerIdType &id, Buffer::Ptr &buf, struct sockaddr *addr, int addr_len, const EventLoop::Ptr &poller) {
+    // 会话绑定收到首包的分片poller，内核按对端地址把同一对端固定分发到同一分片，分片间负载由内核均衡
+    auto socket = createSocket(poller);
     if (!socket) {
         //创建socket失败，本次onRead事件收到的数据直接丢弃
         return nullptr;
     }
+    Socket::Ptr shard;// 单socket模式下会话共享fd的分片
+    if (_single_socket) {
+        for (auto &sock : _shards) {
+            if (sock->getPoller() == poller) {
+                shard = sock;
+                break;
+            }
+        }
+        if (!shard) {
+            return nullptr;
+        }
+    }
 
     auto addr_str = string((char *) addr, addr_len);
     std::weak_ptr<UdpServer> weak_self = std::static_pointer_cast<UdpServer>(shared_from_this());
-    auto helper_creator = [this, weak_self, socket, addr_str, id]() -> Session::Ptr {
+    auto helper_creator = [this, weak_self, socket, shard, addr_str, id]() -> Session::Ptr {
         auto server = weak_self.lock();
         if (!server) {
             return nullptr;
         }
 
         //如果已经创建该客户端对应的UdpSession类，那么直接返回
-        lock_guard<std::recursive_mutex> lck(*_session_mutex);
-        auto it = _session_map->find(id);
-        if (it != _session_map->end()) {
-            return it->second;
+        lock_guard<std::mutex> lck(_session_mutex);
+        if (auto session = _session_map.find(id)) {
+            return *session;
         }
 
         assert(_socket);
-        socket->bindUdpSock(_socket->get_local_port(), _socket->get_local_ip());
-        //chw:服务端必须使用硬绑定,否则内核无法正确把消息分发到各个接入的session
-        socket->bindPeerAddr((struct sockaddr *)addr_str.data(), sizeof(struct sockaddr));
+        if (shard) {
+            //单socket模式：共享分片的fd发送，软绑定对端地址，数据由分片接收后按对端地址分发
+            socket->shareSock(*shard);
+            socket->bindPeerAddr((struct sockaddr *)addr_str.data(), 0, true);
+        } else {
+            socket->bindUdpSock(_socket->get_local_port(), _socket->get_local_ip());
+            //chw:服务端必须使用硬绑定,否则内核无法正确把消息分发到各个接入的session
+            socket->bindPeerAddr((struct sockaddr *)addr_str.data(), sizeof(struct sockaddr));
+        }
 
         PrintD("create udp session ,local ip=%s,local port=%d,peer ip=%s,peer port=%d,fd=%d"
         ,socket->get_local_ip().c_str(),socket->get_local_port(),socket->get_peer_ip().c_str(),socket->get_peer_port(),socket->rawFD());
@@ -249,30 +353,33 @@ Session::Ptr UdpServer::createSession(const PeerIdType &id, Buffer::Ptr &buf, st
         // helper->session()->attachServer(*this);
 
         std::weak_ptr<Session> weak_session = session;
-        socket->setOnRead([weak_self, weak_session, id](Buffer::Ptr &buf, struct sockaddr *addr, int addr_len) {
+        struct sockaddr_storage peer_addr;
+        memset(&peer_addr, 0, sizeof(peer_addr));
+        memcpy(&peer_addr, addr_str.data(), std::min(addr_str.size(), sizeof(peer_addr)));
+        socket->setOnMultiRead([weak_self, weak_session, id, peer_addr](Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count) {
             auto strong_self = weak_self.lock();
             if (!strong_self) {
                 return;
             }
+            auto strong_session = weak_session.lock();
+            if (!strong_session) {
+                PrintD("error");
+                return;
+            }
 
-            //快速判断是否为本会话的的数据, 通常应该成立
-            if (id == makeSockId((struct sockaddr *)addr, addr_len)) 
-            {
-                if (auto strong_session = weak_session.lock()) {
-                    emitSessionRecv(strong_session, buf);
-                    strong_self->_last_session = strong_session;
+            for (size_t i = 0; i < count; ++i) {
+                //快速判断是否为本会话的的数据, 通常应该成立，地址不同时再按id比较
+                if (isSamePeer(peer_addr, addr[i]) || id == makeSockId((struct sockaddr *)(addr + i), sizeof(struct sockaddr_storage))) {
+                    emitSessionRecv(strong_session, buf[i]);
                 }
-                else 
+                //todo:id不同
+                else
+                {
                     PrintD("error");
-                return;
-            }
-            //todo:id不同
-            else
-            {
-                PrintD("error");
+                }
+                //收到非本peer fd的数据，让server去派发此数据到合适的session对象
             }
-
-            //收到非本peer fd的数据，让server去派发此数据到合适的session对象
+            strong_self->setLastSession(strong_session);
         });
         socket->setOnErr([weak_self, weak_session, id](const SockException &err) {
             // 在本函数作用域结束时移除会话对象
@@ -288,9 +395,14 @@ Session::Ptr UdpServer::createSession(const PeerIdType &id, Buffer::Ptr &buf, st
                 // 延时移除udp session, 防止频繁快速重建对象
                 strong_self->_poller->doDelayTask(kUdpDelayCloseMS, [weak_self, id]() {
                     if (auto strong_self = weak_self.lock()) {
-                        // 从共享map中移除本session对象
-                        lock_guard<std::recursive_mutex> lck(*strong_self->_session_mutex);
-                        strong_self->_session_map->erase(id);
+                        // 从共享map中移除本session对象，会话在锁外释放
+                        Session::Ptr session;
+                        lock_guard<std::mutex> lck(strong_self->_session_mutex);
+                        if (auto ptr = strong_self->_session_map.find(id)) {
+                            session = std::move(*ptr);
+                            strong_self->keepStampStat(session->getSock()->getStampStat());
+                            strong_self->_session_map.erase(id);
+                        }
                     }
                     return 0;
                 });
@@ -305,9 +417,9 @@ Session::Ptr UdpServer::createSession(const PeerIdType &id, Buffer::Ptr &buf, st
             }
         });
         
-        auto pr = _session_map->emplace(id, std::move(session));
+        auto pr = _session_map.emplace(id, std::move(session));
         assert(pr.second);
-        return pr.first->second;
+        return *pr.first;
     };
 
     if (socket->getPoller()->isCurrentThread()) {
@@ -328,7 +440,11 @@ Session::Ptr UdpServer::createSession(const PeerIdType &id, Buffer::Ptr &buf, st
  */
 uint32_t UdpServer::sendclientdata(char* buf, uint32_t len)
 {
-    auto strong_session = _last_session.lock();
+    Session::Ptr strong_session;
+    {
+        std::lock_guard<std::mutex> lock(_session_mutex);
+        strong_session = _last_session.lock();
+    }
     if (!strong_session) {
         PrintE("last session is null.");
         return 0;
@@ -339,6 +455,7 @@ uint32_t UdpServer::sendclientdata(char* buf, uint32_t len)
 
 /**
  * @brief 获取会话接收信息,避免session释放查询不到,包数量和总大小累加,序列号取最大值,速率采用当前值
+ *        会话和服务端Socket可能分布在多个分片poller,会话的统计计数为原子变量,可跨线程汇总
  *
  * @param rcv_num   [out]接收包的数量(每次调用后session保存的值清0,因此这里累加)
  * @param rcv_seq   [out]接收包的最大序列号
@@ -348,22 +465,41 @@ uint32_t UdpServer::sendclientdata(char* buf, uint32_t len)
 void UdpServer::GetRcvInfo(uint64_t& rcv_num,uint64_t& rcv_seq,uint64_t& rcv_len,uint64_t& rcv_speed)
 {
     uint64_t curr_seq = 0;
-    rcv_speed = _socket->getRecvSpeed();// 服务端接收速率
-
-    auto iter = _session_map->begin();
-    while(iter != _session_map->end())
-    {
-        rcv_num += iter->second->GetPktNum();
-        curr_seq += iter->second->GetSeq();
-        rcv_len += iter->second->GetRcvLen();
-        rcv_speed += iter->second->getSock()->getRecvSpeed();
-        iter ++;
+    rcv_speed = 0;
+    for (auto &socket : _shards) {
+        rcv_speed += socket->getRecvSpeed();// 服务端接收速率
     }
 
+    std::lock_guard<std::mutex> lock(_session_mutex);
+    _session_map.for_each([&](const PeerIdType &, Session::Ptr &session) {
+        rcv_num += session->GetPktNum();
+        curr_seq += session->GetSeq();
+        rcv_len += session->GetRcvLen();
+        rcv_speed += session->getSock()->getRecvSpeed();
+    });
+
     if(curr_seq > rcv_seq)
     {
         rcv_seq = curr_seq;
     }
 }
 
+void UdpServer::GetStampStat(Socket::StampStat &stat)
+{
+    stat += closedStampStat();
+    for (auto &socket : _shards) {
+        stat += socket->getStampStat();
+    }
+
+    std::lock_guard<std::mutex> lock(_session_mutex);
+    _session_map.for_each([&](const PeerIdType &, Session::Ptr &session) {
+        stat += session->getSock()->getStampStat();
+    });
+}
+
+void UdpServer::GetTcpInfo(SockUtil::TcpInfo &info, SockUtil::TcpInfo &interval, uint32_t &conns)
+{
+    // udp没有TCP_INFO
+}
+
 } // namespace chw
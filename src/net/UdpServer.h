@@ -5,9 +5,11 @@
 #define __UDP_SERVER_H
 
 #include <functional>
-#include <unordered_map>
+#include <mutex>
+#include <vector>
 #include "Session.h"
 #include "Server.h"
+#include "PeerTable.h"
 
 namespace chw {
 
@@ -18,11 +20,15 @@ namespace chw {
  * 3、这样当收到来自对端port和ip的数据时，内核会分发给使用了connect的Socket。
  * 4、linux：经测试connect后收到的消息会正确分发给session的Socket。
  * 5、windows：使用connect后还是UdpServer的Socket收到消息（todo:bug还是系统限制?）。
+ * 6、启用线程池(-j)时，每个poller绑定一个SO_REUSEPORT的服务端Socket(分片)，内核按对端地址把数据分发到各个分片，
+ *    会话Socket创建在收到首包的分片poller上，会话表所有分片共享。
+ * 7、单socket模式(setSingleSocket)不为对端创建connect的Socket，所有对端的数据都由服务端Socket接收，按对端地址查会话表分发，
+ *    会话通过共享服务端fd的Socket发送，对端很多时节省fd；windows上connect不能分发时也可使用。
  */
 class UdpServer : public Server {
 public:
     using Ptr = std::shared_ptr<UdpServer>;
-    using PeerIdType = std::string;
+    using PeerIdType = PeerKey;
 
     explicit UdpServer(const EventLoop::Ptr &poller = nullptr);
     ~UdpServer();
@@ -37,6 +43,36 @@ public:
      */
     virtual void GetRcvInfo(uint64_t& rcv_num,uint64_t& rcv_seq,uint64_t& rcv_len,uint64_t& rcv_speed) override;
 
+    /**
+     * @brief 汇总所有socket的收发时间戳统计
+     * 
+     * @param stat [out]时间戳统计
+     */
+    virtual void GetStampStat(Socket::StampStat &stat) override;
+
+    /**
+     * @brief 采样并合并所有tcp会话的连接状态(TCP_INFO)
+     * 
+     * @param info     [out]各会话当前值之和
+     * @param interval [out]各会话与上次采样的差值之和
+     * @param conns    [out]采样成功的会话数量
+     */
+    virtual void GetTcpInfo(SockUtil::TcpInfo &info, SockUtil::TcpInfo &interval, uint32_t &conns) override;
+
+    /**
+     * @brief 分片时按接收数据包的cpu选择分片(SO_ATTACH_REUSEPORT_CBPF)，代替内核默认的按对端地址哈希，需要在start之前设置
+     * 
+     * @param on [in]是否开启
+     */
+    void setSteerCpu(bool on) { _steer_cpu = on; }
+
+    /**
+     * @brief 单socket模式，不为每个对端创建connect的Socket，所有对端由服务端Socket接收分发，需要在start之前设置
+     * 
+     * @param on [in]是否开启
+     */
+    void setSingleSocket(bool on) { _single_socket = on; }
+
 private:
     /**
      * @brief 开始udp server
@@ -51,23 +87,14 @@ private:
     virtual void onManagerSession() override;
 
     /**
-     * @brief udp服务端Socket接收回调
+     * @brief udp服务端Socket批量接收回调，连续来自同一对端的包只查找一次会话
      * 
-     * @param buf       [in]数据
-     * @param addr      [in]对端地址
-     * @param addr_len  [in]对端地址长度
-     */
-    void onRead(Buffer::Ptr &buf, struct sockaddr *addr, int addr_len);
-
-    /**
-     * @brief udp服务端Socket接收到数据,获取或创建session,消息可能来自server fd，也可能来自peer fd
-     * @param is_server_fd  [in]是否为server fd
-     * @param id            [in]客户端id
-     * @param buf           [in]数据
-     * @param addr          [in]客户端地址
-     * @param addr_len      [in]客户端地址长度
+     * @param buf   [in]数据数组
+     * @param addr  [in]对端地址数组
+     * @param count [in]包数量
+     * @param poller [in]收到数据的分片poller
      */
-    void onRead_l(bool is_server_fd, const PeerIdType &id, Buffer::Ptr &buf, struct sockaddr *addr, int addr_len);
+    void onMultiRead(Buffer::Ptr *buf, struct sockaddr_storage *addr, size_t count, const EventLoop::Ptr &poller);
 
     /**
      * @brief 根据对端信息获取或创建一个会话
@@ -77,9 +104,10 @@ private:
      * @param addr      [in]对端地址
      * @param addr_len  [in]对端地址长度
      * @param is_new    [out]是否新接入连接
+     * @param poller    [in]新会话绑定的poller
      * @return Session::Ptr 会话
      */
-    Session::Ptr getOrCreateSession(const PeerIdType &id, Buffer::Ptr &buf, struct sockaddr *addr, int addr_len, bool &is_new);
+    Session::Ptr getOrCreateSession(const PeerIdType &id, Buffer::Ptr &buf, struct sockaddr *addr, int addr_len, bool &is_new, const EventLoop::Ptr &poller);
 
     /**
      * @brief 创建一个会话, 同时进行必要的设置
@@ -88,19 +116,32 @@ private:
      * @param buf       [in]buf
      * @param addr      [in]对端地址
      * @param addr_len  [in]对端地址长度
+     * @param poller    [in]会话绑定的poller
      * @return Session::Ptr 会话
      */
-    Session::Ptr createSession(const PeerIdType &id, Buffer::Ptr &buf, struct sockaddr *addr, int addr_len);
+    Session::Ptr createSession(const PeerIdType &id, Buffer::Ptr &buf, struct sockaddr *addr, int addr_len, const EventLoop::Ptr &poller);
 
     /**
     * @brief 创建服务端Socket，设置接收回调
     * 
+    * @param poller [in]Socket绑定的poller
+    * @return Socket::Ptr 服务端Socket
     */
-    void setupEvent();
+    Socket::Ptr setupEvent(const EventLoop::Ptr &poller);
+
+    /**
+     * @brief 记录最后一个活动的客户端（任意分片poller线程执行）
+     * 
+     * @param session [in]会话
+     */
+    void setLastSession(const Session::Ptr &session);
 
 private:
     std::shared_ptr<Timer> _timer;
-    std::shared_ptr<std::recursive_mutex> _session_mutex;
+    std::mutex _session_mutex;// 会话表和_last_session的锁，分片poller线程和服务端poller线程访问
+    std::vector<Socket::Ptr> _shards;// 服务端Socket分片，每个poller一个，_socket是第一个分片
+    bool _steer_cpu = false;// 按cpu选择分片
+    bool _single_socket = false;// 单socket模式
 
 //chw
 public:
@@ -114,7 +155,7 @@ public:
     virtual uint32_t sendclientdata(char* buf, uint32_t len) override;
     std::weak_ptr<Session> _last_session;// 最后一个活动的客户端
 private:
-    std::shared_ptr<std::unordered_map<PeerIdType, Session::Ptr> > _session_map;
+    PeerTable<Session::Ptr> _session_map;// 按对端地址索引的会话表，受 _session_mutex 保护
 };
 
 } // namespace chw